@@ -0,0 +1,185 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "snapshot.h"
+
+// Superinstructions: X(opcode, name, first, second). Each fuses a pair of
+// instructions that instruction profiles (kasd --profile-ops) show to run
+// one after the other most often. fuse_superinstructions rewrites the
+// first instruction of each such pair; the second stays in place, so jump
+// targets and source positions do not move, and the VM runs both with one
+// dispatch. A pair never starts with a jump, nor with OP_DEFINE, after
+// which a native declaration may begin.
+#define SUPERINSTRUCTIONS(X) \
+    X(OP_CONSTANT_DEFINE, "CONSTANT_DEFINE", OP_CONSTANT, OP_DEFINE) \
+    X(OP_LOAD_DEFINE, "LOAD_DEFINE", OP_LOAD, OP_DEFINE) \
+    X(OP_LOAD_LOAD, "LOAD_LOAD", OP_LOAD, OP_LOAD) \
+    X(OP_LOAD_CONSTANT, "LOAD_CONSTANT", OP_LOAD, OP_CONSTANT) \
+    X(OP_CONSTANT_LOAD, "CONSTANT_LOAD", OP_CONSTANT, OP_LOAD)
+
+// Stack machine instructions. Operators are specialized by the static
+// types the semantic analyzer resolved, so the VM never checks tags.
+typedef enum {
+    OP_CONSTANT,          // Push constants[operand]
+    OP_LOAD,              // Push the value of global names[operand]
+    OP_DEFINE,            // Pop into global names[operand]; flags = declared type
+    OP_POP,               // Discard the top of the stack
+
+    OP_NEGATE_INT,
+    OP_NEGATE_FLOAT,
+    OP_NOT,
+    OP_INT_TO_FLOAT,
+
+    OP_ADD_INT,
+    OP_SUBTRACT_INT,
+    OP_MULTIPLY_INT,
+    OP_DIVIDE_INT,
+    OP_MODULO_INT,
+    OP_ADD_FLOAT,
+    OP_SUBTRACT_FLOAT,
+    OP_MULTIPLY_FLOAT,
+    OP_DIVIDE_FLOAT,
+    OP_MODULO_FLOAT,
+    OP_CONCAT,
+
+    // Comparisons; flags = relational operator token
+    OP_COMPARE_INT,
+    OP_COMPARE_FLOAT,
+    OP_COMPARE_BOOL,
+    OP_COMPARE_STRING,
+    OP_COMPARE_NULL,      // Pops both operands; operand = precomputed ordering
+
+    // Short-circuit jumps to operand, leaving the condition on the stack
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
+
+    // Values the IR lowering computes once and uses again; operand = slot
+    OP_GET_LOCAL,         // Push a copy of locals[operand]
+    OP_SET_LOCAL,         // Pop into locals[operand]
+
+    // Superinstructions, one per SUPERINSTRUCTIONS entry
+#define SUPERINSTRUCTION_OPCODE(opcode, name, first, second) opcode,
+    SUPERINSTRUCTIONS(SUPERINSTRUCTION_OPCODE)
+#undef SUPERINSTRUCTION_OPCODE
+
+    OP_COUNT
+} OpCode;
+
+// Instruction a superinstruction starts with; other instructions are their own
+static inline OpCode base_opcode(uint8_t op) {
+    switch (op) {
+#define SUPERINSTRUCTION_BASE(opcode, name, first, second) case opcode: return first;
+        SUPERINSTRUCTIONS(SUPERINSTRUCTION_BASE)
+#undef SUPERINSTRUCTION_BASE
+        default: return (OpCode)op;
+    }
+}
+
+// Instruction a superinstruction expects after it
+static inline OpCode superinstruction_second(uint8_t op) {
+    switch (op) {
+#define SUPERINSTRUCTION_SECOND(opcode, name, first, second) case opcode: return second;
+        SUPERINSTRUCTIONS(SUPERINSTRUCTION_SECOND)
+#undef SUPERINSTRUCTION_SECOND
+        default: return OP_COUNT;
+    }
+}
+
+// Instructions run by one dispatch of an instruction
+static inline int superinstruction_length(uint8_t op) {
+    return base_opcode(op) == (OpCode)op ? 1 : 2;
+}
+
+// Fixed-size instruction
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t unused;
+    int32_t operand;
+} Instruction;
+
+// Source position of an instruction, for runtime errors
+typedef struct {
+    int32_t line;
+    int32_t column;
+} SourcePosition;
+
+// Constant pool entry; strings are offsets into the string table
+typedef struct {
+    uint32_t type;  // ValueType
+    uint32_t unused;
+    union {
+        int64_t as_int;
+        double as_float;
+        uint64_t as_bool;
+        uint64_t as_string;
+    } data;
+} Constant;
+
+// Compiled program. Every array has the same layout in memory and in a
+// .kasdc file, so a mapped file is executed in place.
+typedef struct {
+    Instruction* code;
+    SourcePosition* positions;  // One per instruction
+    int code_count;
+    int code_capacity;
+
+    Constant* constants;
+    int constant_count;
+    int constant_capacity;
+
+    uint32_t* names;  // Global names, as string table offsets
+    int name_count;
+    int name_capacity;
+
+    char* strings;    // Static String objects, 8-byte aligned
+    uint32_t strings_length;
+    uint32_t strings_capacity;
+
+    int max_stack;    // Deepest operand stack the code needs
+    int local_count;  // Slots OP_GET_LOCAL and OP_SET_LOCAL address
+
+    void* mapping;    // Backing file mapping, or NULL if the arrays are owned
+    size_t mapping_size;
+} Chunk;
+
+// Initialize an empty chunk
+void init_chunk(Chunk* chunk);
+
+// Append an instruction; returns its index
+int write_instruction(Chunk* chunk, OpCode op, uint8_t flags, int32_t operand, int line, int column);
+
+// Add a constant; strings are copied into the string table. Returns its index.
+int add_constant(Chunk* chunk, Value value);
+
+// Add a global name; returns its index. Callers deduplicate.
+int add_name(Chunk* chunk, const char* name);
+
+// String table access. Table strings are static, so values may share
+// them for as long as the chunk lives.
+static inline String* chunk_string_object(const Chunk* chunk, uint64_t offset) {
+    return (String*)(chunk->strings + offset);
+}
+
+static inline const char* chunk_string(const Chunk* chunk, uint64_t offset) {
+    return chunk_string_object(chunk, offset)->chars;
+}
+
+// Check that every index, offset and jump in a chunk is in range and that
+// every operand has the type its instruction expects. Variables the chunk
+// reads without defining must be in snapshot, which may be NULL.
+bool verify_chunk(const Chunk* chunk, const Snapshot* snapshot);
+
+// Rewrite the first instruction of every pair listed in SUPERINSTRUCTIONS
+void fuse_superinstructions(Chunk* chunk);
+
+// Disassembly name of an instruction
+const char* opcode_name(OpCode op);
+
+// Debug print a chunk
+void disassemble_chunk(const Chunk* chunk);
+
+// Free a chunk, unmapping it if it was loaded from a file
+void free_chunk(Chunk* chunk);
+
+#endif // BYTECODE_H
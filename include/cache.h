@@ -0,0 +1,56 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "closure.h"
+#include <stdatomic.h>
+
+// Default memory budget for the compiled script cache
+#define CACHE_DEFAULT_BUDGET (64u * 1024 * 1024)
+
+// Immutable compiled program, shared by reference between every context
+// and thread that runs the same source. Nothing in it changes after
+// creation except the reference count and LRU stamp.
+typedef struct {
+    atomic_int refcount;
+    atomic_uint_fast64_t last_used;  // LRU clock value of the latest hit
+    uint64_t hash;                   // Content hash of source and options
+    char* source;                    // Key, compared on hash match
+    size_t source_length;
+    int opt_level;
+    AstNode* program;                // Analyzed and optimized AST
+    ClosureProgram* closures;        // The AST compiled for execution
+    size_t size;                     // Approximate bytes held
+} CompiledScript;
+
+// Cache counters
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+} CacheStats;
+
+// Wrap a compiled program and compile it to closures; the caller holds
+// the only reference
+CompiledScript* create_compiled_script(const char* source, int opt_level, AstNode* program);
+
+// Reference counting
+void retain_compiled_script(CompiledScript* script);
+void release_compiled_script(CompiledScript* script);
+
+// Find a cached compilation of source; returns a new reference or NULL.
+// Lock-free: never blocks on concurrent inserts or evictions.
+CompiledScript* cache_lookup(const char* source, int opt_level);
+
+// Publish a compiled script. Returns a new reference to the cached
+// script, which is an existing entry if another thread won the race.
+CompiledScript* cache_insert(CompiledScript* script);
+
+// Configuration and statistics
+void cache_set_budget(size_t bytes);
+void cache_get_stats(CacheStats* stats);
+void cache_clear(void);
+
+#endif // CACHE_H
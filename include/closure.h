@@ -0,0 +1,59 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "interpreter.h"
+
+typedef struct Closure Closure;
+
+// Evaluate a closure, returning an owned value
+typedef Value (*ClosureFn)(Interpreter* interpreter, const Closure* closure);
+
+// An AST node compiled for direct execution. The function is chosen once
+// from the node type, operator and static types, and the operands it
+// needs are copied in, so running it neither dispatches on the node nor
+// reads it.
+struct Closure {
+    ClosureFn run;
+    int line;
+    int column;
+    union {
+        Value literal;                 // Borrowed from the AST
+        const char* name;              // Variable, borrowed from the AST
+        const Closure* operand;        // Unary operator or conversion
+        struct {
+            const Closure* left;
+            const Closure* right;
+            TokenType op;
+            bool same_type;            // For comparisons with null
+        } binary;
+        struct {
+            const char* name;
+            const Closure* initializer;
+            ValueType type;
+        } declaration;
+    } as;
+};
+
+// Compiled program: every closure in one array, children before parents
+typedef struct {
+    Closure* closures;
+    int closure_count;
+    const Closure** declarations;
+    int declaration_count;
+} ClosureProgram;
+
+// Compile an analyzed program. Literals and names are borrowed, so the
+// AST must outlive the result. The result is immutable and can be run by
+// several threads at once.
+ClosureProgram* compile_closures(const AstNode* program);
+
+// Run a compiled program, defining its globals in the interpreter's
+// environment. Returns false and sets had_error on a runtime error.
+bool run_closures(Interpreter* interpreter, const ClosureProgram* program);
+
+void free_closures(ClosureProgram* program);
+
+// Approximate memory held by a compiled program
+size_t closures_size(const ClosureProgram* program);
+
+#endif // CLOSURE_H
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 // Log levels
 #define LOG_NONE 0
@@ -39,8 +40,8 @@ typedef struct {
     int line;
     int column;
     char* message;
-    char* source_line;
-    int source_pos;
+    const char* source;   // Borrowed; must stay alive until print_error()
+    int source_pos;       // Byte offset of the error within source
     int source_len;
     bool has_error;
 } Error;
@@ -54,36 +55,96 @@ typedef enum {
     VALUE_STRING
 } ValueType;
 
-// Value structure
+// Reference count of strings that are never freed one by one, such as
+// those inside a mapped file or a region; they are shared without counting
+#define STRING_STATIC (-1)
+
+// Immutable, reference-counted string. Values share one by pointer, so
+// binding, passing and returning a string never copies its characters.
+// Nothing mutates strings today; an operation that does must copy unless
+// it holds the only reference.
+typedef struct {
+    atomic_int refcount;
+    uint32_t length;
+    uint32_t hash;      // FNV-1a of the characters
+    bool is_ascii;
+    bool is_interned;   // Unique among interned strings; see intern.h
+    char chars[];       // NUL-terminated
+} String;
+
+// Longest string stored inside a Value rather than in a heap String
+#define SHORT_STRING_MAX 15
+
+// short_length of a string value that points to a String
+#define STRING_ON_HEAP 0xFF
+
+// Bump allocator, see region.h
+typedef struct Region Region;
+
+// Value structure. A string is stored inline when it fits and in a String
+// otherwise, so strings up to SHORT_STRING_MAX bytes never allocate and
+// two equal strings always have the same representation.
 typedef struct {
     ValueType type;
+    uint8_t short_length;   // Length of an inline string, or STRING_ON_HEAP
     union {
         int64_t as_int;
         double as_float;
         bool as_bool;
-        char* as_string;
+        String* as_string;
+        char as_short[SHORT_STRING_MAX + 1];   // NUL-terminated
     } data;
 } Value;
 
-// Global state
+// Characters and length of a string value, whichever way it is stored
+static inline const char* string_chars(const Value* value) {
+    return value->short_length == STRING_ON_HEAP ? value->data.as_string->chars : value->data.as_short;
+}
+
+static inline size_t string_length(const Value* value) {
+    return value->short_length == STRING_ON_HEAP ? value->data.as_string->length : value->short_length;
+}
+
+// Per-context error and logging state. Every lexer, parser, analyzer,
+// optimizer and interpreter reports through the state it was created
+// with, so independent contexts can run on different threads.
 typedef struct {
     int log_level;
     Error error;
 } KasdState;
 
-// Global state instance
-extern KasdState kasd_state;
-
 // Initialize the KASD state
-void init_kasd_state(int log_level);
+void init_kasd_state(KasdState* state, int log_level);
 
 // Error handling functions
-void set_error(ErrorType type, int line, int column, const char* message, const char* source_line, int source_pos, int source_len);
-void print_error(void);
-void clear_error(void);
+void set_error(KasdState* state, ErrorType type, int line, int column, const char* message, const char* source, int source_pos, int source_len);
+void print_error(KasdState* state);
+char* format_error(KasdState* state);
+void clear_error(KasdState* state);
 
 // Logging functions
-void log_message(int level, const char* format, ...);
+void log_message(KasdState* state, int level, const char* format, ...);
+
+// FNV-1a hash of a byte range; seed distinguishes otherwise equal inputs
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed);
+
+// Replace a file atomically with the given contents
+bool write_file_atomically(const char* path, const void* data, size_t size);
+
+// String functions
+String* create_string(const char* chars, size_t length);
+String* retain_string(String* string);
+void release_string(String* string);
+
+// Hash stored in a String with these characters
+uint32_t hash_chars(const char* chars, size_t length);
+
+// Bytes a string of the given length occupies
+size_t string_size(size_t length);
+
+// Build a static string in caller-provided memory of string_size(length)
+// bytes, e.g. inside a file image
+void init_static_string(void* memory, const char* chars, size_t length);
 
 // Value functions
 Value create_null_value(void);
@@ -91,6 +152,12 @@ Value create_int_value(int64_t value);
 Value create_float_value(double value);
 Value create_bool_value(bool value);
 Value create_string_value(const char* value);
+Value create_string_value_length(const char* chars, size_t length);
+Value create_shared_string_value(String* string);
+Value concat_string_values(Value left, Value right, Region* region);
+bool string_values_equal(Value left, Value right);
+int compare_string_values(Value left, Value right);
+Value copy_value(Value value);
 void free_value(Value value);
 char* value_to_string(Value value);
 const char* value_type_to_string(ValueType type);
@@ -0,0 +1,16 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "parser.h"
+#include "bytecode.h"
+#include "ir.h"
+
+// Compile an analyzed (and optionally optimized) program into a chunk
+void compile_program(Chunk* chunk, AstNode* program);
+
+// Compile a program in SSA form into a chunk. A value is computed where
+// it is used when that is its only use; otherwise it is computed once
+// into a local slot.
+void compile_ir(Chunk* chunk, const IrProgram* program);
+
+#endif // COMPILER_H
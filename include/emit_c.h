@@ -0,0 +1,12 @@
+#ifndef EMIT_C_H
+#define EMIT_C_H
+
+#include "parser.h"
+
+// Translate an analyzed (and optionally optimized) program into a C
+// program that computes the same variables and prints them like the REPL.
+// Values are untagged C types chosen from the static types, and the
+// output only needs kasd_runtime.h and lib/libkasdrt.a.
+void emit_c_program(FILE* out, const AstNode* program, const char* source_name);
+
+#endif // EMIT_C_H
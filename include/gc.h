@@ -0,0 +1,63 @@
+#ifndef GC_H
+#define GC_H
+
+#include "region.h"
+
+// Bytes of young strings allocated before a minor collection is due
+#define GC_NURSERY_SIZE (256 * 1024)
+
+// Collector counters
+typedef struct {
+    uint64_t collections;
+    uint64_t total_pause_ns;
+    uint64_t max_pause_ns;
+    uint64_t bytes_allocated;  // Young strings allocated
+    uint64_t bytes_promoted;   // Young strings that survived a collection
+    uint64_t start_ns;         // Creation time of the heap, for rates
+} GcStats;
+
+// Generational heap for strings built at runtime. New strings are bump
+// allocated in a nursery and are not reference counted. Storing one in a
+// variable records the variable's slot in a remembered set; those slots
+// are the only roots, since no temporaries are live at a safe point. A
+// minor collection copies the young strings the roots still reach into
+// the reference-counted old generation, then resets the nursery at once.
+// Old strings refer to nothing, so they need no tracing.
+typedef struct {
+    Region nursery;
+    size_t nursery_bytes;      // Allocated since the last collection
+    Value** remembered;
+    int remembered_count;
+    int remembered_capacity;
+    GcStats stats;
+} Heap;
+
+void init_heap(Heap* heap);
+void free_heap(Heap* heap);
+
+// Concatenate two strings, allocating a long result in the nursery
+Value heap_concat(Heap* heap, Value left, Value right);
+
+// Write barrier: call after storing a value into a slot that outlives
+// the current statement
+void gc_write_barrier(Heap* heap, Value* slot);
+
+// Drop remembered slots inside an array that is about to be freed; young
+// strings only it held are reclaimed by the next collection
+void gc_forget(Heap* heap, const Value* slots, int count);
+
+// Collect if the nursery is full. Only call where no young value is held
+// anywhere but in remembered slots, e.g. between statements.
+void gc_safepoint(Heap* heap);
+
+// Run a minor collection now, under the same conditions as gc_safepoint
+void gc_collect(Heap* heap);
+
+// Discard every young string and the remembered set, once the slots
+// themselves are gone
+void gc_reset(Heap* heap);
+
+// Statistics
+void print_gc_stats(const Heap* heap);
+
+#endif // GC_H
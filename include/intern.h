@@ -0,0 +1,28 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "common.h"
+
+// Process-wide set of interned strings. Equal interned strings are the
+// same object, so comparing two of them is a pointer comparison. The set
+// holds no references: a string leaves it when its last reference goes.
+
+// Find or create the interned string with these characters; returns a
+// new reference
+String* create_interned_string(const char* chars, size_t length);
+
+// String value for the characters, interned if too long to store inline
+Value create_interned_string_value(const char* chars, size_t length);
+
+// Replace a long string value with its interned equivalent, consuming
+// the value; anything else is returned unchanged
+Value intern_value(Value value);
+
+// Remove a string whose reference count reached zero. Called by
+// release_string before it frees an interned string.
+void unintern_string(String* string);
+
+// Number of strings currently interned
+size_t interned_string_count(void);
+
+#endif // INTERN_H
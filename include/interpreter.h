@@ -2,6 +2,8 @@
 #define INTERPRETER_H
 
 #include "semantic.h"
+#include "snapshot.h"
+#include "gc.h"
 
 // Environment entry
 typedef struct EnvEntry {
@@ -10,9 +12,18 @@ typedef struct EnvEntry {
     struct EnvEntry* next;
 } EnvEntry;
 
-// Environment
+// Environment: variables defined at runtime, layered over an optional
+// read-only snapshot. With a region, entries and the strings they hold
+// come from it and are discarded together by env_clear; otherwise strings
+// built at runtime live in the garbage-collected heap. Entries are only
+// ever freed together, which gives the environment a new generation,
+// so a pointer to an entry's value stays valid while the generation does.
 typedef struct {
     EnvEntry* head;
+    const Snapshot* base;
+    Region* region;
+    Heap heap;
+    uint64_t generation;  // Unique across all environments
 } Environment;
 
 // Interpreter
@@ -20,14 +31,41 @@ typedef struct {
     Environment env;
     bool had_error;
     bool repl_mode;
+    KasdState* state;
 } Interpreter;
 
+// Define or redefine a variable; the environment takes its own reference to value
+void env_define(Environment* env, const char* name, Value value);
+
+// Find a variable; the value is borrowed from the environment
+bool env_get(Environment* env, const char* name, Value* value);
+
+// Find the slot holding a variable defined at runtime, or NULL. The slot
+// is valid until the environment's generation changes.
+Value* env_slot(Environment* env, const char* name);
+
+// Concatenate strings in the environment's region or heap
+Value env_concat(Environment* env, Value left, Value right);
+
+// Remove every variable; with a region this resets it in O(1) instead of
+// visiting each entry
+void env_clear(Environment* env);
+
+// Remove the variables defined after mark (an earlier head). Like
+// env_clear, this starts a new generation. A region keeps their memory
+// until it is reset.
+void env_rollback(Environment* env, EnvEntry* mark);
+
 // Initialize interpreter
-void init_interpreter(Interpreter* interpreter, bool repl_mode);
+void init_interpreter(Interpreter* interpreter, KasdState* state, bool repl_mode);
 
-// Execute AST
+// Execute AST. Nodes specialize themselves as they run, so one AST must
+// not be interpreted by two threads at once.
 Value interpret(Interpreter* interpreter, AstNode* node);
 
+// Look up a variable's current value; the value is borrowed
+bool lookup_variable(Interpreter* interpreter, const char* name, Value* value);
+
 // Clean up interpreter
 void free_interpreter(Interpreter* interpreter);
 
@@ -0,0 +1,124 @@
+#ifndef IR_H
+#define IR_H
+
+#include "parser.h"
+
+// Instructions of the SSA form. Every instruction that produces a value
+// is that value; operators are specialized by static type, as in bytecode.
+typedef enum {
+    IR_CONSTANT,       // as.constant
+    IR_LOAD,           // Global defined before this program, as.name
+    IR_DEFINE,         // Define global as.name as args[0]; type = declared type
+
+    IR_NEGATE_INT,
+    IR_NEGATE_FLOAT,
+    IR_NOT,
+    IR_INT_TO_FLOAT,
+
+    IR_ADD_INT,
+    IR_SUBTRACT_INT,
+    IR_MULTIPLY_INT,
+    IR_DIVIDE_INT,
+    IR_MODULO_INT,
+    IR_ADD_FLOAT,
+    IR_SUBTRACT_FLOAT,
+    IR_MULTIPLY_FLOAT,
+    IR_DIVIDE_FLOAT,
+    IR_MODULO_FLOAT,
+    IR_CONCAT,
+
+    // Comparisons; as.compare = relational operator
+    IR_COMPARE_INT,
+    IR_COMPARE_FLOAT,
+    IR_COMPARE_BOOL,
+    IR_COMPARE_STRING,
+
+    // Result of && or ||: args[0] if the branch skipped the right operand,
+    // else args[1]. as.targets = first and last block of the right operand.
+    IR_PHI,
+
+    // Terminators
+    IR_BRANCH,         // To as.targets[0] if args[0] is true, else as.targets[1]
+    IR_JUMP,           // To as.targets[0]
+
+    IR_COUNT
+} IrOp;
+
+typedef struct {
+    IrOp op;
+    ValueType type;    // Type of the result
+    int block;
+    int args[2];       // Operand values, or -1
+    int line;
+    int column;
+    bool dead;         // Removed by a pass
+    union {
+        Value constant;        // Borrowed from the AST
+        const char* name;      // Borrowed from the AST
+        TokenType compare;
+        int targets[2];
+    } as;
+} IrValue;
+
+// Basic block. Blocks are laid out in evaluation order: the right operand
+// of && and || follows the block that branches around it, and the join
+// block follows the right operand.
+typedef struct {
+    int* code;         // Values in order, the terminator last
+    int count;
+    int capacity;
+    int idom;          // Immediate dominator, -1 for the entry block
+    int chain;         // Blocks that run one after another without a branch
+                       // around them share a chain: a join continues the
+                       // chain of the block that branched
+} IrBlock;
+
+typedef struct {
+    IrValue* values;
+    int value_count;
+    int value_capacity;
+    IrBlock* blocks;
+    int block_count;
+    int block_capacity;
+    int chain_count;
+} IrProgram;
+
+// Optimization passes, run in this order by optimize_ir
+#define IR_PASS_COUNT 4
+
+typedef struct {
+    const char* name;
+    int changes;        // Values replaced or removed
+    uint64_t time_ns;
+} IrPassStats;
+
+typedef struct {
+    int values_before;
+    int values_after;
+    IrPassStats passes[IR_PASS_COUNT];
+} IrStats;
+
+// Lower an analyzed (and optionally optimized) program. Names and
+// literals are borrowed, so the AST must outlive the result.
+IrProgram* build_ir(const AstNode* program);
+
+// Run every pass once, adding to stats
+void optimize_ir(IrProgram* program, IrStats* stats);
+
+// Whether a value may stop the program with a division by zero
+bool ir_may_trap(const IrProgram* program, int value);
+
+// Whether block a dominates block b
+bool ir_dominates(const IrProgram* program, int a, int b);
+
+// Drop dead values from the blocks
+void ir_compact(IrProgram* program);
+
+// Debug print a program
+void print_ir(const IrProgram* program);
+
+void print_ir_stats(const IrStats* stats);
+
+void free_ir(IrProgram* program);
+
+#endif // IR_H
@@ -0,0 +1,76 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "bytecode.h"
+
+// Declarations shorter than this are left to the VM, since calling native
+// code costs about as much as interpreting them
+#define JIT_MIN_INSTRUCTIONS 4
+
+// Most variables one native declaration may read
+#define JIT_MAX_INPUTS 256
+
+// Native code for one declaration. Takes the raw payloads of the
+// variables it reads, each once in the order they are first loaded, and
+// stores the raw payload of its result. Returns -1, or the index of the
+// instruction that divided by zero.
+typedef int64_t (*JitFunction)(const uint64_t* inputs, uint64_t* result);
+
+// A declaration compiled to native code: instructions start..end, where
+// end is its OP_DEFINE
+typedef struct {
+    int start;
+    int end;
+    JitFunction function;
+    const int32_t* loads;  // Name operands of the variables it reads
+    int load_count;
+} JitRegion;
+
+// Native tier counters
+typedef struct {
+    int declarations;       // Declarations in the chunk
+    int compiled;           // Declarations compiled to native code
+    uint64_t entries;       // Native declarations reached
+    uint64_t side_exits;    // Of those, left for the VM because a guard on
+                            // an input failed, or ended by a division trap
+    uint64_t native_ns;     // Time in native code, when timed
+    uint64_t compile_ns;
+} JitStats;
+
+// Native code for the numeric declarations of a chunk
+typedef struct {
+    JitRegion* regions;
+    int region_count;
+    int* region_at;     // Per instruction: region starting there, or -1
+    int32_t* loads;
+    void* code;         // Executable mapping, never writable at once
+    size_t code_size;
+    JitStats stats;
+    bool timed;         // Measure time in native code
+} JitCode;
+
+// Whether native code can be generated on this platform (x86-64 Linux)
+bool jit_available(void);
+
+// Compile every declaration of a chunk that only computes with ints,
+// floats and bools into native code by stitching one machine code
+// template per instruction. Operand types come from the opcodes the
+// compiler specialized, so values are untagged. Returns NULL if nothing
+// qualifies or the platform is not supported.
+JitCode* jit_compile(const Chunk* chunk);
+
+// Native region starting at an instruction, or NULL
+static inline const JitRegion* jit_region(const JitCode* jit, int ip) {
+    int index = jit->region_at[ip];
+    return index < 0 ? NULL : &jit->regions[index];
+}
+
+// Call a region's native code, timing it if asked
+int64_t jit_call(JitCode* jit, const JitRegion* region, const uint64_t* inputs, uint64_t* result);
+
+void jit_free(JitCode* jit);
+
+// Statistics; jit may be NULL when nothing was compiled
+void print_jit_stats(const JitCode* jit);
+
+#endif // JIT_H
@@ -2,6 +2,7 @@
 #define KASD_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // Log levels
 #define KASD_LOG_NONE 0
@@ -30,12 +31,60 @@ typedef struct {
     } data;
 } KasdValue;
 
+// Compiled script cache counters
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    size_t entries;
+    size_t bytes;   // Approximate memory held by cached scripts
+    size_t budget;
+} KasdCacheStats;
+
+// Garbage collector counters of a context
+typedef struct {
+    unsigned long long collections;
+    unsigned long long total_pause_ns;
+    unsigned long long max_pause_ns;
+    unsigned long long bytes_allocated;  // Strings built at runtime
+    unsigned long long bytes_promoted;   // Of those, bytes that outlived a collection
+} KasdGcStats;
+
+// Memory allocator for runtime objects: variables, symbols and strings.
+// Small objects are carved from slabs it provides; larger ones are
+// allocated from it directly. Memory must be 16-byte aligned, and both
+// functions may be called from any thread.
+typedef struct {
+    void* (*allocate)(void* user_data, size_t size);
+    void (*deallocate)(void* user_data, void* pointer, size_t size);
+    void* user_data;
+} KasdAllocator;
+
 // KASD context
 typedef struct KasdContext KasdContext;
 
+// Compiled KASD script, reusable across runs
+typedef struct KasdScript KasdScript;
+
+// Route runtime object allocations through an allocator; NULL restores
+// malloc. Must be called before anything is run. Returns false if memory
+// has already been allocated.
+bool kasd_set_allocator(const KasdAllocator* allocator);
+
 // Create a new KASD context
 KasdContext* kasd_create_context(int log_level);
 
+// Create a context for short-lived runs, such as one per request. Every
+// variable and string that kasd_run creates in it comes from a region,
+// and kasd_reset_context discards them all in O(1) without visiting them.
+// Only the names the script declared are freed one by one.
+KasdContext* kasd_create_region_context(int log_level);
+
+// Forget every variable, leaving the context as if new. Copy out anything
+// still needed with kasd_get_variable first. After kasd_execute, this
+// also frees that code's symbols and programs one by one.
+void kasd_reset_context(KasdContext* context);
+
 // Free a KASD context
 void kasd_free_context(KasdContext* context);
 
@@ -45,11 +94,42 @@ bool kasd_execute(KasdContext* context, const char* source);
 // Execute KASD code in REPL mode
 bool kasd_execute_repl(KasdContext* context, const char* source);
 
+// Compile KASD code once: lex, parse, analyze and optimize it into a
+// reusable script. The script is self-contained; it cannot refer to
+// variables defined by earlier calls. Compiled code is immutable and
+// cached process-wide, so compiling the same source again from any
+// context or thread shares the earlier result. Returns NULL on error.
+KasdScript* kasd_compile(KasdContext* context, const char* source);
+
+// Run a compiled script in a context, defining its variables there. Later
+// calls to kasd_execute can read them. Fails without running anything if
+// the context already declares one of them with another type; running the
+// same script again defines its variables again. After a runtime error
+// none of the variables it defined are kept.
+bool kasd_run(KasdContext* context, const KasdScript* script);
+
+// Free a compiled script
+void kasd_free_script(KasdScript* script);
+
+// Compiled script cache: counters, memory budget (least recently used
+// scripts are evicted beyond it) and clearing. Thread-safe; scripts still
+// held by callers stay valid after eviction.
+void kasd_cache_get_stats(KasdCacheStats* stats);
+void kasd_cache_set_budget(size_t bytes);
+void kasd_cache_clear(void);
+
+// Read a context's garbage collector counters. Strings built at runtime
+// are collected automatically at statement boundaries.
+void kasd_get_gc_stats(KasdContext* context, KasdGcStats* stats);
+
+// Copy a variable's value out of a context; free it with kasd_free_value
+bool kasd_get_variable(KasdContext* context, const char* name, KasdValue* value);
+
 // Get the last error message
 const char* kasd_get_error(KasdContext* context);
 
 // Create KASD values
-KasdValue kasd_null();
+KasdValue kasd_null(void);
 KasdValue kasd_int(long long value);
 KasdValue kasd_float(double value);
 KasdValue kasd_bool(bool value);
@@ -0,0 +1,78 @@
+#ifndef KASD_RUNTIME_H
+#define KASD_RUNTIME_H
+
+// Runtime for C translated from KASD by kasd --emit-c. It only depends on
+// the C standard library; build it with make runtime and link translated
+// programs against lib/libkasdrt.a. The interpreter is built with the same
+// string and formatting functions, so both give identical results.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Immutable string. Translated programs run straight through once, so
+// strings built at runtime are never freed.
+typedef struct {
+    const char* chars;  // NUL-terminated
+    size_t length;
+} KasdString;
+
+// Integer arithmetic wraps on overflow, as in the interpreter
+static inline int64_t kasd_rt_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t kasd_rt_subtract(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t kasd_rt_multiply(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t kasd_rt_negate(int64_t a) { return (int64_t)(0 - (uint64_t)a); }
+
+// Report a division by zero at a source position and exit
+void kasd_rt_division_by_zero(int line, int column);
+
+static inline int64_t kasd_rt_divide(int64_t a, int64_t b, int line, int column) {
+    if (b == 0) {
+        kasd_rt_division_by_zero(line, column);
+    }
+    return b == -1 ? kasd_rt_negate(a) : a / b;
+}
+
+static inline int64_t kasd_rt_modulo(int64_t a, int64_t b, int line, int column) {
+    if (b == 0) {
+        kasd_rt_division_by_zero(line, column);
+    }
+    return b == -1 ? 0 : a % b;
+}
+
+// Three-way comparison of strings
+int kasd_rt_compare_string(KasdString left, KasdString right);
+
+// Write left and right, then a NUL, to chars, which has room for them
+void kasd_rt_concat_into(char* chars, KasdString left, KasdString right);
+
+KasdString kasd_rt_concat(KasdString left, KasdString right);
+
+// Float with an exact bit pattern, for infinities and NaNs
+static inline double kasd_rt_float_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Room for the text of any int or float
+#define KASD_RT_NUMBER_SIZE 32
+
+// Text of a value as the REPL prints it. A quoted string needs
+// length + 3 bytes.
+void kasd_rt_format_int(char* buffer, int64_t value);
+void kasd_rt_format_float(char* buffer, double value);
+const char* kasd_rt_format_bool(bool value);
+void kasd_rt_format_string(char* buffer, KasdString value);
+
+// Print a declared variable the way the REPL does; a variable declared
+// with a type but holding null is printed with null and that type
+void kasd_rt_print_int(const char* name, int64_t value);
+void kasd_rt_print_float(const char* name, double value);
+void kasd_rt_print_bool(const char* name, bool value);
+void kasd_rt_print_string(const char* name, KasdString value);
+void kasd_rt_print_null(const char* name, const char* type);
+
+#endif // KASD_RUNTIME_H
@@ -0,0 +1,34 @@
+#ifndef KASDC_H
+#define KASDC_H
+
+#include "bytecode.h"
+
+// Compiled file format version; bump whenever the layout, the opcodes or
+// the encoding of operands changes
+#define KASDC_VERSION 6
+
+// File extension for compiled scripts
+#define KASDC_EXTENSION ".kasdc"
+
+// Everything besides the source that compiled code depends on
+typedef struct {
+    int opt_level;
+    bool export_globals;     // Unread declarations were kept
+    uint64_t snapshot_hash;  // Snapshot the source was analyzed against, or 0
+} CompileKey;
+
+// Path of the compiled file for a source file: next to the source, or in
+// cache_dir if it is not NULL. Returns a new string.
+char* compiled_file_path(const char* source_path, const char* cache_dir);
+
+// Map a compiled file. Fails unless it was compiled from exactly this
+// source with the same key by this format version, and its code passes
+// verify_chunk against snapshot (the one key was made from, or NULL). On
+// success the chunk points into the mapping and is freed with free_chunk.
+bool load_compiled_file(const char* path, Chunk* chunk, const char* source, const CompileKey* key,
+                        const Snapshot* snapshot);
+
+// Write a compiled file atomically; a failure leaves any old file intact
+bool write_compiled_file(const char* path, const Chunk* chunk, const char* source, const CompileKey* key);
+
+#endif // KASDC_H
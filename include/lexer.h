@@ -21,7 +21,25 @@ typedef enum {
     TOKEN_TYPE_FLOAT,
     TOKEN_TYPE_BOOL,
     TOKEN_TYPE_STRING,
-    TOKEN_TYPE_NULL
+    TOKEN_TYPE_NULL,
+    
+    // Operators and grouping
+    TOKEN_LEFT_PAREN,
+    TOKEN_RIGHT_PAREN,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_PERCENT,
+    TOKEN_BANG,
+    TOKEN_BANG_EQUAL,
+    TOKEN_EQUAL_EQUAL,
+    TOKEN_LESS,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_AND_AND,
+    TOKEN_OR_OR
 } TokenType;
 
 // Token structure
@@ -34,7 +52,10 @@ typedef struct {
     union {
         int64_t as_int;
         double as_float;
-        char* as_string;
+        struct {
+            const char* chars;  // Points into the source
+            int length;
+        } as_string;
     } value;
 } Token;
 
@@ -47,10 +68,11 @@ typedef struct {
     int column;
     Token previous;
     bool had_error;
+    KasdState* state;
 } Lexer;
 
-// Initialize lexer with source code
-void init_lexer(Lexer* lexer, const char* source);
+// Initialize lexer with source code, reporting errors to state
+void init_lexer(Lexer* lexer, const char* source, KasdState* state);
 
 // Get the next token
 Token scan_token(Lexer* lexer);
@@ -0,0 +1,26 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include "lexer.h"
+
+// Apply a binary operator to two values.
+// Returns false (leaving result untouched) if the operator is not defined
+// for the operand types or would trap, e.g. integer division by zero.
+// Operands are not consumed; a string result is newly allocated.
+bool apply_binary_operator(TokenType op, Value left, Value right, Value* result);
+
+// Apply a unary operator to a value, with the same contract as above
+bool apply_unary_operator(TokenType op, Value operand, Value* result);
+
+// Type-specialized kernels shared by the folder and the interpreter.
+// int_arithmetic wraps on overflow; the caller rejects a zero divisor.
+int64_t int_arithmetic(TokenType op, int64_t left, int64_t right);
+double float_arithmetic(TokenType op, double left, double right);
+bool compare_result(TokenType op, int cmp);
+// Floats are not three-way: a relation with NaN is false, except !=
+bool float_compare(TokenType op, double left, double right);
+
+// Source spelling of an operator token, for diagnostics
+const char* operator_to_string(TokenType op);
+
+#endif // OPERATORS_H
@@ -0,0 +1,64 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parser.h"
+#include "snapshot.h"
+
+// Optimization levels
+#define OPT_LEVEL_NONE 0
+#define OPT_LEVEL_BASIC 1
+#define OPT_LEVEL_FULL 2   // Also optimize bytecode programs in SSA form
+
+// Optimizer statistics
+typedef struct {
+    int nodes_before;
+    int nodes_after;
+    int constants_propagated;
+    int expressions_folded;
+    int declarations_removed;
+} OptimizerStats;
+
+// Known constant: a variable whose initializer folded to a literal
+typedef struct ConstantEntry {
+    const char* name;
+    AstNode* literal;
+    struct ConstantEntry* next;
+} ConstantEntry;
+
+// Read count of a declared variable, used by the liveness pass
+typedef struct LivenessEntry {
+    const char* name;
+    int reads;
+    struct LivenessEntry* next;
+} LivenessEntry;
+
+// Optimizer
+typedef struct {
+    int level;
+    bool export_globals;  // Keep every declaration visible to the REPL/embedder
+    ConstantEntry* constants;
+    const Snapshot* snapshot;  // Its variables are constants too, or NULL
+    OptimizerStats stats;
+    KasdState* state;
+} Optimizer;
+
+// Initialize optimizer
+void init_optimizer(Optimizer* optimizer, KasdState* state, int level, bool export_globals);
+
+// Optimize an analyzed AST in place
+void optimize(Optimizer* optimizer, AstNode* node);
+
+// Forget the constant recorded for a variable, e.g. one that a compiled
+// script is about to define again
+void forget_constant(Optimizer* optimizer, const char* name);
+
+// Forget constants recorded after mark (a previous constants head)
+void rollback_constants(Optimizer* optimizer, ConstantEntry* mark);
+
+// Print optimizer statistics
+void print_optimizer_stats(Optimizer* optimizer);
+
+// Clean up optimizer
+void free_optimizer(Optimizer* optimizer);
+
+#endif // OPTIMIZER_H
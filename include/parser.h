@@ -5,17 +5,48 @@
 
 // Node types for AST
 typedef enum {
+    NODE_PROGRAM,
     NODE_VARIABLE_DECLARATION,
-    NODE_LITERAL
+    NODE_LITERAL,
+    NODE_VARIABLE,
+    NODE_UNARY,
+    NODE_BINARY,
+    NODE_CONVERT
 } NodeType;
 
+// Specialized form of a node, chosen by the interpreter the first time it
+// runs the node. Each form checks its assumption and falls back to the
+// generic evaluation of node->type when it no longer holds.
+typedef enum {
+    QUICK_NONE,
+    QUICK_CONSTANT,        // Literal that needs no copy
+    QUICK_VARIABLE_SLOT,   // Variable read through a cached slot
+    QUICK_ADD_INT,
+    QUICK_SUBTRACT_INT,
+    QUICK_MULTIPLY_INT,
+    QUICK_COMPARE_INT,
+    QUICK_ADD_FLOAT,
+    QUICK_SUBTRACT_FLOAT,
+    QUICK_MULTIPLY_FLOAT,
+    QUICK_DIVIDE_FLOAT
+} QuickKind;
+
 // AST node structure
 typedef struct AstNode {
     NodeType type;
+    ValueType value_type;  // Resolved static type, set by the semantic analyzer
+    QuickKind quick;       // Set by the interpreter
     int line;
     int column;
     
     union {
+        // Program: sequence of declarations
+        struct {
+            struct AstNode** declarations;
+            int count;
+            int capacity;
+        } program;
+        
         // Variable declaration
         struct {
             char* name;
@@ -25,6 +56,31 @@ typedef struct AstNode {
         
         // Literal value
         Value literal;
+        
+        // Variable reference
+        struct {
+            char* name;
+            Value* slot;          // Cached by the interpreter
+            uint64_t generation;  // Environment generation the slot belongs to
+        } variable;
+        
+        // Unary operation
+        struct {
+            TokenType op;
+            struct AstNode* operand;
+        } unary;
+        
+        // Binary operation
+        struct {
+            TokenType op;
+            struct AstNode* left;
+            struct AstNode* right;
+        } binary;
+        
+        // Conversion of operand to value_type, inserted by the analyzer
+        struct {
+            struct AstNode* operand;
+        } convert;
     } as;
 } AstNode;
 
@@ -43,6 +99,9 @@ void init_parser(Parser* parser, Lexer* lexer);
 // Parse source code into AST
 AstNode* parse(Parser* parser);
 
+// Create a new AST node
+AstNode* create_node(NodeType type, int line, int column);
+
 // Free AST nodes
 void free_ast(AstNode* node);
 
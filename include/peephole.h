@@ -0,0 +1,24 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "bytecode.h"
+
+// Rules in the peephole table, in the order they are tried
+#define PEEPHOLE_RULE_COUNT 11
+
+typedef struct {
+    int instructions_before;
+    int instructions_after;
+    int hits[PEEPHOLE_RULE_COUNT];  // Times each rule rewrote the code
+} PeepholeStats;
+
+// Rewrite short sequences of a compiled chunk into cheaper ones until no
+// rule applies: redundant local stores and loads, jumps to jumps, jumps on
+// constants and operators that cancel out. Instructions that become
+// unnecessary are removed and jumps moved to match, so this runs before
+// fuse_superinstructions. Adds to stats.
+void optimize_peephole(Chunk* chunk, PeepholeStats* stats);
+
+void print_peephole_stats(const PeepholeStats* stats);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,54 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "common.h"
+
+// Kinds of runtime object drawn from the pools, counted separately
+typedef enum {
+    POOL_ENV_ENTRY,
+    POOL_SYMBOL_ENTRY,
+    POOL_STRING,
+    POOL_NAME,          // Variable and symbol names
+    POOL_REGION_BLOCK,
+    POOL_KIND_COUNT
+} PoolKind;
+
+// Largest object served from a size class; bigger ones go straight to
+// the backing allocator
+#define POOL_MAX_OBJECT 256
+
+// Backing allocator for slabs and large objects. Memory must be 16-byte
+// aligned. Both functions may be called from any thread.
+typedef struct {
+    void* (*allocate)(void* user_data, size_t size);
+    void (*deallocate)(void* user_data, void* pointer, size_t size);
+    void* user_data;
+} PoolAllocator;
+
+// Per-kind counters
+typedef struct {
+    uint64_t allocations[POOL_KIND_COUNT];
+    uint64_t frees[POOL_KIND_COUNT];
+    size_t slab_bytes;  // Memory taken from the backing allocator for slabs
+} PoolStats;
+
+// Replace the backing allocator; NULL restores malloc. Only valid before
+// the first allocation, since memory is returned to whoever provided it.
+// Returns false once anything has been allocated.
+bool pool_set_allocator(const PoolAllocator* allocator);
+
+// Allocate and free an object; free must be given the allocation size.
+// Objects up to POOL_MAX_OBJECT bytes come from per-thread free lists of
+// fixed-size slots carved from shared slabs.
+void* pool_alloc(PoolKind kind, size_t size);
+void pool_free(PoolKind kind, void* pointer, size_t size);
+
+// Copy and free a NUL-terminated string
+char* pool_strdup(PoolKind kind, const char* string);
+void pool_free_string(PoolKind kind, char* string);
+
+// Statistics
+void pool_get_stats(PoolStats* stats);
+void print_pool_stats(void);
+
+#endif // POOL_H
@@ -0,0 +1,42 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "bytecode.h"
+
+// Sequences shown by print_profile
+#define PROFILE_TOP 10
+
+// Instruction profile of VM runs: how often each instruction ran, and
+// each sequence of two and three instructions that ran one after another.
+// A superinstruction counts as the instructions it fuses, so the profile
+// shows the same sequences whichever are fused; dispatches shows the gain.
+typedef struct {
+    uint64_t dispatches;    // Instructions the VM dispatched
+    uint64_t instructions;  // Instructions executed
+    uint64_t counts[OP_COUNT];
+    uint64_t pairs[OP_COUNT][OP_COUNT];
+    uint64_t* triples;      // OP_COUNT^3, first instruction most significant
+    int previous[2];        // Last two instructions executed, or -1
+} OpProfile;
+
+void init_profile(OpProfile* profile);
+
+// Forget the instructions before, so sequences do not span runs
+void profile_start_run(OpProfile* profile);
+
+// Count the dispatch of the instruction at ip
+void profile_dispatch(OpProfile* profile, const Chunk* chunk, int ip);
+
+// Add the counts saved in a profile file, so one profile can cover a
+// corpus of scripts run one by one. A missing file adds nothing.
+// Returns false if the file exists but cannot be read.
+bool load_profile(OpProfile* profile, const char* path);
+
+bool save_profile(const OpProfile* profile, const char* path);
+
+// Totals and the most frequent pairs and triples
+void print_profile(const OpProfile* profile);
+
+void free_profile(OpProfile* profile);
+
+#endif // PROFILE_H
@@ -0,0 +1,39 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "common.h"
+
+// Size of a region's first block; later blocks double up to the maximum
+#define REGION_BLOCK_SIZE (16 * 1024)
+#define REGION_MAX_BLOCK_SIZE (1024 * 1024)
+
+typedef struct RegionBlock {
+    struct RegionBlock* next;
+    size_t size;
+    _Alignas(16) char data[];
+} RegionBlock;
+
+// Bump allocator whose objects are never freed one by one. Resetting it
+// makes every block available again in O(1); blocks are kept for reuse
+// until the region is freed.
+struct Region {
+    RegionBlock* first;
+    RegionBlock* current;
+    char* cursor;
+    char* end;
+};
+
+void init_region(Region* region);
+
+// Allocate 16-byte aligned memory that lives until the next reset
+void* region_alloc(Region* region, size_t size);
+
+// Whether memory was allocated from the region since the last reset
+bool region_contains(const Region* region, const void* pointer);
+
+// Discard everything allocated since the last reset
+void reset_region(Region* region);
+
+void free_region(Region* region);
+
+#endif // REGION_H
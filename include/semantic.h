@@ -2,11 +2,13 @@
 #define SEMANTIC_H
 
 #include "parser.h"
+#include "snapshot.h"
 
 // Symbol table entry
 typedef struct SymbolEntry {
     char* name;
-    ValueType type;
+    ValueType type;        // Declared type
+    ValueType value_type;  // Static type of the stored value (null if initialized with null)
     struct SymbolEntry* next;
 } SymbolEntry;
 
@@ -18,15 +20,27 @@ typedef struct {
 // Semantic analyzer
 typedef struct {
     SymbolTable symbol_table;
+    const Snapshot* snapshot;  // Variables defined before this session, or NULL
     bool had_error;
+    KasdState* state;
 } SemanticAnalyzer;
 
 // Initialize semantic analyzer
-void init_semantic_analyzer(SemanticAnalyzer* analyzer);
+void init_semantic_analyzer(SemanticAnalyzer* analyzer, KasdState* state);
 
 // Analyze AST for semantic errors
 bool analyze(SemanticAnalyzer* analyzer, AstNode* node);
 
+// Declare the variables of a program analyzed on its own, such as a
+// compiled script about to run in this session. A name may be declared
+// again with the same declared and stored types, so a script can run more
+// than once; a name declared with other types is an error, and then
+// nothing is declared.
+bool declare_program(SemanticAnalyzer* analyzer, const AstNode* program);
+
+// Remove symbols added after mark (a previous symbol_table.head)
+void rollback_symbols(SemanticAnalyzer* analyzer, SymbolEntry* mark);
+
 // Clean up semantic analyzer
 void free_semantic_analyzer(SemanticAnalyzer* analyzer);
 
@@ -0,0 +1,70 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "interpreter.h"
+#include "optimizer.h"
+#include "compiler.h"
+#include "peephole.h"
+#include "closure.h"
+#include "emit_c.h"
+
+// How session_execute runs a program
+typedef enum {
+    ENGINE_CLOSURE,  // Compile to closures, then run them (default)
+    ENGINE_AST       // Walk the tree
+} Engine;
+
+// Long-lived execution session: symbols, constants and the environment
+// persist across inputs, and each input is analyzed incrementally
+typedef struct {
+    KasdState* state;
+    SemanticAnalyzer analyzer;
+    Optimizer optimizer;
+    Interpreter interpreter;
+    Engine engine;
+    IrStats ir_stats;  // Passes run by session_compile at -O2
+    PeepholeStats peephole_stats;  // Rules applied by session_compile from -O1
+    
+    // Executed programs, kept alive because the optimizer's constant
+    // table points into them
+    AstNode** programs;
+    int program_count;
+    int program_capacity;
+} Session;
+
+// Initialize a session reporting to state; export_globals keeps unread
+// declarations alive
+void init_session(Session* session, KasdState* state, int opt_level, bool repl_mode, bool export_globals);
+
+// Continue from a snapshot: its variables become visible to analysis,
+// constant propagation and execution. The snapshot must outlive the session.
+void session_attach_snapshot(Session* session, const Snapshot* snapshot);
+
+// Lex, parse, analyze, optimize and run one input in the session.
+// On failure the error is left in the session's state for the caller to report
+// while source is still alive.
+bool session_execute(Session* session, const char* source);
+
+// Run a program analyzed and compiled outside the session, such as a
+// cached script. Its variables are declared in the session first, so later
+// inputs can read them and cannot declare them with another type. On
+// failure the error is left in the session's state.
+bool session_run(Session* session, const AstNode* program, const ClosureProgram* closures);
+
+// Lex, parse, analyze and optimize one input in the session and compile
+// it into chunk without running it. Symbols and constants it declares stay
+// in the session, as if it had run.
+bool session_compile(Session* session, const char* source, Chunk* chunk);
+
+// Lex, parse, analyze and optimize one input in the session, build its IR
+// and run the IR passes, then print the IR on stdout without running it
+bool session_dump_ir(Session* session, const char* source);
+
+// Lex, parse, analyze and optimize one input in the session and translate
+// it to C on out without running it
+bool session_emit_c(Session* session, const char* source, const char* source_name, FILE* out);
+
+// Clean up a session
+void free_session(Session* session);
+
+#endif // SESSION_H
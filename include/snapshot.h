@@ -0,0 +1,47 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "common.h"
+
+// Snapshot format version
+#define SNAPSHOT_VERSION 3
+
+// Read-only environment image mapped from a file. Variables are found
+// through a hash table stored in the file, so loading costs the same
+// no matter how many variables the snapshot holds.
+typedef struct Snapshot Snapshot;
+
+// Map a snapshot file; returns NULL if it is missing or malformed
+Snapshot* load_snapshot(const char* path);
+
+// Look up a variable. The value is borrowed: long strings are static
+// strings inside the mapping and stay valid until free_snapshot.
+bool snapshot_lookup(const Snapshot* snapshot, const char* name, Value* value);
+
+// Content hash identifying the snapshot, for keying code compiled against
+// it. Reads the whole snapshot.
+uint64_t snapshot_hash(const Snapshot* snapshot);
+
+// Number of variables in a snapshot
+int snapshot_count(const Snapshot* snapshot);
+
+// Unmap a snapshot
+void free_snapshot(Snapshot* snapshot);
+
+// Snapshot under construction
+typedef struct SnapshotBuilder SnapshotBuilder;
+
+// Start a snapshot
+SnapshotBuilder* create_snapshot_builder(void);
+
+// Add a variable unless one with the same name was added already.
+// Equal strings are stored once.
+void snapshot_builder_add(SnapshotBuilder* builder, const char* name, Value value);
+
+// Add every variable of an existing snapshot not already added
+void snapshot_builder_add_snapshot(SnapshotBuilder* builder, const Snapshot* snapshot);
+
+// Write the snapshot atomically and free the builder
+bool finish_snapshot(SnapshotBuilder* builder, const char* path);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,16 @@
+#ifndef VM_H
+#define VM_H
+
+#include "interpreter.h"
+#include "jit.h"
+#include "profile.h"
+
+// Execute a compiled chunk, defining its globals in the interpreter's
+// environment. String values may point into the chunk's string table, so
+// the chunk must outlive the environment. Declarations jit compiled to
+// native code run natively, updating its statistics; jit may be NULL.
+// Instructions the VM runs are counted in profile unless it is NULL.
+// Returns false and sets had_error on a runtime error.
+bool run_chunk(Interpreter* interpreter, const Chunk* chunk, JitCode* jit, OpProfile* profile);
+
+#endif // VM_H
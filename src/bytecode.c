@@ -0,0 +1,511 @@
+#include "../include/bytecode.h"
+#include "../include/operators.h"
+#include <sys/mman.h>
+
+// Grow an array to hold at least one more element
+#define GROW_ARRAY(type, array, count, capacity) \
+    do { \
+        if ((count) == (capacity)) { \
+            (capacity) = (capacity) < 8 ? 8 : (capacity) * 2; \
+            (array) = realloc((array), sizeof(type) * (capacity)); \
+        } \
+    } while (0)
+
+// Initialize an empty chunk
+void init_chunk(Chunk* chunk) {
+    memset(chunk, 0, sizeof(Chunk));
+}
+
+// Append an instruction; returns its index
+int write_instruction(Chunk* chunk, OpCode op, uint8_t flags, int32_t operand, int line, int column) {
+    if (chunk->code_count == chunk->code_capacity) {
+        chunk->code_capacity = chunk->code_capacity < 16 ? 16 : chunk->code_capacity * 2;
+        chunk->code = realloc(chunk->code, sizeof(Instruction) * chunk->code_capacity);
+        chunk->positions = realloc(chunk->positions, sizeof(SourcePosition) * chunk->code_capacity);
+    }
+    
+    Instruction instruction = {(uint8_t)op, flags, 0, operand};
+    SourcePosition position = {line, column};
+    chunk->code[chunk->code_count] = instruction;
+    chunk->positions[chunk->code_count] = position;
+    return chunk->code_count++;
+}
+
+// Copy a string into the string table as a static String; returns its offset
+static uint32_t add_string(Chunk* chunk, const char* chars, size_t length) {
+    uint32_t offset = (chunk->strings_length + 7) & ~7u;
+    uint32_t end = offset + (uint32_t)string_size(length);
+    
+    if (end > chunk->strings_capacity) {
+        uint32_t capacity = chunk->strings_capacity < 64 ? 64 : chunk->strings_capacity;
+        while (capacity < end) {
+            capacity *= 2;
+        }
+        chunk->strings = realloc(chunk->strings, capacity);
+        chunk->strings_capacity = capacity;
+    }
+    
+    // Zero the alignment padding so compiled files are reproducible
+    memset(chunk->strings + chunk->strings_length, 0, offset - chunk->strings_length);
+    init_static_string(chunk->strings + offset, chars, length);
+    chunk->strings_length = end;
+    return offset;
+}
+
+// Add a constant; returns its index
+int add_constant(Chunk* chunk, Value value) {
+    Constant constant;
+    memset(&constant, 0, sizeof(Constant));
+    constant.type = value.type;
+    
+    switch (value.type) {
+        case VALUE_INT:    constant.data.as_int = value.data.as_int; break;
+        case VALUE_FLOAT:  constant.data.as_float = value.data.as_float; break;
+        case VALUE_BOOL:   constant.data.as_bool = value.data.as_bool; break;
+        case VALUE_STRING:
+            constant.data.as_string = add_string(chunk, string_chars(&value), string_length(&value));
+            break;
+        default: break;
+    }
+    
+    GROW_ARRAY(Constant, chunk->constants, chunk->constant_count, chunk->constant_capacity);
+    chunk->constants[chunk->constant_count] = constant;
+    return chunk->constant_count++;
+}
+
+// Add a global name; returns its index
+int add_name(Chunk* chunk, const char* name) {
+    uint32_t offset = add_string(chunk, name, strlen(name));
+    GROW_ARRAY(uint32_t, chunk->names, chunk->name_count, chunk->name_capacity);
+    chunk->names[chunk->name_count] = offset;
+    return chunk->name_count++;
+}
+
+// Operand stack effect of an instruction: values it needs and net change
+static void stack_effect(OpCode op, int* needs, int* change) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_LOAD:
+        case OP_GET_LOCAL:
+            *needs = 0; *change = 1;
+            break;
+        case OP_DEFINE:
+        case OP_POP:
+        case OP_SET_LOCAL:
+            *needs = 1; *change = -1;
+            break;
+        case OP_NEGATE_INT:
+        case OP_NEGATE_FLOAT:
+        case OP_NOT:
+        case OP_INT_TO_FLOAT:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            *needs = 1; *change = 0;
+            break;
+        default:
+            *needs = 2; *change = -1;
+            break;
+    }
+}
+
+// Check that a string table offset holds a whole, terminated static string
+static bool valid_string(const Chunk* chunk, uint64_t offset) {
+    if (offset % 8 != 0 || offset > chunk->strings_length ||
+        chunk->strings_length - offset < sizeof(String)) {
+        return false;
+    }
+    
+    const String* string = chunk_string_object(chunk, offset);
+    return atomic_load_explicit(&string->refcount, memory_order_relaxed) == STRING_STATIC &&
+           !string->is_interned &&
+           string->length < chunk->strings_length - offset - sizeof(String) &&
+           string->chars[string->length] == '\0';
+}
+
+// Types the verifier gives stack slots, variables and locals besides the
+// value types
+#define TYPE_UNKNOWN 0xFF  // Not defined yet
+#define TYPE_ANY 0xFE      // Operand of an instruction that takes any value
+
+// Operand and result types by instruction. CONSTANT, LOAD and GET_LOCAL
+// push the type of what they read instead.
+typedef struct {
+    uint8_t operands;  // Type of every operand popped
+    uint8_t result;    // Type pushed
+} Typing;
+
+static const Typing typings[OP_COUNT] = {
+    [OP_NEGATE_INT] = {VALUE_INT, VALUE_INT},
+    [OP_NEGATE_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_NOT] = {VALUE_BOOL, VALUE_BOOL},
+    [OP_INT_TO_FLOAT] = {VALUE_INT, VALUE_FLOAT},
+    [OP_ADD_INT] = {VALUE_INT, VALUE_INT},
+    [OP_SUBTRACT_INT] = {VALUE_INT, VALUE_INT},
+    [OP_MULTIPLY_INT] = {VALUE_INT, VALUE_INT},
+    [OP_DIVIDE_INT] = {VALUE_INT, VALUE_INT},
+    [OP_MODULO_INT] = {VALUE_INT, VALUE_INT},
+    [OP_ADD_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_SUBTRACT_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_MULTIPLY_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_DIVIDE_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_MODULO_FLOAT] = {VALUE_FLOAT, VALUE_FLOAT},
+    [OP_CONCAT] = {VALUE_STRING, VALUE_STRING},
+    [OP_COMPARE_INT] = {VALUE_INT, VALUE_BOOL},
+    [OP_COMPARE_FLOAT] = {VALUE_FLOAT, VALUE_BOOL},
+    [OP_COMPARE_BOOL] = {VALUE_BOOL, VALUE_BOOL},
+    [OP_COMPARE_STRING] = {VALUE_STRING, VALUE_BOOL},
+    [OP_COMPARE_NULL] = {TYPE_ANY, VALUE_BOOL},
+    [OP_JUMP_IF_FALSE] = {VALUE_BOOL, VALUE_BOOL},
+    [OP_JUMP_IF_TRUE] = {VALUE_BOOL, VALUE_BOOL},
+    [OP_POP] = {TYPE_ANY, TYPE_UNKNOWN},
+    [OP_DEFINE] = {TYPE_ANY, TYPE_UNKNOWN},
+    [OP_SET_LOCAL] = {TYPE_ANY, TYPE_UNKNOWN},
+};
+
+static bool is_relation(uint8_t flags) {
+    return flags == TOKEN_LESS || flags == TOKEN_LESS_EQUAL || flags == TOKEN_GREATER ||
+           flags == TOKEN_GREATER_EQUAL || flags == TOKEN_EQUAL_EQUAL || flags == TOKEN_BANG_EQUAL;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// Each variable must have one name index, so that it has one type
+static bool distinct_names(const Chunk* chunk) {
+    const char** names = malloc(sizeof(const char*) * (chunk->name_count + 1));
+    for (int i = 0; i < chunk->name_count; i++) {
+        names[i] = chunk_string(chunk, chunk->names[i]);
+    }
+    qsort(names, chunk->name_count, sizeof(const char*), compare_names);
+    
+    bool distinct = true;
+    for (int i = 1; i < chunk->name_count && distinct; i++) {
+        distinct = strcmp(names[i - 1], names[i]) != 0;
+    }
+    free(names);
+    return distinct;
+}
+
+// Verification state: the type of every stack slot, variable and local
+// at the current instruction, and the stack expected at each jump target
+typedef struct {
+    const Chunk* chunk;
+    int depth;
+    uint8_t* stack;
+    uint8_t* names;
+    uint8_t* locals;
+    int* target_depth;       // -1 while no jump lands there; one entry past the end
+    uint8_t** target_stack;  // Allocated for the targets jumps land on
+} Verifier;
+
+// Give a jump target the current stack, or check it against the one
+// another jump gave it
+static bool merge_target(Verifier* verifier, int target) {
+    if (verifier->target_depth[target] < 0) {
+        uint8_t* stack = malloc(verifier->depth + 1);
+        if (stack == NULL) {
+            return false;
+        }
+        memcpy(stack, verifier->stack, verifier->depth);
+        verifier->target_stack[target] = stack;
+        verifier->target_depth[target] = verifier->depth;
+        return true;
+    }
+    return verifier->target_depth[target] == verifier->depth &&
+           memcmp(verifier->target_stack[target], verifier->stack, verifier->depth) == 0;
+}
+
+// Check the operands of one instruction and push its result. Index
+// operands have been checked already.
+static bool verify_types(Verifier* verifier, const Instruction* instruction, OpCode op, int needs) {
+    const Chunk* chunk = verifier->chunk;
+    uint8_t* operands = verifier->stack + verifier->depth - needs;
+    uint8_t result = typings[op].result;
+    
+    switch (op) {
+        case OP_CONSTANT:
+            result = chunk->constants[instruction->operand].type;
+            break;
+        case OP_LOAD:
+            // A variable must be defined before it is read, and a local set
+            result = verifier->names[instruction->operand];
+            if (result == TYPE_UNKNOWN) {
+                return false;
+            }
+            break;
+        case OP_GET_LOCAL:
+            result = verifier->locals[instruction->operand];
+            if (result == TYPE_UNKNOWN) {
+                return false;
+            }
+            break;
+        case OP_DEFINE:
+            // A variable is defined once, with its declared type or null
+            if (verifier->names[instruction->operand] != TYPE_UNKNOWN || instruction->flags > VALUE_STRING ||
+                (operands[0] != instruction->flags && operands[0] != VALUE_NULL)) {
+                return false;
+            }
+            verifier->names[instruction->operand] = operands[0];
+            break;
+        case OP_SET_LOCAL:
+            if (verifier->locals[instruction->operand] != TYPE_UNKNOWN &&
+                verifier->locals[instruction->operand] != operands[0]) {
+                return false;
+            }
+            verifier->locals[instruction->operand] = operands[0];
+            break;
+        default:
+            if (op >= OP_COMPARE_INT && op <= OP_COMPARE_NULL && !is_relation(instruction->flags)) {
+                return false;
+            }
+            for (int k = 0; k < needs; k++) {
+                if (typings[op].operands != TYPE_ANY && operands[k] != typings[op].operands) {
+                    return false;
+                }
+            }
+            break;
+    }
+    
+    verifier->depth -= needs;
+    if (result != TYPE_UNKNOWN) {
+        verifier->stack[verifier->depth++] = result;
+    }
+    return true;
+}
+
+// Check that every index, offset and jump in a chunk is in range, and
+// that every instruction finds operands of the types it is specialized
+// for, so code from a file cannot make the VM read out of bounds or
+// misread a value. Variables the chunk does not define must be in
+// snapshot, which may be NULL.
+bool verify_chunk(const Chunk* chunk, const Snapshot* snapshot) {
+    for (int i = 0; i < chunk->name_count; i++) {
+        if (!valid_string(chunk, chunk->names[i])) {
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < chunk->constant_count; i++) {
+        const Constant* constant = &chunk->constants[i];
+        if (constant->type > VALUE_STRING ||
+            (constant->type == VALUE_STRING && !valid_string(chunk, constant->data.as_string))) {
+            return false;
+        }
+    }
+    
+    if (chunk->max_stack < 0 || chunk->local_count < 0 || !distinct_names(chunk)) {
+        return false;
+    }
+    
+    Verifier verifier;
+    verifier.chunk = chunk;
+    verifier.depth = 0;
+    // Each instruction pushes at most one value
+    int slots = chunk->max_stack < chunk->code_count ? chunk->max_stack : chunk->code_count;
+    verifier.stack = malloc(slots + 1);
+    verifier.names = malloc(chunk->name_count + 1);
+    verifier.locals = malloc(chunk->local_count + 1);
+    verifier.target_depth = malloc(sizeof(int) * (chunk->code_count + 1));
+    verifier.target_stack = calloc(chunk->code_count + 1, sizeof(uint8_t*));
+    
+    for (int i = 0; i < chunk->name_count; i++) {
+        Value value;
+        bool found = snapshot_lookup(snapshot, chunk_string(chunk, chunk->names[i]), &value);
+        verifier.names[i] = found ? (uint8_t)value.type : TYPE_UNKNOWN;
+    }
+    memset(verifier.locals, TYPE_UNKNOWN, chunk->local_count + 1);
+    for (int i = 0; i <= chunk->code_count; i++) {
+        verifier.target_depth[i] = -1;
+    }
+    
+    bool valid = true;
+    for (int i = 0; i < chunk->code_count && valid; i++) {
+        const Instruction* instruction = &chunk->code[i];
+        int needs;
+        int change;
+        
+        // Every path into a jump target must bring the same stack
+        if (verifier.target_depth[i] >= 0 && !merge_target(&verifier, i)) {
+            valid = false;
+            break;
+        }
+        
+        if (instruction->op >= OP_COUNT) {
+            valid = false;
+            break;
+        }
+        
+        // A superinstruction is checked as its first instruction; the
+        // second must follow it
+        OpCode op = base_opcode(instruction->op);
+        if (op != (OpCode)instruction->op) {
+            valid = i + 1 < chunk->code_count &&
+                    base_opcode(chunk->code[i + 1].op) == superinstruction_second(instruction->op);
+        }
+        
+        stack_effect(op, &needs, &change);
+        valid = valid && verifier.depth >= needs && verifier.depth + change <= chunk->max_stack;
+        
+        switch (op) {
+            case OP_CONSTANT:
+                valid = valid && instruction->operand >= 0 && instruction->operand < chunk->constant_count;
+                break;
+            case OP_LOAD:
+            case OP_DEFINE:
+                valid = valid && instruction->operand >= 0 && instruction->operand < chunk->name_count;
+                break;
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                valid = valid && instruction->operand >= 0 && instruction->operand < chunk->local_count;
+                break;
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
+                // Forward only, so execution always terminates
+                valid = valid && instruction->operand > i && instruction->operand <= chunk->code_count;
+                break;
+            default:
+                break;
+        }
+        
+        valid = valid && verify_types(&verifier, instruction, op, needs);
+        
+        if (valid && (op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE)) {
+            valid = merge_target(&verifier, instruction->operand);
+        }
+    }
+    
+    valid = valid && (verifier.target_depth[chunk->code_count] < 0 || merge_target(&verifier, chunk->code_count));
+    free(verifier.stack);
+    free(verifier.names);
+    free(verifier.locals);
+    for (int i = 0; i <= chunk->code_count; i++) {
+        free(verifier.target_stack[i]);
+    }
+    free(verifier.target_depth);
+    free(verifier.target_stack);
+    return valid;
+}
+
+static const char* opcode_names[OP_COUNT] = {
+    [OP_CONSTANT] = "CONSTANT",
+    [OP_LOAD] = "LOAD",
+    [OP_DEFINE] = "DEFINE",
+    [OP_POP] = "POP",
+    [OP_NEGATE_INT] = "NEGATE_INT",
+    [OP_NEGATE_FLOAT] = "NEGATE_FLOAT",
+    [OP_NOT] = "NOT",
+    [OP_INT_TO_FLOAT] = "INT_TO_FLOAT",
+    [OP_ADD_INT] = "ADD_INT",
+    [OP_SUBTRACT_INT] = "SUBTRACT_INT",
+    [OP_MULTIPLY_INT] = "MULTIPLY_INT",
+    [OP_DIVIDE_INT] = "DIVIDE_INT",
+    [OP_MODULO_INT] = "MODULO_INT",
+    [OP_ADD_FLOAT] = "ADD_FLOAT",
+    [OP_SUBTRACT_FLOAT] = "SUBTRACT_FLOAT",
+    [OP_MULTIPLY_FLOAT] = "MULTIPLY_FLOAT",
+    [OP_DIVIDE_FLOAT] = "DIVIDE_FLOAT",
+    [OP_MODULO_FLOAT] = "MODULO_FLOAT",
+    [OP_CONCAT] = "CONCAT",
+    [OP_COMPARE_INT] = "COMPARE_INT",
+    [OP_COMPARE_FLOAT] = "COMPARE_FLOAT",
+    [OP_COMPARE_BOOL] = "COMPARE_BOOL",
+    [OP_COMPARE_STRING] = "COMPARE_STRING",
+    [OP_COMPARE_NULL] = "COMPARE_NULL",
+    [OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE",
+    [OP_JUMP_IF_TRUE] = "JUMP_IF_TRUE",
+    [OP_GET_LOCAL] = "GET_LOCAL",
+    [OP_SET_LOCAL] = "SET_LOCAL",
+#define SUPERINSTRUCTION_NAME(opcode, name, first, second) [opcode] = name,
+    SUPERINSTRUCTIONS(SUPERINSTRUCTION_NAME)
+#undef SUPERINSTRUCTION_NAME
+};
+
+const char* opcode_name(OpCode op) {
+    return opcode_names[op];
+}
+
+// Debug print a constant
+static void print_constant(const Chunk* chunk, const Constant* constant) {
+    switch (constant->type) {
+        case VALUE_INT:    printf("%lld", (long long)constant->data.as_int); break;
+        case VALUE_FLOAT:  printf("%g", constant->data.as_float); break;
+        case VALUE_BOOL:   printf("%s", constant->data.as_bool ? "true" : "false"); break;
+        case VALUE_STRING: printf("\"%s\"", chunk_string(chunk, constant->data.as_string)); break;
+        default:           printf("null"); break;
+    }
+}
+
+// Debug print a chunk
+void disassemble_chunk(const Chunk* chunk) {
+    for (int i = 0; i < chunk->code_count; i++) {
+        const Instruction* instruction = &chunk->code[i];
+        printf("%04d %4d  %-16s", i, chunk->positions[i].line, opcode_names[instruction->op]);
+        
+        switch (base_opcode(instruction->op)) {
+            case OP_CONSTANT:
+                print_constant(chunk, &chunk->constants[instruction->operand]);
+                break;
+            case OP_LOAD:
+            case OP_DEFINE:
+                printf("%s", chunk_string(chunk, chunk->names[instruction->operand]));
+                break;
+            case OP_COMPARE_INT:
+            case OP_COMPARE_FLOAT:
+            case OP_COMPARE_BOOL:
+            case OP_COMPARE_STRING:
+            case OP_COMPARE_NULL:
+                printf("%s", operator_to_string((TokenType)instruction->flags));
+                break;
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
+                printf("-> %04d", instruction->operand);
+                break;
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                printf("#%d", instruction->operand);
+                break;
+            default:
+                break;
+        }
+        printf("\n");
+    }
+}
+
+// Fuse every pair of instructions that has a superinstruction. Pairs may
+// overlap: the second instruction of one can start the next, which runs
+// on its own when a jump lands on it.
+void fuse_superinstructions(Chunk* chunk) {
+    static const struct {
+        OpCode opcode;
+        OpCode first;
+        OpCode second;
+    } pairs[] = {
+#define SUPERINSTRUCTION_PAIR(opcode, name, first, second) {opcode, first, second},
+        SUPERINSTRUCTIONS(SUPERINSTRUCTION_PAIR)
+#undef SUPERINSTRUCTION_PAIR
+    };
+    
+    for (int i = 0; i + 1 < chunk->code_count; i++) {
+        for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); p++) {
+            if (chunk->code[i].op == pairs[p].first && chunk->code[i + 1].op == pairs[p].second) {
+                chunk->code[i].op = (uint8_t)pairs[p].opcode;
+                break;
+            }
+        }
+    }
+}
+
+// Free a chunk, unmapping it if it was loaded from a file
+void free_chunk(Chunk* chunk) {
+    if (chunk->mapping != NULL) {
+        munmap(chunk->mapping, chunk->mapping_size);
+    } else {
+        free(chunk->code);
+        free(chunk->positions);
+        free(chunk->constants);
+        free(chunk->names);
+        free(chunk->strings);
+    }
+    init_chunk(chunk);
+}
@@ -0,0 +1,347 @@
+#include "../include/cache.h"
+#include <pthread.h>
+#include <sched.h>
+
+// Immutable snapshot of the cache, open-addressed by hash. Writers build a
+// new snapshot and publish it; readers never see a table being modified.
+typedef struct {
+    size_t capacity;  // Power of two
+    size_t count;
+    CompiledScript* slots[];
+} CacheTable;
+
+// Published table, read without locks
+static _Atomic(CacheTable*) cache_table = NULL;
+
+// Reader tracking for safe reclamation: readers register under the parity
+// of the current epoch, and writers flip the epoch and wait for the old
+// parity to drain before freeing anything unpublished before the flip
+static atomic_uint_fast64_t cache_epoch = 0;
+static atomic_int cache_readers[2] = {0, 0};
+
+// Writers are serialized; the fields below are only touched under the lock
+static pthread_mutex_t cache_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t cache_budget = CACHE_DEFAULT_BUDGET;
+static size_t cache_bytes = 0;
+
+// Counters
+static atomic_uint_fast64_t cache_clock = 0;
+static atomic_uint_fast64_t cache_hits = 0;
+static atomic_uint_fast64_t cache_misses = 0;
+static atomic_uint_fast64_t cache_evictions = 0;
+
+// Hash the source, mixed with the options that affect compilation
+static uint64_t hash_source(const char* source, size_t length, int opt_level) {
+    return hash_bytes(source, length, (uint64_t)opt_level);
+}
+
+// Approximate memory held by an AST
+static size_t estimate_size(AstNode* node) {
+    if (node == NULL) {
+        return 0;
+    }
+    
+    size_t size = sizeof(AstNode);
+    switch (node->type) {
+        case NODE_PROGRAM:
+            size += sizeof(AstNode*) * node->as.program.capacity;
+            for (int i = 0; i < node->as.program.count; i++) {
+                size += estimate_size(node->as.program.declarations[i]);
+            }
+            break;
+        case NODE_VARIABLE_DECLARATION:
+            size += strlen(node->as.var_decl.name) + 1;
+            size += estimate_size(node->as.var_decl.initializer);
+            break;
+        case NODE_LITERAL:
+            if (node->as.literal.type == VALUE_STRING && node->as.literal.short_length == STRING_ON_HEAP) {
+                size += string_size(node->as.literal.data.as_string->length);
+            }
+            break;
+        case NODE_VARIABLE:
+            size += strlen(node->as.variable.name) + 1;
+            break;
+        case NODE_UNARY:
+            size += estimate_size(node->as.unary.operand);
+            break;
+        case NODE_BINARY:
+            size += estimate_size(node->as.binary.left) + estimate_size(node->as.binary.right);
+            break;
+        case NODE_CONVERT:
+            size += estimate_size(node->as.convert.operand);
+            break;
+    }
+    return size;
+}
+
+// Wrap a compiled program
+CompiledScript* create_compiled_script(const char* source, int opt_level, AstNode* program) {
+    CompiledScript* script = malloc(sizeof(CompiledScript));
+    size_t length = strlen(source);
+    
+    atomic_init(&script->refcount, 1);
+    atomic_init(&script->last_used, 0);
+    script->hash = hash_source(source, length, opt_level);
+    script->source = malloc(length + 1);
+    memcpy(script->source, source, length + 1);
+    script->source_length = length;
+    script->opt_level = opt_level;
+    script->program = program;
+    script->closures = compile_closures(program);
+    script->size = sizeof(CompiledScript) + length + 1 + estimate_size(program) +
+                   closures_size(script->closures);
+    return script;
+}
+
+void retain_compiled_script(CompiledScript* script) {
+    atomic_fetch_add_explicit(&script->refcount, 1, memory_order_relaxed);
+}
+
+void release_compiled_script(CompiledScript* script) {
+    if (script == NULL) {
+        return;
+    }
+    
+    if (atomic_fetch_sub_explicit(&script->refcount, 1, memory_order_acq_rel) == 1) {
+        free_closures(script->closures);
+        free_ast(script->program);
+        free(script->source);
+        free(script);
+    }
+}
+
+// Enter and leave a read-side section
+static int read_begin(void) {
+    while (1) {
+        uint_fast64_t epoch = atomic_load(&cache_epoch);
+        int parity = (int)(epoch & 1);
+        
+        atomic_fetch_add(&cache_readers[parity], 1);
+        if (atomic_load(&cache_epoch) == epoch) {
+            return parity;
+        }
+        
+        // A writer flipped the epoch in between; register again
+        atomic_fetch_sub(&cache_readers[parity], 1);
+    }
+}
+
+static void read_end(int parity) {
+    atomic_fetch_sub(&cache_readers[parity], 1);
+}
+
+// Wait until no reader can still hold a pointer obtained before this call.
+// Called with the write lock held.
+static void wait_for_readers(void) {
+    uint_fast64_t epoch = atomic_fetch_add(&cache_epoch, 1);
+    
+    while (atomic_load(&cache_readers[epoch & 1]) != 0) {
+        sched_yield();
+    }
+}
+
+static bool script_matches(CompiledScript* script, uint64_t hash, const char* source,
+                           size_t length, int opt_level) {
+    return script->hash == hash && script->opt_level == opt_level &&
+           script->source_length == length && memcmp(script->source, source, length) == 0;
+}
+
+// Probe a table for a key
+static CompiledScript* table_find(CacheTable* table, uint64_t hash, const char* source,
+                                  size_t length, int opt_level) {
+    if (table == NULL) {
+        return NULL;
+    }
+    
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask; table->slots[i] != NULL; i = (i + 1) & mask) {
+        if (script_matches(table->slots[i], hash, source, length, opt_level)) {
+            return table->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Find a cached compilation of source
+CompiledScript* cache_lookup(const char* source, int opt_level) {
+    size_t length = strlen(source);
+    uint64_t hash = hash_source(source, length, opt_level);
+    
+    int parity = read_begin();
+    CompiledScript* found = table_find(atomic_load(&cache_table), hash, source, length, opt_level);
+    if (found != NULL) {
+        // Safe: the cache's own reference outlives this read section
+        retain_compiled_script(found);
+        atomic_store_explicit(&found->last_used,
+                              atomic_fetch_add_explicit(&cache_clock, 1, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+    }
+    read_end(parity);
+    
+    atomic_fetch_add_explicit(found != NULL ? &cache_hits : &cache_misses, 1, memory_order_relaxed);
+    return found;
+}
+
+// Collect the entries of a table into a flat array
+static CompiledScript** table_entries(CacheTable* table, size_t* count) {
+    *count = 0;
+    if (table == NULL || table->count == 0) {
+        return NULL;
+    }
+    
+    CompiledScript** entries = malloc(sizeof(CompiledScript*) * table->count);
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i] != NULL) {
+            entries[(*count)++] = table->slots[i];
+        }
+    }
+    return entries;
+}
+
+// Build a fresh table holding the given entries
+static CacheTable* build_table(CompiledScript** entries, size_t count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    
+    CacheTable* table = calloc(1, sizeof(CacheTable) + sizeof(CompiledScript*) * capacity);
+    table->capacity = capacity;
+    table->count = count;
+    
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = entries[i]->hash & mask;
+        while (table->slots[j] != NULL) {
+            j = (j + 1) & mask;
+        }
+        table->slots[j] = entries[i];
+    }
+    return table;
+}
+
+// Drop least recently used entries until the cache fits its budget. Evicted
+// entries are moved to the tail of the array, past the returned count.
+static size_t evict_to_budget(CompiledScript** entries, size_t count) {
+    while (count > 0 && cache_bytes > cache_budget) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < count; i++) {
+            if (atomic_load_explicit(&entries[i]->last_used, memory_order_relaxed) <
+                atomic_load_explicit(&entries[oldest]->last_used, memory_order_relaxed)) {
+                oldest = i;
+            }
+        }
+        
+        CompiledScript* victim = entries[oldest];
+        entries[oldest] = entries[count - 1];
+        entries[count - 1] = victim;
+        count--;
+        
+        cache_bytes -= victim->size;
+        atomic_fetch_add_explicit(&cache_evictions, 1, memory_order_relaxed);
+    }
+    return count;
+}
+
+// Publish a new table built from entries[0..keep) and reclaim the old table
+// and the cache references of entries[keep..total). Write lock held.
+static void publish(CompiledScript** entries, size_t keep, size_t total) {
+    CacheTable* old = atomic_exchange(&cache_table, build_table(entries, keep));
+    
+    wait_for_readers();
+    free(old);
+    for (size_t i = keep; i < total; i++) {
+        release_compiled_script(entries[i]);
+    }
+}
+
+// Offer a compiled script to the cache. Returns the canonical entry for its
+// source with a reference for the caller; the caller's reference to script
+// is consumed.
+CompiledScript* cache_insert(CompiledScript* script) {
+    pthread_mutex_lock(&cache_write_lock);
+    
+    CacheTable* current = atomic_load(&cache_table);
+    CompiledScript* existing = table_find(current, script->hash, script->source,
+                                          script->source_length, script->opt_level);
+    if (existing != NULL) {
+        // Another thread compiled the same source first; share its result
+        retain_compiled_script(existing);
+        pthread_mutex_unlock(&cache_write_lock);
+        release_compiled_script(script);
+        return existing;
+    }
+    
+    if (script->size > cache_budget) {
+        // Would evict everything and still not fit; leave it uncached
+        pthread_mutex_unlock(&cache_write_lock);
+        return script;
+    }
+    
+    size_t count;
+    CompiledScript** old_entries = table_entries(current, &count);
+    CompiledScript** entries = malloc(sizeof(CompiledScript*) * (count + 1));
+    if (count > 0) {
+        memcpy(entries, old_entries, sizeof(CompiledScript*) * count);
+    }
+    free(old_entries);
+    
+    // The cache keeps one reference, the caller gets another
+    atomic_store_explicit(&script->last_used,
+                          atomic_fetch_add_explicit(&cache_clock, 1, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    retain_compiled_script(script);
+    cache_bytes += script->size;
+    
+    // Evict among the older entries only, then add the new one
+    size_t keep = evict_to_budget(entries, count);
+    entries[count] = entries[keep];
+    entries[keep] = script;
+    publish(entries, keep + 1, count + 1);
+    
+    free(entries);
+    pthread_mutex_unlock(&cache_write_lock);
+    return script;
+}
+
+// Change the memory budget, evicting immediately if it shrank
+void cache_set_budget(size_t budget) {
+    pthread_mutex_lock(&cache_write_lock);
+    cache_budget = budget;
+    
+    if (cache_bytes > cache_budget) {
+        size_t count;
+        CompiledScript** entries = table_entries(atomic_load(&cache_table), &count);
+        size_t keep = evict_to_budget(entries, count);
+        publish(entries, keep, count);
+        free(entries);
+    }
+    
+    pthread_mutex_unlock(&cache_write_lock);
+}
+
+void cache_get_stats(CacheStats* stats) {
+    pthread_mutex_lock(&cache_write_lock);
+    CacheTable* table = atomic_load(&cache_table);
+    stats->entries = table != NULL ? table->count : 0;
+    stats->bytes = cache_bytes;
+    stats->budget = cache_budget;
+    pthread_mutex_unlock(&cache_write_lock);
+    
+    stats->hits = atomic_load(&cache_hits);
+    stats->misses = atomic_load(&cache_misses);
+    stats->evictions = atomic_load(&cache_evictions);
+}
+
+// Drop every entry; scripts still held by callers stay valid
+void cache_clear(void) {
+    pthread_mutex_lock(&cache_write_lock);
+    
+    size_t count;
+    CompiledScript** entries = table_entries(atomic_load(&cache_table), &count);
+    cache_bytes = 0;
+    publish(entries, 0, count);
+    free(entries);
+    
+    pthread_mutex_unlock(&cache_write_lock);
+}
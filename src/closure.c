@@ -0,0 +1,377 @@
+#include "../include/closure.h"
+#include "../include/operators.h"
+#include <math.h>
+
+// Report a runtime error at a closure's position
+static Value runtime_error(Interpreter* interpreter, const Closure* closure, ErrorType type, const char* message) {
+    set_error(interpreter->state, type, closure->line, closure->column, message, NULL, 0, 0);
+    interpreter->had_error = true;
+    return create_null_value();
+}
+
+// Run a child closure
+#define RUN(child) ((child)->run(interpreter, (child)))
+
+// Evaluate both operands of a binary closure into left and right,
+// returning null from the enclosing function if either fails
+#define EVALUATE_OPERANDS()                                      \
+    Value left = RUN(closure->as.binary.left);                   \
+    if (interpreter->had_error) {                                \
+        free_value(left);                                        \
+        return create_null_value();                              \
+    }                                                            \
+    Value right = RUN(closure->as.binary.right);                 \
+    if (interpreter->had_error) {                                \
+        free_value(left);                                        \
+        free_value(right);                                       \
+        return create_null_value();                              \
+    }
+
+// Literals, variables and conversions
+
+static Value run_constant(Interpreter* interpreter, const Closure* closure) {
+    (void)interpreter;
+    return closure->as.literal;
+}
+
+static Value run_string_literal(Interpreter* interpreter, const Closure* closure) {
+    (void)interpreter;
+    return copy_value(closure->as.literal);
+}
+
+static Value run_variable(Interpreter* interpreter, const Closure* closure) {
+    Value value;
+    if (!env_get(&interpreter->env, closure->as.name, &value)) {
+        return runtime_error(interpreter, closure, ERROR_NAME, "Undefined variable");
+    }
+    return copy_value(value);
+}
+
+static Value run_int_to_float(Interpreter* interpreter, const Closure* closure) {
+    Value operand = RUN(closure->as.operand);
+    return create_float_value((double)operand.data.as_int);
+}
+
+// Unary operators
+
+static Value run_negate_int(Interpreter* interpreter, const Closure* closure) {
+    Value operand = RUN(closure->as.operand);
+    return create_int_value((int64_t)(0u - (uint64_t)operand.data.as_int));
+}
+
+static Value run_negate_float(Interpreter* interpreter, const Closure* closure) {
+    Value operand = RUN(closure->as.operand);
+    return create_float_value(-operand.data.as_float);
+}
+
+static Value run_not(Interpreter* interpreter, const Closure* closure) {
+    Value operand = RUN(closure->as.operand);
+    return create_bool_value(!operand.data.as_bool);
+}
+
+// Arithmetic. Integers wrap on overflow, as in int_arithmetic.
+
+#define INT_OPERATOR(name, expression)                                      \
+    static Value name(Interpreter* interpreter, const Closure* closure) {  \
+        EVALUATE_OPERANDS()                                                 \
+        uint64_t a = (uint64_t)left.data.as_int;                           \
+        uint64_t b = (uint64_t)right.data.as_int;                          \
+        return create_int_value((int64_t)(expression));                    \
+    }
+
+INT_OPERATOR(run_add_int, a + b)
+INT_OPERATOR(run_subtract_int, a - b)
+INT_OPERATOR(run_multiply_int, a * b)
+
+// Integer division and modulo, which trap on a zero divisor
+static Value run_divide_int(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    if (right.data.as_int == 0) {
+        return runtime_error(interpreter, closure, ERROR_RUNTIME, "Division by zero");
+    }
+    return create_int_value(int_arithmetic(closure->as.binary.op, left.data.as_int, right.data.as_int));
+}
+
+#define FLOAT_OPERATOR(name, expression)                                    \
+    static Value name(Interpreter* interpreter, const Closure* closure) {  \
+        EVALUATE_OPERANDS()                                                 \
+        double a = left.data.as_float;                                     \
+        double b = right.data.as_float;                                    \
+        return create_float_value(expression);                             \
+    }
+
+FLOAT_OPERATOR(run_add_float, a + b)
+FLOAT_OPERATOR(run_subtract_float, a - b)
+FLOAT_OPERATOR(run_multiply_float, a * b)
+FLOAT_OPERATOR(run_divide_float, a / b)
+FLOAT_OPERATOR(run_modulo_float, fmod(a, b))
+
+static Value run_concat(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    Value result = env_concat(&interpreter->env, left, right);
+    free_value(left);
+    free_value(right);
+    return result;
+}
+
+// Comparisons. Integers compare directly; floats go through float_compare
+// with IEEE 754 semantics, so NaN compares the same in every engine.
+
+#define INT_COMPARISON(name, operator)                                      \
+    static Value name(Interpreter* interpreter, const Closure* closure) {  \
+        EVALUATE_OPERANDS()                                                 \
+        return create_bool_value(left.data.as_int operator right.data.as_int); \
+    }
+
+INT_COMPARISON(run_less_int, <)
+INT_COMPARISON(run_less_equal_int, <=)
+INT_COMPARISON(run_greater_int, >)
+INT_COMPARISON(run_greater_equal_int, >=)
+INT_COMPARISON(run_equal_int, ==)
+INT_COMPARISON(run_not_equal_int, !=)
+
+static Value run_compare_float(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    return create_bool_value(float_compare(closure->as.binary.op, left.data.as_float, right.data.as_float));
+}
+
+static Value run_compare_bool(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    return create_bool_value(compare_result(closure->as.binary.op, left.data.as_bool != right.data.as_bool));
+}
+
+static Value run_compare_string(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    TokenType op = closure->as.binary.op;
+    int cmp = (op == TOKEN_EQUAL_EQUAL || op == TOKEN_BANG_EQUAL)
+        ? !string_values_equal(left, right)
+        : compare_string_values(left, right);
+    free_value(left);
+    free_value(right);
+    return create_bool_value(compare_result(op, cmp));
+}
+
+// Comparison with null: the outcome depends only on the static types
+static Value run_compare_null(Interpreter* interpreter, const Closure* closure) {
+    EVALUATE_OPERANDS()
+    free_value(left);
+    free_value(right);
+    return create_bool_value(compare_result(closure->as.binary.op, closure->as.binary.same_type ? 0 : 1));
+}
+
+// Short-circuit operators
+
+static Value run_and(Interpreter* interpreter, const Closure* closure) {
+    Value left = RUN(closure->as.binary.left);
+    if (interpreter->had_error || !left.data.as_bool) {
+        return interpreter->had_error ? create_null_value() : left;
+    }
+    return RUN(closure->as.binary.right);
+}
+
+static Value run_or(Interpreter* interpreter, const Closure* closure) {
+    Value left = RUN(closure->as.binary.left);
+    if (interpreter->had_error || left.data.as_bool) {
+        return interpreter->had_error ? create_null_value() : left;
+    }
+    return RUN(closure->as.binary.right);
+}
+
+// Declarations
+
+static Value run_declaration(Interpreter* interpreter, const Closure* closure) {
+    Value value = RUN(closure->as.declaration.initializer);
+    if (interpreter->had_error) {
+        free_value(value);
+        return create_null_value();
+    }
+    
+    env_define(&interpreter->env, closure->as.declaration.name, value);
+    
+    if (interpreter->repl_mode) {
+        char* value_str = value_to_string(value);
+        printf("%s: %s = %s\n", closure->as.declaration.name,
+               value_type_to_string(closure->as.declaration.type), value_str);
+        free(value_str);
+    }
+    
+    free_value(value);
+    return create_null_value();
+}
+
+// Pick the function for an arithmetic operator on operands of a static type
+static ClosureFn arithmetic_function(TokenType op, ValueType type) {
+    if (type == VALUE_INT) {
+        switch (op) {
+            case TOKEN_PLUS:  return run_add_int;
+            case TOKEN_MINUS: return run_subtract_int;
+            case TOKEN_STAR:  return run_multiply_int;
+            default:          return run_divide_int;
+        }
+    }
+    
+    if (type == VALUE_FLOAT) {
+        switch (op) {
+            case TOKEN_PLUS:  return run_add_float;
+            case TOKEN_MINUS: return run_subtract_float;
+            case TOKEN_STAR:  return run_multiply_float;
+            case TOKEN_SLASH: return run_divide_float;
+            default:          return run_modulo_float;
+        }
+    }
+    
+    return run_concat;
+}
+
+// Pick the function for a comparison from its operand types
+static ClosureFn comparison_function(TokenType op, ValueType left_type, ValueType right_type) {
+    if (left_type == VALUE_NULL || right_type == VALUE_NULL) {
+        return run_compare_null;
+    }
+    
+    switch (left_type) {
+        case VALUE_INT:
+            switch (op) {
+                case TOKEN_LESS:          return run_less_int;
+                case TOKEN_LESS_EQUAL:    return run_less_equal_int;
+                case TOKEN_GREATER:       return run_greater_int;
+                case TOKEN_GREATER_EQUAL: return run_greater_equal_int;
+                case TOKEN_EQUAL_EQUAL:   return run_equal_int;
+                default:                  return run_not_equal_int;
+            }
+        case VALUE_FLOAT: return run_compare_float;
+        case VALUE_BOOL:  return run_compare_bool;
+        default:          return run_compare_string;
+    }
+}
+
+static bool is_arithmetic(TokenType op) {
+    return op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_STAR ||
+           op == TOKEN_SLASH || op == TOKEN_PERCENT;
+}
+
+// Closures needed for a subtree
+static int count_closures(const AstNode* node) {
+    switch (node->type) {
+        case NODE_VARIABLE_DECLARATION:
+            return 1 + count_closures(node->as.var_decl.initializer);
+        case NODE_UNARY:
+            return 1 + count_closures(node->as.unary.operand);
+        case NODE_CONVERT:
+            return 1 + count_closures(node->as.convert.operand);
+        case NODE_BINARY:
+            return 1 + count_closures(node->as.binary.left) + count_closures(node->as.binary.right);
+        default:
+            return 1;
+    }
+}
+
+// Compile a subtree into the program's array, children first
+static const Closure* compile_node(ClosureProgram* program, const AstNode* node) {
+    Closure closure;
+    memset(&closure, 0, sizeof(Closure));
+    closure.line = node->line;
+    closure.column = node->column;
+    
+    switch (node->type) {
+        case NODE_VARIABLE_DECLARATION:
+            closure.run = run_declaration;
+            closure.as.declaration.name = node->as.var_decl.name;
+            closure.as.declaration.initializer = compile_node(program, node->as.var_decl.initializer);
+            closure.as.declaration.type = node->as.var_decl.var_type;
+            break;
+        case NODE_LITERAL: {
+            const Value* literal = &node->as.literal;
+            bool shared = literal->type == VALUE_STRING && literal->short_length == STRING_ON_HEAP;
+            closure.run = shared ? run_string_literal : run_constant;
+            closure.as.literal = *literal;
+            break;
+        }
+        case NODE_VARIABLE:
+            closure.run = run_variable;
+            closure.as.name = node->as.variable.name;
+            break;
+        case NODE_UNARY:
+            closure.run = node->value_type == VALUE_INT ? run_negate_int
+                        : node->value_type == VALUE_FLOAT ? run_negate_float
+                        : run_not;
+            closure.as.operand = compile_node(program, node->as.unary.operand);
+            break;
+        case NODE_CONVERT:
+            closure.run = run_int_to_float;
+            closure.as.operand = compile_node(program, node->as.convert.operand);
+            break;
+        case NODE_BINARY: {
+            TokenType op = node->as.binary.op;
+            ValueType left_type = node->as.binary.left->value_type;
+            ValueType right_type = node->as.binary.right->value_type;
+            
+            if (op == TOKEN_AND_AND || op == TOKEN_OR_OR) {
+                closure.run = op == TOKEN_AND_AND ? run_and : run_or;
+            } else if (is_arithmetic(op)) {
+                closure.run = arithmetic_function(op, node->value_type);
+            } else {
+                closure.run = comparison_function(op, left_type, right_type);
+            }
+            
+            closure.as.binary.op = op;
+            closure.as.binary.same_type = left_type == right_type;
+            closure.as.binary.left = compile_node(program, node->as.binary.left);
+            closure.as.binary.right = compile_node(program, node->as.binary.right);
+            break;
+        }
+        default:
+            break;
+    }
+    
+    Closure* slot = &program->closures[program->closure_count++];
+    *slot = closure;
+    return slot;
+}
+
+// Compile an analyzed program
+ClosureProgram* compile_closures(const AstNode* node) {
+    ClosureProgram* program = malloc(sizeof(ClosureProgram));
+    int count = 0;
+    
+    for (int i = 0; i < node->as.program.count; i++) {
+        count += count_closures(node->as.program.declarations[i]);
+    }
+    
+    program->closures = malloc(sizeof(Closure) * (count > 0 ? count : 1));
+    program->closure_count = 0;
+    program->declarations = malloc(sizeof(Closure*) * (node->as.program.count > 0 ? node->as.program.count : 1));
+    program->declaration_count = node->as.program.count;
+    
+    for (int i = 0; i < node->as.program.count; i++) {
+        program->declarations[i] = compile_node(program, node->as.program.declarations[i]);
+    }
+    return program;
+}
+
+// Run a compiled program
+bool run_closures(Interpreter* interpreter, const ClosureProgram* program) {
+    for (int i = 0; i < program->declaration_count && !interpreter->had_error; i++) {
+        const Closure* declaration = program->declarations[i];
+        free_value(RUN(declaration));
+        
+        // Between declarations only variables hold values
+        gc_safepoint(&interpreter->env.heap);
+    }
+    return !interpreter->had_error;
+}
+
+void free_closures(ClosureProgram* program) {
+    if (program == NULL) {
+        return;
+    }
+    
+    free(program->closures);
+    free(program->declarations);
+    free(program);
+}
+
+size_t closures_size(const ClosureProgram* program) {
+    return sizeof(ClosureProgram) + sizeof(Closure) * program->closure_count +
+           sizeof(Closure*) * program->declaration_count;
+}
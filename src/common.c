@@ -1,91 +1,140 @@
 #include "../include/common.h"
+#include "../include/intern.h"
+#include "../include/kasd_runtime.h"
+#include "../include/pool.h"
+#include "../include/region.h"
 #include <stdarg.h>
-
-// Global state instance
-KasdState kasd_state;
+#include <unistd.h>
 
 // Initialize the KASD state
-void init_kasd_state(int log_level) {
-    kasd_state.log_level = log_level;
-    clear_error();
+void init_kasd_state(KasdState* state, int log_level) {
+    state->log_level = log_level;
+    state->error.has_error = false;
+    clear_error(state);
 }
 
 // Error handling functions
-void set_error(ErrorType type, int line, int column, const char* message, const char* source_line, int source_pos, int source_len) {
-    if (kasd_state.error.has_error) {
+void set_error(KasdState* state, ErrorType type, int line, int column, const char* message, const char* source, int source_pos, int source_len) {
+    if (state->error.has_error) {
         return; // Already have an error, don't overwrite
     }
     
-    kasd_state.error.type = type;
-    kasd_state.error.line = line;
-    kasd_state.error.column = column;
-    kasd_state.error.message = strdup(message);
-    kasd_state.error.source_line = source_line ? strdup(source_line) : NULL;
-    kasd_state.error.source_pos = source_pos;
-    kasd_state.error.source_len = source_len;
-    kasd_state.error.has_error = true;
+    // Only the position is recorded; the offending line is located lazily
+    // in print_error() so error paths never copy the whole source
+    state->error.type = type;
+    state->error.line = line;
+    state->error.column = column;
+    state->error.message = strdup(message);
+    state->error.source = source;
+    state->error.source_pos = source_pos;
+    state->error.source_len = source_len;
+    state->error.has_error = true;
 }
 
-void print_error(void) {
-    if (!kasd_state.error.has_error) {
-        return;
+// Find the bounds of the line containing pos: [*start, *end)
+static void find_line_bounds(const char* source, int pos, int* start, int* end) {
+    int s = pos;
+    while (s > 0 && source[s - 1] != '\n') {
+        s--;
     }
     
-    const char* error_type_str = "";
-    const char* color = ANSI_RED;
+    int e = pos;
+    while (source[e] != '\0' && source[e] != '\n') {
+        e++;
+    }
     
-    switch (kasd_state.error.type) {
-        case ERROR_SYNTAX:  error_type_str = "Syntax Error"; break;
-        case ERROR_TYPE:    error_type_str = "Type Error"; break;
-        case ERROR_NAME:    error_type_str = "Name Error"; break;
-        case ERROR_RUNTIME: error_type_str = "Runtime Error"; break;
-        case ERROR_INTERNAL: error_type_str = "Internal Error"; break;
-        default: error_type_str = "Unknown Error"; break;
+    *start = s;
+    *end = e;
+}
+
+// Human-readable name of an error type
+static const char* error_type_to_string(ErrorType type) {
+    switch (type) {
+        case ERROR_SYNTAX:  return "Syntax Error";
+        case ERROR_TYPE:    return "Type Error";
+        case ERROR_NAME:    return "Name Error";
+        case ERROR_RUNTIME: return "Runtime Error";
+        case ERROR_INTERNAL: return "Internal Error";
+        default: return "Unknown Error";
     }
+}
+
+void print_error(KasdState* state) {
+    if (!state->error.has_error) {
+        return;
+    }
+    
+    const char* error_type_str = error_type_to_string(state->error.type);
+    const char* color = ANSI_RED;
     
     fprintf(stderr, "%s%s at line %d, column %d: %s%s\n", 
-            color, error_type_str, kasd_state.error.line, kasd_state.error.column, 
-            kasd_state.error.message, ANSI_RESET);
+            color, error_type_str, state->error.line, state->error.column, 
+            state->error.message, ANSI_RESET);
     
-    if (kasd_state.error.source_line) {
-        fprintf(stderr, "%s\n", kasd_state.error.source_line);
+    if (state->error.source && state->error.source_pos >= 0) {
+        int line_start, line_end;
+        find_line_bounds(state->error.source, state->error.source_pos,
+                         &line_start, &line_end);
         
-        // Print caret pointing to error position
-        if (kasd_state.error.source_pos >= 0) {
-            for (int i = 0; i < kasd_state.error.source_pos; i++) {
-                fputc(' ', stderr);
-            }
-            
-            fprintf(stderr, "%s", color);
-            for (int i = 0; i < kasd_state.error.source_len; i++) {
-                fputc('^', stderr);
-            }
-            fprintf(stderr, "%s\n", ANSI_RESET);
+        fprintf(stderr, "%.*s\n", line_end - line_start,
+                state->error.source + line_start);
+        
+        // Print caret pointing to error position, clipped to this line
+        int caret_len = state->error.source_len;
+        if (caret_len > line_end - state->error.source_pos) {
+            caret_len = line_end - state->error.source_pos;
+        }
+        if (caret_len < 1) {
+            caret_len = 1;
+        }
+        
+        for (int i = line_start; i < state->error.source_pos; i++) {
+            fputc(state->error.source[i] == '\t' ? '\t' : ' ', stderr);
+        }
+        
+        fprintf(stderr, "%s", color);
+        for (int i = 0; i < caret_len; i++) {
+            fputc('^', stderr);
         }
+        fprintf(stderr, "%s\n", ANSI_RESET);
     }
 }
 
-void clear_error(void) {
-    if (kasd_state.error.has_error) {
-        free(kasd_state.error.message);
-        if (kasd_state.error.source_line) {
-            free(kasd_state.error.source_line);
-        }
+// Format the current error as a single uncolored line, or NULL if none
+char* format_error(KasdState* state) {
+    if (!state->error.has_error) {
+        return NULL;
+    }
+    
+    const char* format = "%s at line %d, column %d: %s";
+    const char* type_str = error_type_to_string(state->error.type);
+    int length = snprintf(NULL, 0, format, type_str, state->error.line,
+                          state->error.column, state->error.message);
+    
+    char* result = malloc(length + 1);
+    snprintf(result, length + 1, format, type_str, state->error.line,
+             state->error.column, state->error.message);
+    return result;
+}
+
+void clear_error(KasdState* state) {
+    if (state->error.has_error) {
+        free(state->error.message);
     }
     
-    kasd_state.error.type = ERROR_NONE;
-    kasd_state.error.line = 0;
-    kasd_state.error.column = 0;
-    kasd_state.error.message = NULL;
-    kasd_state.error.source_line = NULL;
-    kasd_state.error.source_pos = -1;
-    kasd_state.error.source_len = 0;
-    kasd_state.error.has_error = false;
+    state->error.type = ERROR_NONE;
+    state->error.line = 0;
+    state->error.column = 0;
+    state->error.message = NULL;
+    state->error.source = NULL;
+    state->error.source_pos = -1;
+    state->error.source_len = 0;
+    state->error.has_error = false;
 }
 
 // Logging functions
-void log_message(int level, const char* format, ...) {
-    if (level > kasd_state.log_level) {
+void log_message(KasdState* state, int level, const char* format, ...) {
+    if (level > state->log_level) {
         return;
     }
     
@@ -121,6 +170,109 @@ void log_message(int level, const char* format, ...) {
     fprintf(stderr, "\n");
 }
 
+// FNV-1a hash of a byte range
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed) {
+    const unsigned char* bytes = data;
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+    
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Write a file under a temporary name and rename it into place, so readers
+// never see a partial file and a failure leaves any old file intact
+bool write_file_atomically(const char* path, const void* data, size_t size) {
+    size_t temp_size = strlen(path) + 32;
+    char* temp_path = malloc(temp_size);
+    snprintf(temp_path, temp_size, "%s.%ld.tmp", path, (long)getpid());
+    
+    FILE* file = fopen(temp_path, "wb");
+    bool written = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL) {
+        written = fclose(file) == 0 && written;
+    }
+    written = written && rename(temp_path, path) == 0;
+    if (!written) {
+        remove(temp_path);
+    }
+    
+    free(temp_path);
+    return written;
+}
+
+// FNV-1a over a string's characters, continuing from hash
+static uint32_t string_hash(uint32_t hash, const char* chars, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)chars[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool chars_are_ascii(const char* chars, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if ((unsigned char)chars[i] >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t hash_chars(const char* chars, size_t length) {
+    return string_hash(2166136261u, chars, length);
+}
+
+size_t string_size(size_t length) {
+    return sizeof(String) + length + 1;
+}
+
+// Fill in a string header and characters
+static void init_string(String* string, int refcount, const char* chars, size_t length) {
+    atomic_init(&string->refcount, refcount);
+    string->length = (uint32_t)length;
+    string->hash = string_hash(2166136261u, chars, length);
+    string->is_ascii = chars_are_ascii(chars, length);
+    string->is_interned = false;
+    memcpy(string->chars, chars, length);
+    string->chars[length] = '\0';
+}
+
+// Create a string holding a copy of chars
+String* create_string(const char* chars, size_t length) {
+    String* string = pool_alloc(POOL_STRING, string_size(length));
+    init_string(string, 1, chars, length);
+    return string;
+}
+
+void init_static_string(void* memory, const char* chars, size_t length) {
+    // Clear the header padding and the bytes after the terminator too, so
+    // file images are reproducible
+    memset(memory, 0, string_size(length));
+    init_string(memory, STRING_STATIC, chars, length);
+}
+
+String* retain_string(String* string) {
+    if (atomic_load_explicit(&string->refcount, memory_order_relaxed) != STRING_STATIC) {
+        atomic_fetch_add_explicit(&string->refcount, 1, memory_order_relaxed);
+    }
+    return string;
+}
+
+void release_string(String* string) {
+    if (atomic_load_explicit(&string->refcount, memory_order_relaxed) == STRING_STATIC) {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&string->refcount, 1, memory_order_acq_rel) == 1) {
+        if (string->is_interned) {
+            unintern_string(string);
+        }
+        pool_free(POOL_STRING, string, string_size(string->length));
+    }
+}
+
 // Value functions
 Value create_null_value(void) {
     Value value;
@@ -150,36 +302,143 @@ Value create_bool_value(bool val) {
 }
 
 Value create_string_value(const char* val) {
+    return create_string_value_length(val, strlen(val));
+}
+
+// Store short strings inline, zero-padded; longer ones get a String
+Value create_string_value_length(const char* chars, size_t length) {
+    Value value;
+    value.type = VALUE_STRING;
+    
+    if (length <= SHORT_STRING_MAX) {
+        value.short_length = (uint8_t)length;
+        memset(value.data.as_short, 0, sizeof(value.data.as_short));
+        memcpy(value.data.as_short, chars, length);
+    } else {
+        value.short_length = STRING_ON_HEAP;
+        value.data.as_string = create_string(chars, length);
+    }
+    return value;
+}
+
+// Take a reference to an existing string, copying it inline if it is short
+Value create_shared_string_value(String* string) {
+    if (string->length <= SHORT_STRING_MAX) {
+        return create_string_value_length(string->chars, string->length);
+    }
+    
+    Value value;
+    value.type = VALUE_STRING;
+    value.short_length = STRING_ON_HEAP;
+    value.data.as_string = retain_string(string);
+    return value;
+}
+
+// A string value as the runtime shared with translated programs takes it
+static KasdString runtime_string(const Value* value) {
+    return (KasdString){string_chars(value), string_length(value)};
+}
+
+// Concatenate two strings, allocating a long result from region if one is
+// given; a long left side's hash is continued, not redone
+Value concat_string_values(Value left, Value right, Region* region) {
+    size_t left_length = string_length(&left);
+    size_t right_length = string_length(&right);
+    size_t length = left_length + right_length;
+    
+    if (length <= SHORT_STRING_MAX) {
+        Value value = create_string_value_length(string_chars(&left), left_length);
+        kasd_rt_concat_into(value.data.as_short, runtime_string(&left), runtime_string(&right));
+        value.short_length = (uint8_t)length;
+        return value;
+    }
+    
+    String* string;
+    if (region != NULL) {
+        string = region_alloc(region, string_size(length));
+        atomic_init(&string->refcount, STRING_STATIC);
+    } else {
+        string = pool_alloc(POOL_STRING, string_size(length));
+        atomic_init(&string->refcount, 1);
+    }
+    string->length = (uint32_t)length;
+    if (left.short_length == STRING_ON_HEAP) {
+        string->hash = left.data.as_string->hash;
+        string->is_ascii = left.data.as_string->is_ascii;
+    } else {
+        string->hash = string_hash(2166136261u, left.data.as_short, left_length);
+        string->is_ascii = chars_are_ascii(left.data.as_short, left_length);
+    }
+    string->hash = string_hash(string->hash, string_chars(&right), right_length);
+    string->is_ascii = string->is_ascii && chars_are_ascii(string_chars(&right), right_length);
+    string->is_interned = false;
+    kasd_rt_concat_into(string->chars, runtime_string(&left), runtime_string(&right));
+    
     Value value;
     value.type = VALUE_STRING;
-    value.data.as_string = strdup(val);
+    value.short_length = STRING_ON_HEAP;
+    value.data.as_string = string;
+    return value;
+}
+
+// Equality. Equal strings share a representation, so short strings need
+// only their inline bytes. Two interned strings are equal only if they are
+// the same object; other long strings are mostly told apart by hash.
+bool string_values_equal(Value left, Value right) {
+    if (left.short_length != right.short_length) {
+        return false;
+    }
+    if (left.short_length != STRING_ON_HEAP) {
+        return memcmp(left.data.as_short, right.data.as_short, left.short_length) == 0;
+    }
+    
+    const String* a = left.data.as_string;
+    const String* b = right.data.as_string;
+    if (a == b || (a->is_interned && b->is_interned)) {
+        return a == b;
+    }
+    return a->length == b->length && a->hash == b->hash && memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+// Three-way comparison in byte order
+int compare_string_values(Value left, Value right) {
+    return kasd_rt_compare_string(runtime_string(&left), runtime_string(&right));
+}
+
+// Take another reference to a value; strings are shared, not copied
+Value copy_value(Value value) {
+    if (value.type == VALUE_STRING && value.short_length == STRING_ON_HEAP) {
+        retain_string(value.data.as_string);
+    }
     return value;
 }
 
+// Inline strings own nothing, so only heap strings are released
 void free_value(Value value) {
-    if (value.type == VALUE_STRING && value.data.as_string != NULL) {
-        free(value.data.as_string);
+    if (value.type == VALUE_STRING && value.short_length == STRING_ON_HEAP) {
+        release_string(value.data.as_string);
     }
 }
 
+// Formatted as translated programs print their variables
 char* value_to_string(Value value) {
-    char buffer[64];
+    char buffer[KASD_RT_NUMBER_SIZE];
     char* result = NULL;
     
     switch (value.type) {
         case VALUE_NULL:
             return strdup("null");
         case VALUE_INT:
-            snprintf(buffer, sizeof(buffer), "%lld", (long long)value.data.as_int);
+            kasd_rt_format_int(buffer, value.data.as_int);
             return strdup(buffer);
         case VALUE_FLOAT:
-            snprintf(buffer, sizeof(buffer), "%g", value.data.as_float);
+            kasd_rt_format_float(buffer, value.data.as_float);
             return strdup(buffer);
         case VALUE_BOOL:
-            return strdup(value.data.as_bool ? "true" : "false");
+            return strdup(kasd_rt_format_bool(value.data.as_bool));
         case VALUE_STRING:
-            result = malloc(strlen(value.data.as_string) + 3);
-            sprintf(result, "\"%s\"", value.data.as_string);
+            result = malloc(string_length(&value) + 3);
+            kasd_rt_format_string(result, runtime_string(&value));
             return result;
     }
     
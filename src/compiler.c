@@ -0,0 +1,487 @@
+#include "../include/compiler.h"
+
+// Code generation state
+typedef struct {
+    Chunk* chunk;
+    int depth;  // Current operand stack depth
+    
+    // Open-addressed index of chunk->names, so each name is stored once
+    int* name_slots;
+    int name_capacity;
+    
+    // Open-addressed index of string constants, so repeated literals share
+    // one constant and one copy in the string table
+    int* string_slots;
+    int string_count;
+    int string_capacity;
+} Compiler;
+
+static void compile_node(Compiler* compiler, AstNode* node);
+
+// Emit an instruction at a source position and track the stack depth
+static int emit_at(Compiler* compiler, int line, int column, OpCode op, uint8_t flags, int32_t operand, int change) {
+    compiler->depth += change;
+    if (compiler->depth > compiler->chunk->max_stack) {
+        compiler->chunk->max_stack = compiler->depth;
+    }
+    return write_instruction(compiler->chunk, op, flags, operand, line, column);
+}
+
+static int emit(Compiler* compiler, AstNode* node, OpCode op, uint8_t flags, int32_t operand, int change) {
+    return emit_at(compiler, node->line, node->column, op, flags, operand, change);
+}
+
+// Index of a global name in the chunk, adding it on first use
+static int name_index(Compiler* compiler, const char* name) {
+    Chunk* chunk = compiler->chunk;
+    
+    if (chunk->name_count * 2 >= compiler->name_capacity) {
+        // Rebuild the index at double the size
+        free(compiler->name_slots);
+        compiler->name_capacity = compiler->name_capacity < 64 ? 64 : compiler->name_capacity * 2;
+        compiler->name_slots = malloc(sizeof(int) * compiler->name_capacity);
+        for (int i = 0; i < compiler->name_capacity; i++) {
+            compiler->name_slots[i] = -1;
+        }
+        
+        for (int i = 0; i < chunk->name_count; i++) {
+            const char* existing = chunk_string(chunk, chunk->names[i]);
+            size_t slot = hash_bytes(existing, strlen(existing), 0) & (compiler->name_capacity - 1);
+            while (compiler->name_slots[slot] >= 0) {
+                slot = (slot + 1) & (compiler->name_capacity - 1);
+            }
+            compiler->name_slots[slot] = i;
+        }
+    }
+    
+    size_t slot = hash_bytes(name, strlen(name), 0) & (compiler->name_capacity - 1);
+    while (compiler->name_slots[slot] >= 0) {
+        int index = compiler->name_slots[slot];
+        if (strcmp(chunk_string(chunk, chunk->names[index]), name) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & (compiler->name_capacity - 1);
+    }
+    
+    compiler->name_slots[slot] = add_name(chunk, name);
+    return compiler->name_slots[slot];
+}
+
+// Characters of a string constant
+static const char* constant_chars(const Chunk* chunk, int index, uint32_t* length) {
+    const String* string = chunk_string_object(chunk, chunk->constants[index].data.as_string);
+    *length = string->length;
+    return string->chars;
+}
+
+// Index of a constant for a literal; strings are stored once per chunk
+static int constant_index(Compiler* compiler, Value value) {
+    Chunk* chunk = compiler->chunk;
+    
+    if (value.type != VALUE_STRING) {
+        return add_constant(chunk, value);
+    }
+    
+    if (compiler->string_count * 2 >= compiler->string_capacity) {
+        // Rebuild the index at double the size
+        int old_capacity = compiler->string_capacity;
+        int* old_slots = compiler->string_slots;
+        compiler->string_capacity = old_capacity < 64 ? 64 : old_capacity * 2;
+        compiler->string_slots = malloc(sizeof(int) * compiler->string_capacity);
+        for (int i = 0; i < compiler->string_capacity; i++) {
+            compiler->string_slots[i] = -1;
+        }
+        
+        for (int i = 0; i < old_capacity; i++) {
+            if (old_slots[i] < 0) {
+                continue;
+            }
+            uint32_t length;
+            const char* chars = constant_chars(chunk, old_slots[i], &length);
+            size_t slot = hash_chars(chars, length) & (compiler->string_capacity - 1);
+            while (compiler->string_slots[slot] >= 0) {
+                slot = (slot + 1) & (compiler->string_capacity - 1);
+            }
+            compiler->string_slots[slot] = old_slots[i];
+        }
+        free(old_slots);
+    }
+    
+    const char* chars = string_chars(&value);
+    size_t length = string_length(&value);
+    size_t slot = hash_chars(chars, length) & (compiler->string_capacity - 1);
+    while (compiler->string_slots[slot] >= 0) {
+        uint32_t existing_length;
+        const char* existing = constant_chars(chunk, compiler->string_slots[slot], &existing_length);
+        if (existing_length == length && memcmp(existing, chars, length) == 0) {
+            return compiler->string_slots[slot];
+        }
+        slot = (slot + 1) & (compiler->string_capacity - 1);
+    }
+    
+    compiler->string_slots[slot] = add_constant(chunk, value);
+    compiler->string_count++;
+    return compiler->string_slots[slot];
+}
+
+// Map an arithmetic operator to its instruction for int or float operands
+static OpCode arithmetic_opcode(TokenType op, ValueType type) {
+    OpCode base = (type == VALUE_INT) ? OP_ADD_INT : OP_ADD_FLOAT;
+    
+    switch (op) {
+        case TOKEN_MINUS:   return (OpCode)(base + 1);
+        case TOKEN_STAR:    return (OpCode)(base + 2);
+        case TOKEN_SLASH:   return (OpCode)(base + 3);
+        case TOKEN_PERCENT: return (OpCode)(base + 4);
+        default:            return base;
+    }
+}
+
+// Map a comparison to its instruction by operand type
+static OpCode comparison_opcode(ValueType type) {
+    switch (type) {
+        case VALUE_INT:   return OP_COMPARE_INT;
+        case VALUE_FLOAT: return OP_COMPARE_FLOAT;
+        case VALUE_BOOL:  return OP_COMPARE_BOOL;
+        default:          return OP_COMPARE_STRING;
+    }
+}
+
+// Compile && and ||: the left value is the result unless it does not decide
+static void compile_logical(Compiler* compiler, AstNode* node) {
+    OpCode jump = (node->as.binary.op == TOKEN_AND_AND) ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+    
+    compile_node(compiler, node->as.binary.left);
+    int exit = emit(compiler, node, jump, 0, 0, 0);
+    emit(compiler, node, OP_POP, 0, 0, -1);
+    compile_node(compiler, node->as.binary.right);
+    compiler->chunk->code[exit].operand = compiler->chunk->code_count;
+}
+
+// Compile a binary operation specialized on its operand types
+static void compile_binary(Compiler* compiler, AstNode* node) {
+    TokenType op = node->as.binary.op;
+    
+    if (op == TOKEN_AND_AND || op == TOKEN_OR_OR) {
+        compile_logical(compiler, node);
+        return;
+    }
+    
+    compile_node(compiler, node->as.binary.left);
+    compile_node(compiler, node->as.binary.right);
+    
+    if (op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_STAR ||
+        op == TOKEN_SLASH || op == TOKEN_PERCENT) {
+        OpCode opcode = (node->value_type == VALUE_STRING)
+            ? OP_CONCAT : arithmetic_opcode(op, node->value_type);
+        emit(compiler, node, opcode, 0, 0, -1);
+        return;
+    }
+    
+    ValueType left_type = node->as.binary.left->value_type;
+    ValueType right_type = node->as.binary.right->value_type;
+    if (left_type == VALUE_NULL || right_type == VALUE_NULL) {
+        // Ordering is known statically: equal only if both are null
+        emit(compiler, node, OP_COMPARE_NULL, (uint8_t)op, left_type == right_type ? 0 : 1, -1);
+    } else {
+        emit(compiler, node, comparison_opcode(left_type), (uint8_t)op, 0, -1);
+    }
+}
+
+// Compile a node
+static void compile_node(Compiler* compiler, AstNode* node) {
+    switch (node->type) {
+        case NODE_PROGRAM:
+            for (int i = 0; i < node->as.program.count; i++) {
+                compile_node(compiler, node->as.program.declarations[i]);
+            }
+            break;
+        case NODE_VARIABLE_DECLARATION:
+            compile_node(compiler, node->as.var_decl.initializer);
+            emit(compiler, node, OP_DEFINE, (uint8_t)node->as.var_decl.var_type,
+                 name_index(compiler, node->as.var_decl.name), -1);
+            break;
+        case NODE_LITERAL:
+            emit(compiler, node, OP_CONSTANT, 0, constant_index(compiler, node->as.literal), 1);
+            break;
+        case NODE_VARIABLE:
+            emit(compiler, node, OP_LOAD, 0, name_index(compiler, node->as.variable.name), 1);
+            break;
+        case NODE_UNARY: {
+            compile_node(compiler, node->as.unary.operand);
+            OpCode op = (node->value_type == VALUE_INT) ? OP_NEGATE_INT
+                      : (node->value_type == VALUE_FLOAT) ? OP_NEGATE_FLOAT : OP_NOT;
+            emit(compiler, node, op, 0, 0, 0);
+            break;
+        }
+        case NODE_BINARY:
+            compile_binary(compiler, node);
+            break;
+        case NODE_CONVERT:
+            compile_node(compiler, node->as.convert.operand);
+            emit(compiler, node, OP_INT_TO_FLOAT, 0, 0, 0);
+            break;
+    }
+}
+
+// Compile an analyzed program into a chunk
+void compile_program(Chunk* chunk, AstNode* program) {
+    Compiler compiler = {chunk, 0, NULL, 0, NULL, 0, 0};
+    
+    if (program != NULL) {
+        compile_node(&compiler, program);
+    }
+    free(compiler.name_slots);
+    free(compiler.string_slots);
+}
+
+// Lowering of SSA form to the stack machine
+typedef struct {
+    Compiler* compiler;
+    const IrProgram* program;
+    int* position;      // Layout order of each value
+    int* uses;
+    int* slot;          // Local holding the value, or -1
+    bool* inlined;      // Computed where it is used
+} IrLowering;
+
+// Instruction for each value operator
+static const OpCode ir_opcodes[IR_COUNT] = {
+    [IR_NEGATE_INT] = OP_NEGATE_INT,
+    [IR_NEGATE_FLOAT] = OP_NEGATE_FLOAT,
+    [IR_NOT] = OP_NOT,
+    [IR_INT_TO_FLOAT] = OP_INT_TO_FLOAT,
+    [IR_ADD_INT] = OP_ADD_INT,
+    [IR_SUBTRACT_INT] = OP_SUBTRACT_INT,
+    [IR_MULTIPLY_INT] = OP_MULTIPLY_INT,
+    [IR_DIVIDE_INT] = OP_DIVIDE_INT,
+    [IR_MODULO_INT] = OP_MODULO_INT,
+    [IR_ADD_FLOAT] = OP_ADD_FLOAT,
+    [IR_SUBTRACT_FLOAT] = OP_SUBTRACT_FLOAT,
+    [IR_MULTIPLY_FLOAT] = OP_MULTIPLY_FLOAT,
+    [IR_DIVIDE_FLOAT] = OP_DIVIDE_FLOAT,
+    [IR_MODULO_FLOAT] = OP_MODULO_FLOAT,
+    [IR_CONCAT] = OP_CONCAT,
+    [IR_COMPARE_INT] = OP_COMPARE_INT,
+    [IR_COMPARE_FLOAT] = OP_COMPARE_FLOAT,
+    [IR_COMPARE_BOOL] = OP_COMPARE_BOOL,
+    [IR_COMPARE_STRING] = OP_COMPARE_STRING,
+};
+
+static void lower_chain(IrLowering* lowering, int block);
+static void lower_tree(IrLowering* lowering, int id);
+
+// Push a value: from its local, or by computing it here
+static void lower_value(IrLowering* lowering, int id) {
+    if (lowering->slot[id] >= 0) {
+        const IrValue* value = &lowering->program->values[id];
+        emit_at(lowering->compiler, value->line, value->column, OP_GET_LOCAL, 0, lowering->slot[id], 1);
+    } else {
+        lower_tree(lowering, id);
+    }
+}
+
+// Compute a value and its inlined operands
+static void lower_tree(IrLowering* lowering, int id) {
+    Compiler* compiler = lowering->compiler;
+    const IrProgram* program = lowering->program;
+    const IrValue* value = &program->values[id];
+    int line = value->line;
+    int column = value->column;
+    
+    switch (value->op) {
+        case IR_CONSTANT:
+            emit_at(compiler, line, column, OP_CONSTANT, 0, constant_index(compiler, value->as.constant), 1);
+            break;
+        case IR_LOAD:
+            emit_at(compiler, line, column, OP_LOAD, 0, name_index(compiler, value->as.name), 1);
+            break;
+        case IR_PHI: {
+            // The branch ends the join's dominator; it enters the right
+            // operand on true for && and on false for ||
+            const IrBlock* branch_block = &program->blocks[program->blocks[value->block].idom];
+            const IrValue* branch = &program->values[branch_block->code[branch_block->count - 1]];
+            OpCode jump = branch->as.targets[0] == value->as.targets[0] ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+            
+            lower_value(lowering, value->args[0]);
+            int exit = emit_at(compiler, line, column, jump, 0, 0, 0);
+            emit_at(compiler, line, column, OP_POP, 0, 0, -1);
+            lower_chain(lowering, value->as.targets[0]);
+            lower_value(lowering, value->args[1]);
+            compiler->chunk->code[exit].operand = compiler->chunk->code_count;
+            break;
+        }
+        default: {
+            bool binary = value->args[1] >= 0;
+            lower_value(lowering, value->args[0]);
+            if (binary) {
+                lower_value(lowering, value->args[1]);
+            }
+            bool compare = value->op >= IR_COMPARE_INT && value->op <= IR_COMPARE_STRING;
+            emit_at(compiler, line, column, ir_opcodes[value->op], compare ? (uint8_t)value->as.compare : 0, 0,
+                    binary ? -1 : 0);
+            break;
+        }
+    }
+}
+
+// Emit the values of a chain of blocks at their own positions: definitions,
+// values kept in locals, and unused values that may fail. A branch
+// continues at its join; the right operand it skips is emitted by the phi.
+static void lower_chain(IrLowering* lowering, int block) {
+    Compiler* compiler = lowering->compiler;
+    const IrProgram* program = lowering->program;
+    
+    while (block >= 0) {
+        const IrBlock* current = &program->blocks[block];
+        int next = -1;
+        
+        for (int i = 0; i < current->count; i++) {
+            int id = current->code[i];
+            const IrValue* value = &program->values[id];
+            
+            switch (value->op) {
+                case IR_BRANCH: {
+                    int target = value->as.targets[0];
+                    next = program->blocks[target].chain == current->chain ? target : value->as.targets[1];
+                    break;
+                }
+                case IR_JUMP:
+                    break;
+                case IR_DEFINE:
+                    lower_value(lowering, value->args[0]);
+                    emit_at(compiler, value->line, value->column, OP_DEFINE, (uint8_t)value->type,
+                            name_index(compiler, value->as.name), -1);
+                    break;
+                default:
+                    if (lowering->inlined[id]) {
+                        break;
+                    }
+                    lower_tree(lowering, id);
+                    if (lowering->slot[id] >= 0) {
+                        emit_at(compiler, value->line, value->column, OP_SET_LOCAL, 0, lowering->slot[id], -1);
+                    } else {
+                        emit_at(compiler, value->line, value->column, OP_POP, 0, 0, -1);
+                    }
+                    break;
+            }
+        }
+        block = next;
+    }
+}
+
+// Decide where each value is computed. A value is inlined into its only
+// user in the same chain, or into the end of a right operand for a phi;
+// constants are inlined into every user.
+// Inlining moves the computation later, so a value that may divide by
+// zero is only inlined if no definition or other division lies between.
+static void place_values(IrLowering* lowering) {
+    const IrProgram* program = lowering->program;
+    int count = program->value_count;
+    int* user = malloc(sizeof(int) * (count + 1));
+    int* order = malloc(sizeof(int) * (count + 1));
+    int* hazards = malloc(sizeof(int) * (count + 2));  // Prefix counts by position
+    bool* may_trap = calloc(count + 1, sizeof(bool));
+    int positions = 0;
+    
+    hazards[0] = 0;
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            int id = block->code[i];
+            const IrValue* value = &program->values[id];
+            bool hazard = value->op == IR_DEFINE || ir_may_trap(program, id);
+            
+            lowering->position[id] = positions;
+            order[positions] = id;
+            hazards[positions + 1] = hazards[positions] + (hazard ? 1 : 0);
+            positions++;
+            
+            // A branch only feeds its phi
+            if (value->op == IR_BRANCH) {
+                continue;
+            }
+            for (int a = 0; a < 2; a++) {
+                if (value->args[a] >= 0) {
+                    lowering->uses[value->args[a]]++;
+                    user[value->args[a]] = id;
+                }
+            }
+        }
+    }
+    
+    for (int p = 0; p < positions; p++) {
+        int id = order[p];
+        const IrValue* value = &program->values[id];
+        if (value->op == IR_DEFINE || value->op == IR_BRANCH || value->op == IR_JUMP) {
+            continue;
+        }
+        
+        // Constants are cheaper to push again than to keep in a local
+        if (value->op == IR_CONSTANT) {
+            lowering->inlined[id] = true;
+            continue;
+        }
+        
+        // Phis run their right operand, which may fail
+        may_trap[id] = value->op == IR_PHI || ir_may_trap(program, id);
+        for (int a = 0; a < 2; a++) {
+            if (value->args[a] >= 0 && lowering->inlined[value->args[a]]) {
+                may_trap[id] = may_trap[id] || may_trap[value->args[a]];
+            }
+        }
+        
+        if (lowering->uses[id] == 1) {
+            const IrValue* use = &program->values[user[id]];
+            int use_block = use->block;
+            int use_position = lowering->position[user[id]];
+            if (use->op == IR_PHI && use->args[1] == id) {
+                // Computed after the rest of the right operand
+                use_block = use->as.targets[1];
+                const IrBlock* last = &program->blocks[use_block];
+                use_position = lowering->position[last->code[last->count - 1]];
+            }
+            
+            bool same_chain = program->blocks[value->block].chain == program->blocks[use_block].chain;
+            bool crosses_hazard = hazards[use_position] - hazards[p + 1] > 0;
+            if (same_chain && use_position > p && !(may_trap[id] && crosses_hazard)) {
+                lowering->inlined[id] = true;
+                continue;
+            }
+        }
+        
+        if (lowering->uses[id] > 0) {
+            lowering->slot[id] = lowering->compiler->chunk->local_count++;
+        }
+    }
+    
+    free(user);
+    free(order);
+    free(hazards);
+    free(may_trap);
+}
+
+// Compile a program in SSA form into a chunk
+void compile_ir(Chunk* chunk, const IrProgram* program) {
+    Compiler compiler = {chunk, 0, NULL, 0, NULL, 0, 0};
+    int count = program->value_count;
+    IrLowering lowering = {&compiler, program, NULL, NULL, NULL, NULL};
+    
+    lowering.position = calloc(count + 1, sizeof(int));
+    lowering.uses = calloc(count + 1, sizeof(int));
+    lowering.inlined = calloc(count + 1, sizeof(bool));
+    lowering.slot = malloc(sizeof(int) * (count + 1));
+    for (int i = 0; i < count; i++) {
+        lowering.slot[i] = -1;
+    }
+    
+    place_values(&lowering);
+    lower_chain(&lowering, 0);
+    
+    free(lowering.position);
+    free(lowering.uses);
+    free(lowering.inlined);
+    free(lowering.slot);
+    free(compiler.name_slots);
+    free(compiler.string_slots);
+}
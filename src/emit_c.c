@@ -0,0 +1,289 @@
+#include "../include/emit_c.h"
+#include "../include/operators.h"
+#include <math.h>
+
+// Every node is computed into its own temporary, in the order the
+// interpreter evaluates it, so a division by zero is reported at the same
+// node. The C compiler folds the temporaries away.
+typedef struct {
+    FILE* out;
+    int temp_count;
+    int depth;  // Blocks opened by short-circuit operators
+} Emitter;
+
+// Declarations per generated function; C compilers slow down sharply on
+// very long functions
+#define EMIT_C_FUNCTION_SIZE 32
+
+// No temporary: the node is null, which has no runtime representation
+#define NO_TEMP -1
+
+static const char* c_type(ValueType type) {
+    switch (type) {
+        case VALUE_INT:    return "int64_t";
+        case VALUE_FLOAT:  return "double";
+        case VALUE_BOOL:   return "bool";
+        case VALUE_STRING: return "KasdString";
+        default:           return "int";
+    }
+}
+
+static void indent(Emitter* emitter) {
+    for (int i = 0; i <= emitter->depth; i++) {
+        fputs("    ", emitter->out);
+    }
+}
+
+// Start the definition of a new temporary: "type tN = "
+static int begin_temp(Emitter* emitter, ValueType type) {
+    int temp = emitter->temp_count++;
+    indent(emitter);
+    fprintf(emitter->out, "%s t%d = ", c_type(type), temp);
+    return temp;
+}
+
+// String literal with every byte that is not plain ASCII escaped; '?' too,
+// so no trigraphs can form
+static void emit_string(FILE* out, const char* chars, size_t length) {
+    fprintf(out, "(KasdString){\"");
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\' || c == '?') {
+            fprintf(out, "\\%c", c);
+        } else if (c >= 0x20 && c < 0x7F) {
+            fputc(c, out);
+        } else {
+            fprintf(out, "\\%03o", c);
+        }
+    }
+    fprintf(out, "\", %zu}", length);
+}
+
+static void emit_literal(FILE* out, const Value* value) {
+    switch (value->type) {
+        case VALUE_INT:
+            if (value->data.as_int == INT64_MIN) {
+                fprintf(out, "INT64_MIN");
+            } else {
+                fprintf(out, "INT64_C(%lld)", (long long)value->data.as_int);
+            }
+            break;
+        case VALUE_FLOAT:
+            // Hexadecimal floats are exact; infinities and NaNs keep their bits
+            if (isfinite(value->data.as_float)) {
+                fprintf(out, "%a", value->data.as_float);
+            } else {
+                uint64_t bits;
+                memcpy(&bits, &value->data.as_float, sizeof(bits));
+                fprintf(out, "kasd_rt_float_bits(UINT64_C(0x%016llx))", (unsigned long long)bits);
+            }
+            break;
+        case VALUE_BOOL:
+            fprintf(out, value->data.as_bool ? "true" : "false");
+            break;
+        case VALUE_STRING:
+            emit_string(out, string_chars(value), string_length(value));
+            break;
+        default:
+            fprintf(out, "0");
+            break;
+    }
+}
+
+static int emit_node(Emitter* emitter, const AstNode* node);
+
+// && and ||: the right operand is only computed when it decides the result
+static int emit_short_circuit(Emitter* emitter, const AstNode* node) {
+    int left = emit_node(emitter, node->as.binary.left);
+    int temp = begin_temp(emitter, VALUE_BOOL);
+    fprintf(emitter->out, "t%d;\n", left);
+    
+    indent(emitter);
+    fprintf(emitter->out, node->as.binary.op == TOKEN_AND_AND ? "if (t%d) {\n" : "if (!t%d) {\n", temp);
+    emitter->depth++;
+    int right = emit_node(emitter, node->as.binary.right);
+    indent(emitter);
+    fprintf(emitter->out, "t%d = t%d;\n", temp, right);
+    emitter->depth--;
+    indent(emitter);
+    fprintf(emitter->out, "}\n");
+    return temp;
+}
+
+static void emit_arithmetic(Emitter* emitter, const AstNode* node, int left, int right) {
+    FILE* out = emitter->out;
+    TokenType op = node->as.binary.op;
+    
+    switch (node->value_type) {
+        case VALUE_INT:
+            switch (op) {
+                case TOKEN_PLUS:  fprintf(out, "kasd_rt_add(t%d, t%d)", left, right); break;
+                case TOKEN_MINUS: fprintf(out, "kasd_rt_subtract(t%d, t%d)", left, right); break;
+                case TOKEN_STAR:  fprintf(out, "kasd_rt_multiply(t%d, t%d)", left, right); break;
+                default:
+                    fprintf(out, "kasd_rt_%s(t%d, t%d, %d, %d)", op == TOKEN_SLASH ? "divide" : "modulo",
+                            left, right, node->line, node->column);
+                    break;
+            }
+            break;
+        case VALUE_FLOAT:
+            if (op == TOKEN_PERCENT) {
+                fprintf(out, "fmod(t%d, t%d)", left, right);
+            } else {
+                fprintf(out, "t%d %s t%d", left, operator_to_string(op), right);
+            }
+            break;
+        default:
+            fprintf(out, "kasd_rt_concat(t%d, t%d)", left, right);
+            break;
+    }
+}
+
+// Comparisons give the same results as the interpreter's
+static void emit_comparison(Emitter* emitter, const AstNode* node, int left, int right) {
+    FILE* out = emitter->out;
+    TokenType op = node->as.binary.op;
+    const char* c_op = operator_to_string(op);
+    ValueType left_type = node->as.binary.left->value_type;
+    ValueType right_type = node->as.binary.right->value_type;
+    
+    // With null, the outcome depends only on the static types
+    if (left_type == VALUE_NULL || right_type == VALUE_NULL) {
+        bool result = compare_result(op, left_type == right_type ? 0 : 1);
+        fprintf(out, "%s", result ? "true" : "false");
+        if (left != NO_TEMP) fprintf(out, "; (void)t%d", left);
+        if (right != NO_TEMP) fprintf(out, "; (void)t%d", right);
+        return;
+    }
+    
+    switch (left_type) {
+        case VALUE_INT:
+        case VALUE_FLOAT:
+            // C compares doubles the way float_compare does
+            fprintf(out, "t%d %s t%d", left, c_op, right);
+            break;
+        case VALUE_BOOL:
+            fprintf(out, "(t%d != t%d) %s 0", left, right, c_op);
+            break;
+        default:
+            fprintf(out, "kasd_rt_compare_string(t%d, t%d) %s 0", left, right, c_op);
+            break;
+    }
+}
+
+// Compute a node into a new temporary and return its number
+static int emit_node(Emitter* emitter, const AstNode* node) {
+    FILE* out = emitter->out;
+    
+    if (node->value_type == VALUE_NULL) {
+        return NO_TEMP;
+    }
+    
+    switch (node->type) {
+        case NODE_LITERAL: {
+            int temp = begin_temp(emitter, node->value_type);
+            emit_literal(out, &node->as.literal);
+            fprintf(out, ";\n");
+            return temp;
+        }
+        case NODE_VARIABLE: {
+            int temp = begin_temp(emitter, node->value_type);
+            fprintf(out, "v_%s;\n", node->as.variable.name);
+            return temp;
+        }
+        case NODE_UNARY: {
+            int operand = emit_node(emitter, node->as.unary.operand);
+            int temp = begin_temp(emitter, node->value_type);
+            fprintf(out, node->value_type == VALUE_INT ? "kasd_rt_negate(t%d);\n"
+                       : node->value_type == VALUE_FLOAT ? "-t%d;\n"
+                       : "!t%d;\n", operand);
+            return temp;
+        }
+        case NODE_CONVERT: {
+            int operand = emit_node(emitter, node->as.convert.operand);
+            int temp = begin_temp(emitter, VALUE_FLOAT);
+            fprintf(out, "(double)t%d;\n", operand);
+            return temp;
+        }
+        case NODE_BINARY: {
+            TokenType op = node->as.binary.op;
+            if (op == TOKEN_AND_AND || op == TOKEN_OR_OR) {
+                return emit_short_circuit(emitter, node);
+            }
+            
+            int left = emit_node(emitter, node->as.binary.left);
+            int right = emit_node(emitter, node->as.binary.right);
+            int temp = begin_temp(emitter, node->value_type);
+            if (op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_STAR ||
+                op == TOKEN_SLASH || op == TOKEN_PERCENT) {
+                emit_arithmetic(emitter, node, left, right);
+            } else {
+                emit_comparison(emitter, node, left, right);
+            }
+            fprintf(out, ";\n");
+            return temp;
+        }
+        default:
+            return NO_TEMP;
+    }
+}
+
+// A variable initialized with null holds nothing at runtime: reads of it
+// are typed null too, so it needs no C variable
+static bool holds_null(const AstNode* declaration) {
+    return declaration->as.var_decl.var_type == VALUE_NULL ||
+           declaration->as.var_decl.initializer->value_type == VALUE_NULL;
+}
+
+// Define a variable and print it as the REPL would
+static void emit_declaration(Emitter* emitter, const AstNode* node) {
+    FILE* out = emitter->out;
+    const char* name = node->as.var_decl.name;
+    ValueType type = node->as.var_decl.var_type;
+    
+    fprintf(out, "    // line %d: %s\n", node->line, name);
+    int value = emit_node(emitter, node->as.var_decl.initializer);
+    
+    if (holds_null(node)) {
+        fprintf(out, "    kasd_rt_print_null(\"%s\", \"%s\");\n", name, value_type_to_string(type));
+        return;
+    }
+    
+    fprintf(out, "    v_%s = t%d;\n", name, value);
+    fprintf(out, "    kasd_rt_print_%s(\"%s\", v_%s);\n", value_type_to_string(type), name, name);
+}
+
+void emit_c_program(FILE* out, const AstNode* program, const char* source_name) {
+    Emitter emitter = {out, 0, 0};
+    int count = program->as.program.count;
+    AstNode** declarations = program->as.program.declarations;
+    
+    fprintf(out, "// Translated from %s by kasd --emit-c\n", source_name);
+    fprintf(out, "#include \"kasd_runtime.h\"\n\n");
+    
+    // Variables live at file scope so every function can read them
+    for (int i = 0; i < count; i++) {
+        if (declarations[i]->type == NODE_VARIABLE_DECLARATION && !holds_null(declarations[i])) {
+            fprintf(out, "static %s v_%s;\n", c_type(declarations[i]->as.var_decl.var_type),
+                    declarations[i]->as.var_decl.name);
+        }
+    }
+    
+    int functions = (count + EMIT_C_FUNCTION_SIZE - 1) / EMIT_C_FUNCTION_SIZE;
+    for (int f = 0; f < functions; f++) {
+        fprintf(out, "\nstatic void run_%d(void) {\n", f);
+        for (int i = f * EMIT_C_FUNCTION_SIZE; i < count && i < (f + 1) * EMIT_C_FUNCTION_SIZE; i++) {
+            if (declarations[i]->type == NODE_VARIABLE_DECLARATION) {
+                emit_declaration(&emitter, declarations[i]);
+            }
+        }
+        fprintf(out, "}\n");
+    }
+    
+    fprintf(out, "\nint main(void) {\n");
+    for (int f = 0; f < functions; f++) {
+        fprintf(out, "    run_%d();\n", f);
+    }
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
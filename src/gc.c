@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include "../include/gc.h"
+#include "../include/pool.h"
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+void init_heap(Heap* heap) {
+    init_region(&heap->nursery);
+    heap->nursery_bytes = 0;
+    heap->remembered = NULL;
+    heap->remembered_count = 0;
+    heap->remembered_capacity = 0;
+    memset(&heap->stats, 0, sizeof(GcStats));
+    heap->stats.start_ns = now_ns();
+}
+
+void free_heap(Heap* heap) {
+    free_region(&heap->nursery);
+    free(heap->remembered);
+    heap->remembered = NULL;
+    heap->remembered_count = 0;
+    heap->remembered_capacity = 0;
+}
+
+// Whether a value is a string in the nursery
+static bool is_young(const Heap* heap, Value value) {
+    return value.type == VALUE_STRING && value.short_length == STRING_ON_HEAP &&
+           atomic_load_explicit(&value.data.as_string->refcount, memory_order_relaxed) == STRING_STATIC &&
+           region_contains(&heap->nursery, value.data.as_string);
+}
+
+// A young string already promoted by this collection: its characters,
+// which the old copy holds now, are overwritten with the address of the
+// copy. Strings outside a Value are longer than a pointer.
+#define STRING_FORWARDED (-2)
+
+static bool is_forwarded(const Heap* heap, Value value) {
+    return value.type == VALUE_STRING && value.short_length == STRING_ON_HEAP &&
+           atomic_load_explicit(&value.data.as_string->refcount, memory_order_relaxed) == STRING_FORWARDED &&
+           region_contains(&heap->nursery, value.data.as_string);
+}
+
+Value heap_concat(Heap* heap, Value left, Value right) {
+    Value result = concat_string_values(left, right, &heap->nursery);
+    
+    if (result.short_length == STRING_ON_HEAP) {
+        size_t size = string_size(result.data.as_string->length);
+        heap->nursery_bytes += size;
+        heap->stats.bytes_allocated += size;
+    }
+    return result;
+}
+
+void gc_write_barrier(Heap* heap, Value* slot) {
+    if (!is_young(heap, *slot)) {
+        return;
+    }
+    
+    if (heap->remembered_count == heap->remembered_capacity) {
+        int capacity = heap->remembered_capacity < 16 ? 16 : heap->remembered_capacity * 2;
+        heap->remembered = realloc(heap->remembered, sizeof(Value*) * capacity);
+        heap->remembered_capacity = capacity;
+    }
+    heap->remembered[heap->remembered_count++] = slot;
+}
+
+void gc_forget(Heap* heap, const Value* slots, int count) {
+    uintptr_t start = (uintptr_t)slots;
+    uintptr_t end = (uintptr_t)(slots + count);
+    int kept = 0;
+    
+    for (int i = 0; i < heap->remembered_count; i++) {
+        uintptr_t slot = (uintptr_t)heap->remembered[i];
+        if (slot < start || slot >= end) {
+            heap->remembered[kept++] = heap->remembered[i];
+        }
+    }
+    heap->remembered_count = kept;
+}
+
+void gc_safepoint(Heap* heap) {
+    if (heap->nursery_bytes >= GC_NURSERY_SIZE) {
+        gc_collect(heap);
+    }
+}
+
+// Copy the young strings that remembered slots still hold into the old
+// generation. Each string is copied once: later slots holding it, or a slot
+// stored twice, share the first copy.
+void gc_collect(Heap* heap) {
+    uint64_t start = now_ns();
+    
+    for (int i = 0; i < heap->remembered_count; i++) {
+        Value* slot = heap->remembered[i];
+        if (is_forwarded(heap, *slot)) {
+            String* old;
+            memcpy(&old, slot->data.as_string->chars, sizeof(old));
+            slot->data.as_string = retain_string(old);
+            continue;
+        }
+        if (!is_young(heap, *slot)) {
+            continue;
+        }
+        
+        String* young = slot->data.as_string;
+        size_t size = string_size(young->length);
+        String* old = pool_alloc(POOL_STRING, size);
+        memcpy(old, young, size);
+        atomic_init(&old->refcount, 1);
+        slot->data.as_string = old;
+        heap->stats.bytes_promoted += size;
+        
+        // The nursery is reset below, so the young string can be overwritten
+        atomic_store_explicit(&young->refcount, STRING_FORWARDED, memory_order_relaxed);
+        memcpy(young->chars, &old, sizeof(old));
+    }
+    
+    gc_reset(heap);
+    
+    uint64_t pause = now_ns() - start;
+    heap->stats.collections++;
+    heap->stats.total_pause_ns += pause;
+    if (pause > heap->stats.max_pause_ns) {
+        heap->stats.max_pause_ns = pause;
+    }
+}
+
+void gc_reset(Heap* heap) {
+    heap->remembered_count = 0;
+    heap->nursery_bytes = 0;
+    reset_region(&heap->nursery);
+}
+
+void print_gc_stats(const Heap* heap) {
+    const GcStats* stats = &heap->stats;
+    double seconds = (double)(now_ns() - stats->start_ns) / 1e9;
+    
+    fprintf(stderr, "GC statistics:\n");
+    fprintf(stderr, "  Minor collections:     %llu\n", (unsigned long long)stats->collections);
+    fprintf(stderr, "  Total pause:           %.3f ms\n", (double)stats->total_pause_ns / 1e6);
+    fprintf(stderr, "  Longest pause:         %.3f ms\n", (double)stats->max_pause_ns / 1e6);
+    fprintf(stderr, "  Bytes allocated:       %llu\n", (unsigned long long)stats->bytes_allocated);
+    fprintf(stderr, "  Allocation rate:       %.1f MB/s\n",
+            seconds > 0 ? (double)stats->bytes_allocated / seconds / 1e6 : 0.0);
+    fprintf(stderr, "  Survival rate:         %.1f%%\n",
+            stats->bytes_allocated > 0 ? 100.0 * (double)stats->bytes_promoted / (double)stats->bytes_allocated : 0.0);
+}
@@ -0,0 +1,139 @@
+#include "../include/intern.h"
+#include <pthread.h>
+
+// Slot of a removed string; probing continues past it
+#define TOMBSTONE ((String*)1)
+
+// Open-addressed set of interned strings, keyed by their characters.
+// Entries are weak: a string whose count has dropped to zero is dying and
+// is skipped until its releaser removes it.
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static String** intern_slots = NULL;
+static size_t intern_capacity = 0;  // Power of two
+static size_t intern_count = 0;     // Live and dying strings
+static size_t intern_used = 0;      // Strings and tombstones
+
+// Take a reference unless the string is already dying
+static bool try_retain(String* string) {
+    int count = atomic_load_explicit(&string->refcount, memory_order_relaxed);
+    while (count > 0) {
+        if (atomic_compare_exchange_weak_explicit(&string->refcount, &count, count + 1,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rebuild the table without tombstones, growing it if it is half full.
+// Called with the lock held.
+static void intern_rehash(void) {
+    size_t old_capacity = intern_capacity;
+    String** old_slots = intern_slots;
+    
+    intern_capacity = intern_capacity < 64 ? 64 : intern_capacity;
+    while (intern_count * 2 >= intern_capacity) {
+        intern_capacity *= 2;
+    }
+    intern_slots = calloc(intern_capacity, sizeof(String*));
+    
+    for (size_t i = 0; i < old_capacity; i++) {
+        String* string = old_slots[i];
+        if (string != NULL && string != TOMBSTONE) {
+            size_t slot = string->hash & (intern_capacity - 1);
+            while (intern_slots[slot] != NULL) {
+                slot = (slot + 1) & (intern_capacity - 1);
+            }
+            intern_slots[slot] = string;
+        }
+    }
+    
+    intern_used = intern_count;
+    free(old_slots);
+}
+
+// Find a live string with these characters, or add one
+String* create_interned_string(const char* chars, size_t length) {
+    uint32_t hash = hash_chars(chars, length);
+    
+    pthread_mutex_lock(&intern_lock);
+    
+    if ((intern_used + 1) * 4 >= intern_capacity * 3) {
+        intern_rehash();
+    }
+    
+    size_t mask = intern_capacity - 1;
+    size_t slot = hash & mask;
+    size_t free_slot = SIZE_MAX;
+    
+    for (String* string; (string = intern_slots[slot]) != NULL; slot = (slot + 1) & mask) {
+        if (string == TOMBSTONE) {
+            if (free_slot == SIZE_MAX) {
+                free_slot = slot;
+            }
+        } else if (string->hash == hash && string->length == length &&
+                   memcmp(string->chars, chars, length) == 0 && try_retain(string)) {
+            pthread_mutex_unlock(&intern_lock);
+            return string;
+        }
+    }
+    
+    if (free_slot == SIZE_MAX) {
+        free_slot = slot;
+        intern_used++;
+    }
+    
+    String* string = create_string(chars, length);
+    string->is_interned = true;
+    intern_slots[free_slot] = string;
+    intern_count++;
+    
+    pthread_mutex_unlock(&intern_lock);
+    return string;
+}
+
+Value create_interned_string_value(const char* chars, size_t length) {
+    if (length <= SHORT_STRING_MAX) {
+        return create_string_value_length(chars, length);
+    }
+    
+    Value value;
+    value.type = VALUE_STRING;
+    value.short_length = STRING_ON_HEAP;
+    value.data.as_string = create_interned_string(chars, length);
+    return value;
+}
+
+Value intern_value(Value value) {
+    if (value.type != VALUE_STRING || value.short_length != STRING_ON_HEAP ||
+        value.data.as_string->is_interned) {
+        return value;
+    }
+    
+    String* string = value.data.as_string;
+    value.data.as_string = create_interned_string(string->chars, string->length);
+    release_string(string);
+    return value;
+}
+
+// Replace a dead string's slot with a tombstone
+void unintern_string(String* string) {
+    pthread_mutex_lock(&intern_lock);
+    
+    size_t mask = intern_capacity - 1;
+    size_t slot = string->hash & mask;
+    while (intern_slots[slot] != string) {
+        slot = (slot + 1) & mask;
+    }
+    intern_slots[slot] = TOMBSTONE;
+    intern_count--;
+    
+    pthread_mutex_unlock(&intern_lock);
+}
+
+size_t interned_string_count(void) {
+    pthread_mutex_lock(&intern_lock);
+    size_t count = intern_count;
+    pthread_mutex_unlock(&intern_lock);
+    return count;
+}
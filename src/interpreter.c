@@ -1,24 +1,43 @@
 #include "../include/interpreter.h"
+#include "../include/operators.h"
+#include "../include/pool.h"
+#include "../include/region.h"
 
 // Forward declarations
 static Value evaluate_node(Interpreter* interpreter, AstNode* node);
+static Value evaluate_generic(Interpreter* interpreter, AstNode* node);
+static Value evaluate_program(Interpreter* interpreter, AstNode* node);
 static Value evaluate_variable_declaration(Interpreter* interpreter, AstNode* node);
 static Value evaluate_literal(Interpreter* interpreter, AstNode* node);
+static Value evaluate_variable(Interpreter* interpreter, AstNode* node);
+static Value evaluate_unary(Interpreter* interpreter, AstNode* node);
+static Value evaluate_binary(Interpreter* interpreter, AstNode* node);
+static Value evaluate_convert(Interpreter* interpreter, AstNode* node);
+static Value evaluate_variable_slot(Interpreter* interpreter, AstNode* node);
+static Value evaluate_quick_binary(Interpreter* interpreter, AstNode* node);
 
-// Environment operations
-static void env_define(Environment* env, const char* name, Value value);
-static void env_free(Environment* env);
+// Source of environment generations
+static atomic_uint_fast64_t next_generation = 1;
+
+static uint64_t new_generation(void) {
+    return atomic_fetch_add_explicit(&next_generation, 1, memory_order_relaxed);
+}
 
 // Initialize interpreter
-void init_interpreter(Interpreter* interpreter, bool repl_mode) {
+void init_interpreter(Interpreter* interpreter, KasdState* state, bool repl_mode) {
+    interpreter->state = state;
     interpreter->env.head = NULL;
+    interpreter->env.base = NULL;
+    interpreter->env.region = NULL;
+    init_heap(&interpreter->env.heap);
+    interpreter->env.generation = new_generation();
     interpreter->had_error = false;
     interpreter->repl_mode = repl_mode;
 }
 
 // Execute AST
 Value interpret(Interpreter* interpreter, AstNode* node) {
-    log_message(LOG_DEBUG, "Starting interpretation");
+    log_message(interpreter->state, LOG_DEBUG, "Starting interpretation");
     
     if (node == NULL) {
         return create_null_value();
@@ -27,29 +46,70 @@ Value interpret(Interpreter* interpreter, AstNode* node) {
     return evaluate_node(interpreter, node);
 }
 
-// Evaluate a node based on its type
+// Evaluate a node through its specialized form, if it has one
 static Value evaluate_node(Interpreter* interpreter, AstNode* node) {
+    switch (node->quick) {
+        case QUICK_NONE:
+            return evaluate_generic(interpreter, node);
+        case QUICK_CONSTANT:
+            return node->as.literal;
+        case QUICK_VARIABLE_SLOT:
+            return evaluate_variable_slot(interpreter, node);
+        default:
+            return evaluate_quick_binary(interpreter, node);
+    }
+}
+
+// Evaluate a node based on its type
+static Value evaluate_generic(Interpreter* interpreter, AstNode* node) {
     switch (node->type) {
+        case NODE_PROGRAM:
+            return evaluate_program(interpreter, node);
         case NODE_VARIABLE_DECLARATION:
             return evaluate_variable_declaration(interpreter, node);
         case NODE_LITERAL:
             return evaluate_literal(interpreter, node);
+        case NODE_VARIABLE:
+            return evaluate_variable(interpreter, node);
+        case NODE_UNARY:
+            return evaluate_unary(interpreter, node);
+        case NODE_BINARY:
+            return evaluate_binary(interpreter, node);
+        case NODE_CONVERT:
+            return evaluate_convert(interpreter, node);
         default:
-            log_message(LOG_ERROR, "Unknown node type in interpreter");
+            log_message(interpreter->state, LOG_ERROR, "Unknown node type in interpreter");
             interpreter->had_error = true;
             return create_null_value();
     }
 }
 
+// Evaluate each declaration of a program in order
+static Value evaluate_program(Interpreter* interpreter, AstNode* node) {
+    for (int i = 0; i < node->as.program.count && !interpreter->had_error; i++) {
+        free_value(evaluate_node(interpreter, node->as.program.declarations[i]));
+        
+        // Between declarations only variables hold values
+        gc_safepoint(&interpreter->env.heap);
+    }
+    
+    return create_null_value();
+}
+
 // Evaluate a variable declaration
 static Value evaluate_variable_declaration(Interpreter* interpreter, AstNode* node) {
-    log_message(LOG_DEBUG, "Evaluating variable declaration: %s", node->as.var_decl.name);
+    log_message(interpreter->state, LOG_DEBUG, "Evaluating variable declaration: %s", node->as.var_decl.name);
     
     // Evaluate initializer
     Value value = evaluate_node(interpreter, node->as.var_decl.initializer);
+    if (interpreter->had_error) {
+        free_value(value);
+        return create_null_value();
+    }
     
     // Define variable in environment
     env_define(&interpreter->env, node->as.var_decl.name, value);
+    log_message(interpreter->state, LOG_DEBUG, "Defined variable: %s", node->as.var_decl.name);
     
     // In REPL mode, print the variable
     if (interpreter->repl_mode) {
@@ -65,72 +125,392 @@ static Value evaluate_variable_declaration(Interpreter* interpreter, AstNode* no
 }
 
 // Evaluate a literal
-static Value evaluate_literal(Interpreter* interpreter __attribute__((unused)), AstNode* node) {
-    log_message(LOG_DEBUG, "Evaluating literal");
-    return node->as.literal;
+static Value evaluate_literal(Interpreter* interpreter, AstNode* node) {
+    log_message(interpreter->state, LOG_DEBUG, "Evaluating literal");
+    
+    // Only strings on the heap need a reference of their own
+    const Value* literal = &node->as.literal;
+    if (literal->type != VALUE_STRING || literal->short_length != STRING_ON_HEAP) {
+        node->quick = QUICK_CONSTANT;
+    }
+    return copy_value(node->as.literal);
+}
+
+// Evaluate a variable reference, caching the slot of a runtime variable
+static Value evaluate_variable(Interpreter* interpreter, AstNode* node) {
+    Value* slot = env_slot(&interpreter->env, node->as.variable.name);
+    if (slot != NULL) {
+        node->as.variable.slot = slot;
+        node->as.variable.generation = interpreter->env.generation;
+        node->quick = QUICK_VARIABLE_SLOT;
+        return copy_value(*slot);
+    }
+    
+    Value value;
+    if (!snapshot_lookup(interpreter->env.base, node->as.variable.name, &value)) {
+        set_error(interpreter->state, ERROR_NAME, node->line, node->column, "Undefined variable", NULL, 0, 0);
+        interpreter->had_error = true;
+        return create_null_value();
+    }
+    
+    return copy_value(value);
+}
+
+// Read a variable through its cached slot while the entry still exists
+static Value evaluate_variable_slot(Interpreter* interpreter, AstNode* node) {
+    if (node->as.variable.generation != interpreter->env.generation) {
+        node->quick = QUICK_NONE;
+        return evaluate_variable(interpreter, node);
+    }
+    
+    return copy_value(*node->as.variable.slot);
+}
+
+// Evaluate a unary operation on an operand of known static type
+static Value evaluate_unary(Interpreter* interpreter, AstNode* node) {
+    Value operand = evaluate_node(interpreter, node->as.unary.operand);
+    
+    switch (node->value_type) {
+        case VALUE_INT:
+            return create_int_value(int_arithmetic(TOKEN_MINUS, 0, operand.data.as_int));
+        case VALUE_FLOAT:
+            return create_float_value(-operand.data.as_float);
+        default:
+            return create_bool_value(!operand.data.as_bool);
+    }
+}
+
+// Evaluate an arithmetic operator; operands share the static type
+static Value evaluate_arithmetic(Interpreter* interpreter, AstNode* node, Value left, Value right) {
+    TokenType op = node->as.binary.op;
+    
+    switch (node->value_type) {
+        case VALUE_INT:
+            if ((op == TOKEN_SLASH || op == TOKEN_PERCENT) && right.data.as_int == 0) {
+                set_error(interpreter->state, ERROR_RUNTIME, node->line, node->column, "Division by zero", NULL, 0, 0);
+                interpreter->had_error = true;
+                return create_null_value();
+            }
+            return create_int_value(int_arithmetic(op, left.data.as_int, right.data.as_int));
+        case VALUE_FLOAT:
+            return create_float_value(float_arithmetic(op, left.data.as_float, right.data.as_float));
+        default:
+            // String concatenation
+            return env_concat(&interpreter->env, left, right);
+    }
+}
+
+// Evaluate a comparison; operands share the static type unless one is null
+static Value evaluate_comparison(AstNode* node, Value left, Value right) {
+    ValueType left_type = node->as.binary.left->value_type;
+    ValueType right_type = node->as.binary.right->value_type;
+    int cmp;
+    
+    if (left_type == VALUE_NULL || right_type == VALUE_NULL) {
+        cmp = (left_type == right_type) ? 0 : 1;
+    } else {
+        switch (left_type) {
+            case VALUE_INT:
+                cmp = (left.data.as_int > right.data.as_int) - (left.data.as_int < right.data.as_int);
+                break;
+            case VALUE_FLOAT:
+                return create_bool_value(float_compare(node->as.binary.op, left.data.as_float,
+                                                       right.data.as_float));
+            case VALUE_BOOL:
+                cmp = left.data.as_bool != right.data.as_bool;
+                break;
+            default:
+                // Equality needs no ordering, and usually not even the bytes
+                if (node->as.binary.op == TOKEN_EQUAL_EQUAL || node->as.binary.op == TOKEN_BANG_EQUAL) {
+                    cmp = !string_values_equal(left, right);
+                } else {
+                    cmp = compare_string_values(left, right);
+                }
+                break;
+        }
+    }
+    
+    return create_bool_value(compare_result(node->as.binary.op, cmp));
+}
+
+// Apply an arithmetic operator or comparison to evaluated operands,
+// consuming them
+static Value apply_binary(Interpreter* interpreter, AstNode* node, Value left, Value right) {
+    TokenType op = node->as.binary.op;
+    Value result;
+    
+    if (op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_STAR ||
+        op == TOKEN_SLASH || op == TOKEN_PERCENT) {
+        result = evaluate_arithmetic(interpreter, node, left, right);
+    } else {
+        result = evaluate_comparison(node, left, right);
+    }
+    
+    free_value(left);
+    free_value(right);
+    return result;
+}
+
+// Specialize a binary node for the operand types it has just seen.
+// Integer division keeps its zero check in the generic form.
+static void quicken_binary(AstNode* node, Value left, Value right) {
+    if (left.type != right.type) {
+        return;
+    }
+    
+    TokenType op = node->as.binary.op;
+    if (left.type == VALUE_INT) {
+        switch (op) {
+            case TOKEN_PLUS:    node->quick = QUICK_ADD_INT; break;
+            case TOKEN_MINUS:   node->quick = QUICK_SUBTRACT_INT; break;
+            case TOKEN_STAR:    node->quick = QUICK_MULTIPLY_INT; break;
+            case TOKEN_SLASH:
+            case TOKEN_PERCENT: break;
+            default:            node->quick = QUICK_COMPARE_INT; break;
+        }
+    } else if (left.type == VALUE_FLOAT) {
+        switch (op) {
+            case TOKEN_PLUS:  node->quick = QUICK_ADD_FLOAT; break;
+            case TOKEN_MINUS: node->quick = QUICK_SUBTRACT_FLOAT; break;
+            case TOKEN_STAR:  node->quick = QUICK_MULTIPLY_FLOAT; break;
+            case TOKEN_SLASH: node->quick = QUICK_DIVIDE_FLOAT; break;
+            default:          break;
+        }
+    }
+}
+
+// Evaluate a binary operation; && and || short-circuit
+static Value evaluate_binary(Interpreter* interpreter, AstNode* node) {
+    TokenType op = node->as.binary.op;
+    Value left = evaluate_node(interpreter, node->as.binary.left);
+    
+    if (interpreter->had_error) {
+        free_value(left);
+        return create_null_value();
+    }
+    
+    if (op == TOKEN_AND_AND || op == TOKEN_OR_OR) {
+        if (left.data.as_bool == (op == TOKEN_OR_OR)) {
+            return left;
+        }
+        return evaluate_node(interpreter, node->as.binary.right);
+    }
+    
+    Value right = evaluate_node(interpreter, node->as.binary.right);
+    if (interpreter->had_error) {
+        free_value(left);
+        free_value(right);
+        return create_null_value();
+    }
+    
+    quicken_binary(node, left, right);
+    return apply_binary(interpreter, node, left, right);
+}
+
+// Evaluate a binary operator specialized for the operand types it saw
+static Value evaluate_quick_binary(Interpreter* interpreter, AstNode* node) {
+    Value left = evaluate_node(interpreter, node->as.binary.left);
+    if (interpreter->had_error) {
+        free_value(left);
+        return create_null_value();
+    }
+    
+    Value right = evaluate_node(interpreter, node->as.binary.right);
+    if (interpreter->had_error) {
+        free_value(left);
+        free_value(right);
+        return create_null_value();
+    }
+    
+    // Fall back to the generic form if the operands changed type
+    ValueType expected = node->quick >= QUICK_ADD_FLOAT ? VALUE_FLOAT : VALUE_INT;
+    if (left.type != expected || right.type != expected) {
+        node->quick = QUICK_NONE;
+        return apply_binary(interpreter, node, left, right);
+    }
+    
+    uint64_t a = (uint64_t)left.data.as_int;
+    uint64_t b = (uint64_t)right.data.as_int;
+    switch (node->quick) {
+        case QUICK_ADD_INT:
+            return create_int_value((int64_t)(a + b));
+        case QUICK_SUBTRACT_INT:
+            return create_int_value((int64_t)(a - b));
+        case QUICK_MULTIPLY_INT:
+            return create_int_value((int64_t)(a * b));
+        case QUICK_COMPARE_INT:
+            return create_bool_value(compare_result(node->as.binary.op,
+                (left.data.as_int > right.data.as_int) - (left.data.as_int < right.data.as_int)));
+        case QUICK_ADD_FLOAT:
+            return create_float_value(left.data.as_float + right.data.as_float);
+        case QUICK_SUBTRACT_FLOAT:
+            return create_float_value(left.data.as_float - right.data.as_float);
+        case QUICK_MULTIPLY_FLOAT:
+            return create_float_value(left.data.as_float * right.data.as_float);
+        default:
+            return create_float_value(left.data.as_float / right.data.as_float);
+    }
+}
+
+// Evaluate a conversion inserted by the analyzer (int -> float)
+static Value evaluate_convert(Interpreter* interpreter, AstNode* node) {
+    Value operand = evaluate_node(interpreter, node->as.convert.operand);
+    return create_float_value((double)operand.data.as_int);
 }
 
 // Define a variable in the environment
-static void env_define(Environment* env, const char* name, Value value) {
-    // Check if variable already exists
+// Copy a value into a region unless it is already independent of the
+// heap: inline and static strings are kept as they are
+static Value region_value(Region* region, Value value) {
+    if (value.type != VALUE_STRING || value.short_length != STRING_ON_HEAP ||
+        atomic_load_explicit(&value.data.as_string->refcount, memory_order_relaxed) == STRING_STATIC) {
+        return value;
+    }
+    
+    // Copy the hash too, so it is not computed again, but not the
+    // reference count: other threads may be changing it
+    const String* string = value.data.as_string;
+    String* copy = region_alloc(region, string_size(string->length));
+    atomic_init(&copy->refcount, STRING_STATIC);
+    copy->length = string->length;
+    copy->hash = string->hash;
+    copy->is_ascii = string->is_ascii;
+    copy->is_interned = false;
+    memcpy(copy->chars, string->chars, string->length + 1);
+    value.data.as_string = copy;
+    return value;
+}
+
+// Define a variable in a region; nothing is freed until the region is reset
+static void region_define(Environment* env, const char* name, Value value) {
     for (EnvEntry* entry = env->head; entry != NULL; entry = entry->next) {
         if (strcmp(entry->name, name) == 0) {
-            // Free old value if it's a string
-            if (entry->value.type == VALUE_STRING && entry->value.data.as_string != NULL) {
-                free(entry->value.data.as_string);
-            }
-            
-            // Copy new value
-            entry->value = value;
-            
-            // If it's a string, duplicate it
-            if (value.type == VALUE_STRING && value.data.as_string != NULL) {
-                entry->value.data.as_string = strdup(value.data.as_string);
-            }
-            
+            entry->value = region_value(env->region, value);
             return;
         }
     }
     
-    // Create new entry
-    EnvEntry* entry = malloc(sizeof(EnvEntry));
-    entry->name = strdup(name);
-    entry->value = value;
+    size_t name_size = strlen(name) + 1;
+    EnvEntry* entry = region_alloc(env->region, sizeof(EnvEntry));
+    entry->name = region_alloc(env->region, name_size);
+    memcpy(entry->name, name, name_size);
+    entry->value = region_value(env->region, value);
+    entry->next = env->head;
+    env->head = entry;
+}
+
+void env_define(Environment* env, const char* name, Value value) {
+    if (env->region != NULL) {
+        region_define(env, name, value);
+        return;
+    }
     
-    // If it's a string, duplicate it
-    if (value.type == VALUE_STRING && value.data.as_string != NULL) {
-        entry->value.data.as_string = strdup(value.data.as_string);
+    // Check if variable already exists
+    for (EnvEntry* entry = env->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            // Take the new value before dropping the old one, which may be the same string
+            Value old = entry->value;
+            entry->value = copy_value(value);
+            free_value(old);
+            gc_write_barrier(&env->heap, &entry->value);
+            return;
+        }
     }
     
+    // Create new entry
+    EnvEntry* entry = pool_alloc(POOL_ENV_ENTRY, sizeof(EnvEntry));
+    entry->name = pool_strdup(POOL_NAME, name);
+    entry->value = copy_value(value);
+    gc_write_barrier(&env->heap, &entry->value);
+    
     // Add to environment
     entry->next = env->head;
     env->head = entry;
-    
-    log_message(LOG_DEBUG, "Defined variable: %s", name);
 }
 
-// Free the environment
-static void env_free(Environment* env) {
+// Look up a variable in the environment, then in its snapshot
+bool env_get(Environment* env, const char* name, Value* value) {
+    Value* slot = env_slot(env, name);
+    if (slot != NULL) {
+        *value = *slot;
+        return true;
+    }
+    return snapshot_lookup(env->base, name, value);
+}
+
+// Find the slot of a variable defined at runtime
+Value* env_slot(Environment* env, const char* name) {
+    for (EnvEntry* entry = env->head; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return &entry->value;
+        }
+    }
+    return NULL;
+}
+
+// Concatenate strings in the environment's region or heap
+Value env_concat(Environment* env, Value left, Value right) {
+    if (env->region != NULL) {
+        return concat_string_values(left, right, env->region);
+    }
+    return heap_concat(&env->heap, left, right);
+}
+
+// Remove every variable
+void env_clear(Environment* env) {
+    env->generation = new_generation();
+    
+    if (env->region != NULL) {
+        env->head = NULL;
+        reset_region(env->region);
+        return;
+    }
+    
     EnvEntry* current = env->head;
     while (current != NULL) {
         EnvEntry* next = current->next;
         
-        free(current->name);
+        pool_free_string(POOL_NAME, current->name);
         
-        // Free string values
-        if (current->value.type == VALUE_STRING && current->value.data.as_string != NULL) {
-            free(current->value.data.as_string);
-        }
+        free_value(current->value);
         
-        free(current);
+        pool_free(POOL_ENV_ENTRY, current, sizeof(EnvEntry));
         current = next;
     }
     env->head = NULL;
+    gc_reset(&env->heap);
+}
+
+// Remove the variables defined after mark
+void env_rollback(Environment* env, EnvEntry* mark) {
+    if (env->head == mark) {
+        return;
+    }
+    env->generation = new_generation();
+    
+    while (env->head != mark) {
+        EnvEntry* entry = env->head;
+        env->head = entry->next;
+        if (env->region != NULL) {
+            continue;
+        }
+        
+        gc_forget(&env->heap, &entry->value, 1);
+        pool_free_string(POOL_NAME, entry->name);
+        free_value(entry->value);
+        pool_free(POOL_ENV_ENTRY, entry, sizeof(EnvEntry));
+    }
+}
+
+// Look up a variable's current value
+bool lookup_variable(Interpreter* interpreter, const char* name, Value* value) {
+    return env_get(&interpreter->env, name, value);
 }
 
 // Clean up interpreter
 void free_interpreter(Interpreter* interpreter) {
-    env_free(&interpreter->env);
+    env_clear(&interpreter->env);
+    free_heap(&interpreter->env.heap);
 }
 
 // Print a value
@@ -0,0 +1,325 @@
+#include "../include/ir.h"
+#include "../include/operators.h"
+
+// Lowering state
+typedef struct {
+    IrProgram* program;
+    int block;  // Block new values go to
+} IrBuilder;
+
+static int new_block(IrProgram* program, int idom, int chain) {
+    if (program->block_count == program->block_capacity) {
+        program->block_capacity = program->block_capacity < 8 ? 8 : program->block_capacity * 2;
+        program->blocks = realloc(program->blocks, sizeof(IrBlock) * program->block_capacity);
+    }
+    
+    IrBlock* block = &program->blocks[program->block_count];
+    block->code = NULL;
+    block->count = 0;
+    block->capacity = 0;
+    block->idom = idom;
+    block->chain = chain;
+    return program->block_count++;
+}
+
+// Append a value to the current block
+static int emit(IrBuilder* builder, IrOp op, ValueType type, int left, int right, const AstNode* node) {
+    IrProgram* program = builder->program;
+    
+    if (program->value_count == program->value_capacity) {
+        program->value_capacity = program->value_capacity < 64 ? 64 : program->value_capacity * 2;
+        program->values = realloc(program->values, sizeof(IrValue) * program->value_capacity);
+    }
+    
+    IrValue* value = &program->values[program->value_count];
+    memset(value, 0, sizeof(IrValue));
+    value->op = op;
+    value->type = type;
+    value->block = builder->block;
+    value->args[0] = left;
+    value->args[1] = right;
+    value->line = node->line;
+    value->column = node->column;
+    
+    IrBlock* block = &program->blocks[builder->block];
+    if (block->count == block->capacity) {
+        block->capacity = block->capacity < 8 ? 8 : block->capacity * 2;
+        block->code = realloc(block->code, sizeof(int) * block->capacity);
+    }
+    block->code[block->count++] = program->value_count;
+    return program->value_count++;
+}
+
+static IrOp arithmetic_op(TokenType op, ValueType type) {
+    IrOp base = type == VALUE_INT ? IR_ADD_INT : IR_ADD_FLOAT;
+    
+    switch (op) {
+        case TOKEN_MINUS:   return (IrOp)(base + 1);
+        case TOKEN_STAR:    return (IrOp)(base + 2);
+        case TOKEN_SLASH:   return (IrOp)(base + 3);
+        case TOKEN_PERCENT: return (IrOp)(base + 4);
+        default:            return base;
+    }
+}
+
+static IrOp comparison_op(ValueType type) {
+    switch (type) {
+        case VALUE_INT:   return IR_COMPARE_INT;
+        case VALUE_FLOAT: return IR_COMPARE_FLOAT;
+        case VALUE_BOOL:  return IR_COMPARE_BOOL;
+        default:          return IR_COMPARE_STRING;
+    }
+}
+
+static int build_node(IrBuilder* builder, const AstNode* node);
+
+// && and ||: branch around the right operand and join the two results
+static int build_logical(IrBuilder* builder, const AstNode* node) {
+    IrProgram* program = builder->program;
+    int left = build_node(builder, node->as.binary.left);
+    int branch_block = builder->block;
+    int branch = emit(builder, IR_BRANCH, VALUE_NULL, left, -1, node);
+    
+    int right_block = new_block(program, branch_block, program->chain_count++);
+    builder->block = right_block;
+    int right = build_node(builder, node->as.binary.right);
+    int last_block = builder->block;
+    int jump = emit(builder, IR_JUMP, VALUE_NULL, -1, -1, node);
+    
+    int join = new_block(program, branch_block, program->blocks[branch_block].chain);
+    bool is_and = node->as.binary.op == TOKEN_AND_AND;
+    program->values[branch].as.targets[0] = is_and ? right_block : join;
+    program->values[branch].as.targets[1] = is_and ? join : right_block;
+    program->values[jump].as.targets[0] = join;
+    
+    builder->block = join;
+    int phi = emit(builder, IR_PHI, VALUE_BOOL, left, right, node);
+    program->values[phi].as.targets[0] = right_block;
+    program->values[phi].as.targets[1] = last_block;
+    return phi;
+}
+
+static int build_binary(IrBuilder* builder, const AstNode* node) {
+    TokenType op = node->as.binary.op;
+    
+    if (op == TOKEN_AND_AND || op == TOKEN_OR_OR) {
+        return build_logical(builder, node);
+    }
+    
+    int left = build_node(builder, node->as.binary.left);
+    int right = build_node(builder, node->as.binary.right);
+    
+    if (op == TOKEN_PLUS || op == TOKEN_MINUS || op == TOKEN_STAR ||
+        op == TOKEN_SLASH || op == TOKEN_PERCENT) {
+        IrOp ir_op = node->value_type == VALUE_STRING ? IR_CONCAT : arithmetic_op(op, node->value_type);
+        return emit(builder, ir_op, node->value_type, left, right, node);
+    }
+    
+    // With null the outcome is known statically; the operands are still
+    // evaluated, and stay behind if they can fail
+    ValueType left_type = node->as.binary.left->value_type;
+    ValueType right_type = node->as.binary.right->value_type;
+    if (left_type == VALUE_NULL || right_type == VALUE_NULL) {
+        int result = emit(builder, IR_CONSTANT, VALUE_BOOL, -1, -1, node);
+        builder->program->values[result].as.constant =
+            create_bool_value(compare_result(op, left_type == right_type ? 0 : 1));
+        return result;
+    }
+    
+    int result = emit(builder, comparison_op(left_type), VALUE_BOOL, left, right, node);
+    builder->program->values[result].as.compare = op;
+    return result;
+}
+
+static int build_node(IrBuilder* builder, const AstNode* node) {
+    int result;
+    
+    switch (node->type) {
+        case NODE_VARIABLE_DECLARATION: {
+            int value = build_node(builder, node->as.var_decl.initializer);
+            result = emit(builder, IR_DEFINE, node->as.var_decl.var_type, value, -1, node);
+            builder->program->values[result].as.name = node->as.var_decl.name;
+            return result;
+        }
+        case NODE_LITERAL:
+            result = emit(builder, IR_CONSTANT, node->as.literal.type, -1, -1, node);
+            builder->program->values[result].as.constant = node->as.literal;
+            return result;
+        case NODE_VARIABLE:
+            result = emit(builder, IR_LOAD, node->value_type, -1, -1, node);
+            builder->program->values[result].as.name = node->as.variable.name;
+            return result;
+        case NODE_UNARY: {
+            int operand = build_node(builder, node->as.unary.operand);
+            IrOp op = node->value_type == VALUE_INT ? IR_NEGATE_INT
+                    : node->value_type == VALUE_FLOAT ? IR_NEGATE_FLOAT : IR_NOT;
+            return emit(builder, op, node->value_type, operand, -1, node);
+        }
+        case NODE_CONVERT: {
+            int operand = build_node(builder, node->as.convert.operand);
+            return emit(builder, IR_INT_TO_FLOAT, VALUE_FLOAT, operand, -1, node);
+        }
+        case NODE_BINARY:
+            return build_binary(builder, node);
+        default:
+            return -1;
+    }
+}
+
+IrProgram* build_ir(const AstNode* program) {
+    IrProgram* ir = calloc(1, sizeof(IrProgram));
+    IrBuilder builder = {ir, 0};
+    
+    new_block(ir, -1, ir->chain_count++);
+    if (program != NULL) {
+        for (int i = 0; i < program->as.program.count; i++) {
+            build_node(&builder, program->as.program.declarations[i]);
+        }
+    }
+    return ir;
+}
+
+bool ir_may_trap(const IrProgram* program, int value) {
+    const IrValue* instruction = &program->values[value];
+    if (instruction->op != IR_DIVIDE_INT && instruction->op != IR_MODULO_INT) {
+        return false;
+    }
+    
+    const IrValue* divisor = &program->values[instruction->args[1]];
+    return divisor->op != IR_CONSTANT || divisor->as.constant.data.as_int == 0;
+}
+
+bool ir_dominates(const IrProgram* program, int a, int b) {
+    while (b >= 0) {
+        if (a == b) {
+            return true;
+        }
+        b = program->blocks[b].idom;
+    }
+    return false;
+}
+
+void ir_compact(IrProgram* program) {
+    for (int b = 0; b < program->block_count; b++) {
+        IrBlock* block = &program->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->count; i++) {
+            if (!program->values[block->code[i]].dead) {
+                block->code[kept++] = block->code[i];
+            }
+        }
+        block->count = kept;
+    }
+}
+
+static const char* ir_op_names[IR_COUNT] = {
+    [IR_CONSTANT] = "constant",
+    [IR_LOAD] = "load",
+    [IR_DEFINE] = "define",
+    [IR_NEGATE_INT] = "negate_int",
+    [IR_NEGATE_FLOAT] = "negate_float",
+    [IR_NOT] = "not",
+    [IR_INT_TO_FLOAT] = "int_to_float",
+    [IR_ADD_INT] = "add_int",
+    [IR_SUBTRACT_INT] = "subtract_int",
+    [IR_MULTIPLY_INT] = "multiply_int",
+    [IR_DIVIDE_INT] = "divide_int",
+    [IR_MODULO_INT] = "modulo_int",
+    [IR_ADD_FLOAT] = "add_float",
+    [IR_SUBTRACT_FLOAT] = "subtract_float",
+    [IR_MULTIPLY_FLOAT] = "multiply_float",
+    [IR_DIVIDE_FLOAT] = "divide_float",
+    [IR_MODULO_FLOAT] = "modulo_float",
+    [IR_CONCAT] = "concat",
+    [IR_COMPARE_INT] = "compare_int",
+    [IR_COMPARE_FLOAT] = "compare_float",
+    [IR_COMPARE_BOOL] = "compare_bool",
+    [IR_COMPARE_STRING] = "compare_string",
+    [IR_PHI] = "phi",
+    [IR_BRANCH] = "branch",
+    [IR_JUMP] = "jump",
+};
+
+void print_ir(const IrProgram* program) {
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        if (block->idom < 0) {
+            printf("block%d:\n", b);
+        } else {
+            printf("block%d:  ; idom block%d\n", b, block->idom);
+        }
+        
+        for (int i = 0; i < block->count; i++) {
+            int id = block->code[i];
+            const IrValue* value = &program->values[id];
+            
+            switch (value->op) {
+                case IR_DEFINE:
+                    printf("    define %s: %s = %%%d\n", value->as.name,
+                           value_type_to_string(value->type), value->args[0]);
+                    continue;
+                case IR_BRANCH:
+                    printf("    branch %%%d, block%d, block%d\n", value->args[0],
+                           value->as.targets[0], value->as.targets[1]);
+                    continue;
+                case IR_JUMP:
+                    printf("    jump block%d\n", value->as.targets[0]);
+                    continue;
+                default:
+                    break;
+            }
+            
+            printf("    %%%d = %s %s", id, value_type_to_string(value->type), ir_op_names[value->op]);
+            switch (value->op) {
+                case IR_CONSTANT: {
+                    char* text = value_to_string(value->as.constant);
+                    printf(" %s", text);
+                    free(text);
+                    break;
+                }
+                case IR_LOAD:
+                    printf(" %s", value->as.name);
+                    break;
+                case IR_COMPARE_INT:
+                case IR_COMPARE_FLOAT:
+                case IR_COMPARE_BOOL:
+                case IR_COMPARE_STRING:
+                    printf(" %s %%%d, %%%d", operator_to_string(value->as.compare),
+                           value->args[0], value->args[1]);
+                    break;
+                case IR_PHI:
+                    printf(" [%%%d, block%d], [%%%d, block%d]", value->args[0], block->idom,
+                           value->args[1], value->as.targets[1]);
+                    break;
+                default:
+                    for (int a = 0; a < 2 && value->args[a] >= 0; a++) {
+                        printf("%s%%%d", a == 0 ? " " : ", ", value->args[a]);
+                    }
+                    break;
+            }
+            printf("\n");
+        }
+    }
+}
+
+void print_ir_stats(const IrStats* stats) {
+    fprintf(stderr, "IR passes:\n");
+    fprintf(stderr, "  Values before:         %d\n", stats->values_before);
+    fprintf(stderr, "  Values after:          %d\n", stats->values_after);
+    for (int i = 0; i < IR_PASS_COUNT; i++) {
+        const IrPassStats* pass = &stats->passes[i];
+        fprintf(stderr, "  %-22s %d changes, %.3f ms\n", pass->name, pass->changes, (double)pass->time_ns / 1e6);
+    }
+}
+
+void free_ir(IrProgram* program) {
+    if (program == NULL) {
+        return;
+    }
+    for (int b = 0; b < program->block_count; b++) {
+        free(program->blocks[b].code);
+    }
+    free(program->blocks);
+    free(program->values);
+    free(program);
+}
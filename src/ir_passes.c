@@ -0,0 +1,435 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include "../include/ir.h"
+#include "../include/operators.h"
+#include <math.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+// Every pass walks the values in layout order, which puts each value
+// after its operands. A value a pass replaces is marked dead and mapped to
+// its replacement, and later operands are rewritten through that map.
+
+static int* new_replacements(const IrProgram* program) {
+    int* replacements = malloc(sizeof(int) * (program->value_count + 1));
+    for (int i = 0; i < program->value_count; i++) {
+        replacements[i] = i;
+    }
+    return replacements;
+}
+
+static void rewrite_operands(IrValue* value, const int* replacements) {
+    for (int a = 0; a < 2; a++) {
+        if (value->args[a] >= 0) {
+            value->args[a] = replacements[value->args[a]];
+        }
+    }
+}
+
+static void replace_value(IrProgram* program, int* replacements, int value, int replacement) {
+    replacements[value] = replacements[replacement];
+    program->values[value].dead = true;
+}
+
+static bool is_pure(IrOp op) {
+    return op != IR_DEFINE && op != IR_PHI && op != IR_BRANCH && op != IR_JUMP;
+}
+
+// Hash of a name, also used for constants and value keys
+static size_t name_hash(const char* name) {
+    return (size_t)hash_bytes(name, strlen(name), 0);
+}
+
+// Copy propagation: a variable defined earlier in the same program is
+// read straight from the value it was defined as, instead of by name.
+
+static int propagate_copies(IrProgram* program) {
+    int* replacements = new_replacements(program);
+    int capacity = 64;
+    while (capacity < program->value_count * 2) {
+        capacity *= 2;
+    }
+    int* slots = malloc(sizeof(int) * capacity);  // Open-addressed defines by name
+    for (int i = 0; i < capacity; i++) {
+        slots[i] = -1;
+    }
+    
+    int changes = 0;
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            int id = block->code[i];
+            IrValue* value = &program->values[id];
+            rewrite_operands(value, replacements);
+            
+            if (value->op != IR_DEFINE && value->op != IR_LOAD) {
+                continue;
+            }
+            
+            size_t slot = name_hash(value->as.name) & (capacity - 1);
+            while (slots[slot] >= 0 && strcmp(program->values[slots[slot]].as.name, value->as.name) != 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            
+            if (value->op == IR_DEFINE) {
+                slots[slot] = id;
+            } else if (slots[slot] >= 0) {
+                replace_value(program, replacements, id, program->values[slots[slot]].args[0]);
+                changes++;
+            }
+        }
+    }
+    
+    free(slots);
+    free(replacements);
+    return changes;
+}
+
+// Strength reduction: replace an operation by a cheaper one with the same
+// result for every input, e.g. x * 2 by x + x, x * 1 by x and x == x by
+// true. Float rules are limited to ones that keep -0.0 and NaN payloads.
+
+static bool int_constant(const IrProgram* program, int value, int64_t* result) {
+    const IrValue* constant = &program->values[value];
+    if (constant->op != IR_CONSTANT || constant->type != VALUE_INT) {
+        return false;
+    }
+    *result = constant->as.constant.data.as_int;
+    return true;
+}
+
+static bool float_constant(const IrProgram* program, int value, double* result) {
+    const IrValue* constant = &program->values[value];
+    if (constant->op != IR_CONSTANT || constant->type != VALUE_FLOAT) {
+        return false;
+    }
+    *result = constant->as.constant.data.as_float;
+    return true;
+}
+
+// Turn a value into a constant in place; its operands are left to DCE
+static void make_constant(IrValue* value, Value constant) {
+    value->op = IR_CONSTANT;
+    value->args[0] = -1;
+    value->args[1] = -1;
+    value->as.constant = constant;
+}
+
+static void make_unary(IrValue* value, IrOp op, int operand) {
+    value->op = op;
+    value->args[0] = operand;
+    value->args[1] = -1;
+}
+
+// Reduce one value. Returns the value that replaces it, itself if it was
+// rewritten in place, or -1 if nothing applies.
+static int reduce_value(IrProgram* program, int id) {
+    IrValue* value = &program->values[id];
+    int left = value->args[0];
+    int right = value->args[1];
+    int64_t n;
+    double x;
+    
+    switch (value->op) {
+        case IR_ADD_INT:
+            if (int_constant(program, right, &n) && n == 0) return left;
+            if (int_constant(program, left, &n) && n == 0) return right;
+            return -1;
+        case IR_SUBTRACT_INT:
+            if (int_constant(program, right, &n) && n == 0) return left;
+            if (int_constant(program, left, &n) && n == 0) {
+                make_unary(value, IR_NEGATE_INT, right);
+                return id;
+            }
+            return -1;
+        case IR_MULTIPLY_INT:
+            if (int_constant(program, left, &n)) {
+                // Constant on the right from here on
+                int swap = left;
+                left = right;
+                right = swap;
+            }
+            if (!int_constant(program, right, &n)) return -1;
+            if (n == 1) return left;
+            if (n == 0) {
+                make_constant(value, create_int_value(0));
+            } else if (n == -1) {
+                make_unary(value, IR_NEGATE_INT, left);
+            } else if (n == 2) {
+                value->op = IR_ADD_INT;
+                value->args[0] = left;
+                value->args[1] = left;
+            } else {
+                return -1;
+            }
+            return id;
+        case IR_DIVIDE_INT:
+            if (!int_constant(program, right, &n)) return -1;
+            if (n == 1) return left;
+            if (n == -1) {
+                make_unary(value, IR_NEGATE_INT, left);
+                return id;
+            }
+            return -1;
+        case IR_MODULO_INT:
+            if (!int_constant(program, right, &n) || (n != 1 && n != -1)) return -1;
+            make_constant(value, create_int_value(0));
+            return id;
+        case IR_SUBTRACT_FLOAT:
+            if (float_constant(program, right, &x) && x == 0.0 && !signbit(x)) return left;
+            return -1;
+        case IR_MULTIPLY_FLOAT:
+            if (float_constant(program, left, &x)) {
+                int swap = left;
+                left = right;
+                right = swap;
+            }
+            if (!float_constant(program, right, &x)) return -1;
+            if (x == 1.0) return left;
+            if (x == 2.0) {
+                value->op = IR_ADD_FLOAT;
+                value->args[0] = left;
+                value->args[1] = left;
+                return id;
+            }
+            return -1;
+        case IR_DIVIDE_FLOAT:
+            if (float_constant(program, right, &x) && x == 1.0) return left;
+            return -1;
+        case IR_NEGATE_INT:
+        case IR_NEGATE_FLOAT:
+        case IR_NOT:
+            // Applying the operator twice gives the operand back
+            if (program->values[left].op == value->op) return program->values[left].args[0];
+            return -1;
+        case IR_COMPARE_INT:
+        case IR_COMPARE_BOOL:
+        case IR_COMPARE_STRING:
+            // A value compares equal to itself; a float may be NaN, which
+            // does not, so IR_COMPARE_FLOAT is left alone
+            if (left != right) return -1;
+            make_constant(value, create_bool_value(compare_result(value->as.compare, 0)));
+            return id;
+        default:
+            return -1;
+    }
+}
+
+static int reduce_strength(IrProgram* program) {
+    int* replacements = new_replacements(program);
+    int changes = 0;
+    
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            int id = block->code[i];
+            rewrite_operands(&program->values[id], replacements);
+            
+            int result = reduce_value(program, id);
+            if (result >= 0) {
+                if (result != id) {
+                    replace_value(program, replacements, id, result);
+                }
+                changes++;
+            }
+        }
+    }
+    
+    free(replacements);
+    return changes;
+}
+
+// Common subexpression elimination: a pure value computed again where an
+// earlier, identical value dominates is replaced by the earlier one. A
+// repeated division cannot fail where the first one succeeded, so
+// divisions take part too.
+
+// Payload of a constant that is not a string; floats by bit pattern, so
+// 0.0 and -0.0 stay apart. The rest of the union is not compared.
+static uint64_t constant_bits(const Value* constant) {
+    uint64_t bits = 0;
+    
+    switch (constant->type) {
+        case VALUE_INT:   bits = (uint64_t)constant->data.as_int; break;
+        case VALUE_FLOAT: memcpy(&bits, &constant->data.as_float, sizeof(bits)); break;
+        case VALUE_BOOL:  bits = constant->data.as_bool; break;
+        default:          break;
+    }
+    return bits;
+}
+
+static uint64_t value_key(const IrValue* value) {
+    uint64_t key = ((uint64_t)value->op << 8) ^ (uint64_t)value->type;
+    key = hash_bytes(value->args, sizeof(value->args), key);
+    
+    switch (value->op) {
+        case IR_CONSTANT: {
+            if (value->type == VALUE_STRING) {
+                return key ^ hash_chars(string_chars(&value->as.constant), string_length(&value->as.constant));
+            }
+            uint64_t bits = constant_bits(&value->as.constant);
+            return hash_bytes(&bits, sizeof(bits), key);
+        }
+        case IR_LOAD:
+            return key ^ name_hash(value->as.name);
+        case IR_COMPARE_INT:
+        case IR_COMPARE_FLOAT:
+        case IR_COMPARE_BOOL:
+        case IR_COMPARE_STRING:
+            return key ^ (uint64_t)value->as.compare;
+        default:
+            return key;
+    }
+}
+
+static bool same_value(const IrValue* a, const IrValue* b) {
+    if (a->op != b->op || a->type != b->type || a->args[0] != b->args[0] || a->args[1] != b->args[1]) {
+        return false;
+    }
+    
+    switch (a->op) {
+        case IR_CONSTANT:
+            if (a->type == VALUE_STRING) {
+                return string_length(&a->as.constant) == string_length(&b->as.constant) &&
+                       memcmp(string_chars(&a->as.constant), string_chars(&b->as.constant),
+                              string_length(&a->as.constant)) == 0;
+            }
+            return constant_bits(&a->as.constant) == constant_bits(&b->as.constant);
+        case IR_LOAD:
+            return strcmp(a->as.name, b->as.name) == 0;
+        case IR_COMPARE_INT:
+        case IR_COMPARE_FLOAT:
+        case IR_COMPARE_BOOL:
+        case IR_COMPARE_STRING:
+            return a->as.compare == b->as.compare;
+        default:
+            return true;
+    }
+}
+
+static int eliminate_common_subexpressions(IrProgram* program) {
+    int* replacements = new_replacements(program);
+    int capacity = 64;
+    while (capacity < program->value_count * 2) {
+        capacity *= 2;
+    }
+    int* slots = malloc(sizeof(int) * capacity);
+    for (int i = 0; i < capacity; i++) {
+        slots[i] = -1;
+    }
+    
+    int changes = 0;
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            int id = block->code[i];
+            IrValue* value = &program->values[id];
+            rewrite_operands(value, replacements);
+            if (!is_pure(value->op)) {
+                continue;
+            }
+            
+            size_t slot = value_key(value) & (capacity - 1);
+            while (slots[slot] >= 0 && !same_value(&program->values[slots[slot]], value)) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            
+            int earlier = slots[slot];
+            if (earlier >= 0 && ir_dominates(program, program->values[earlier].block, b)) {
+                replace_value(program, replacements, id, earlier);
+                changes++;
+            } else {
+                // Later values are more likely to be dominated by this one
+                slots[slot] = id;
+            }
+        }
+    }
+    
+    free(slots);
+    free(replacements);
+    return changes;
+}
+
+// Dead code elimination: remove pure values nothing uses, last first so
+// their operands can become unused in the same walk. Values that may
+// divide by zero stay, since the error is part of the program's behavior.
+
+static int eliminate_dead_code(IrProgram* program) {
+    int* uses = calloc(program->value_count + 1, sizeof(int));
+    for (int b = 0; b < program->block_count; b++) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            const IrValue* value = &program->values[block->code[i]];
+            for (int a = 0; a < 2; a++) {
+                if (value->args[a] >= 0) {
+                    uses[value->args[a]]++;
+                }
+            }
+        }
+    }
+    
+    int changes = 0;
+    for (int b = program->block_count - 1; b >= 0; b--) {
+        const IrBlock* block = &program->blocks[b];
+        for (int i = block->count - 1; i >= 0; i--) {
+            int id = block->code[i];
+            IrValue* value = &program->values[id];
+            if (uses[id] > 0 || !is_pure(value->op) || ir_may_trap(program, id)) {
+                continue;
+            }
+            
+            value->dead = true;
+            changes++;
+            for (int a = 0; a < 2; a++) {
+                if (value->args[a] >= 0) {
+                    uses[value->args[a]]--;
+                }
+            }
+        }
+    }
+    
+    free(uses);
+    return changes;
+}
+
+typedef struct {
+    const char* name;
+    int (*run)(IrProgram* program);
+} IrPass;
+
+// Copies go first so the other passes see through variables; DCE last
+// collects what the others left unused
+static const IrPass passes[IR_PASS_COUNT] = {
+    {"copy-propagation", propagate_copies},
+    {"strength-reduction", reduce_strength},
+    {"cse", eliminate_common_subexpressions},
+    {"dce", eliminate_dead_code},
+};
+
+static int live_values(const IrProgram* program) {
+    int count = 0;
+    for (int b = 0; b < program->block_count; b++) {
+        count += program->blocks[b].count;
+    }
+    return count;
+}
+
+void optimize_ir(IrProgram* program, IrStats* stats) {
+    stats->values_before += live_values(program);
+    
+    for (int i = 0; i < IR_PASS_COUNT; i++) {
+        uint64_t start = now_ns();
+        int changes = passes[i].run(program);
+        ir_compact(program);
+        
+        stats->passes[i].name = passes[i].name;
+        stats->passes[i].changes += changes;
+        stats->passes[i].time_ns += now_ns() - start;
+    }
+    
+    stats->values_after += live_values(program);
+}
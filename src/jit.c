@@ -0,0 +1,623 @@
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS, clock_gettime
+#include "../include/jit.h"
+#include "../include/lexer.h"
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Growable machine code buffer
+typedef struct {
+    uint8_t* bytes;
+    size_t length;
+    size_t capacity;
+} CodeBuffer;
+
+static void emit_bytes(CodeBuffer* code, const uint8_t* bytes, size_t count) {
+    if (code->length + count > code->capacity) {
+        size_t capacity = code->capacity < 256 ? 256 : code->capacity;
+        while (code->length + count > capacity) {
+            capacity *= 2;
+        }
+        code->bytes = realloc(code->bytes, capacity);
+        code->capacity = capacity;
+    }
+    memcpy(code->bytes + code->length, bytes, count);
+    code->length += count;
+}
+
+#define EMIT(code, ...) \
+    emit_bytes(code, (const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+static void emit_u32(CodeBuffer* code, uint32_t value) {
+    emit_bytes(code, (const uint8_t*)&value, sizeof(value));
+}
+
+static void emit_u64(CodeBuffer* code, uint64_t value) {
+    emit_bytes(code, (const uint8_t*)&value, sizeof(value));
+}
+
+// Short forward jump; returns the position of its displacement
+static size_t emit_jump8(CodeBuffer* code, uint8_t opcode) {
+    EMIT(code, opcode, 0);
+    return code->length - 1;
+}
+
+// Point a short jump at the current position
+static void patch_jump8(CodeBuffer* code, size_t position) {
+    code->bytes[position] = (uint8_t)(code->length - position - 1);
+}
+
+// Templates. The operand stack is the machine stack, one 8-byte slot per
+// value; binary operators pop the right operand into rcx and the left
+// into rax. rbx holds the stack pointer at entry, so an error can leave
+// from any depth.
+
+#define POP_RAX 0x58
+#define POP_RCX 0x59
+#define PUSH_RAX 0x50
+
+// Pop the operands of a binary operator. The right one may already be in
+// rcx, when the instruction before loaded it there instead of pushing it.
+static void emit_operands(CodeBuffer* code, bool right_in_rcx) {
+    if (!right_in_rcx) {
+        EMIT(code, POP_RCX);
+    }
+    EMIT(code, POP_RAX);
+}
+
+static void emit_prologue(CodeBuffer* code) {
+    EMIT(code, 0x53);                       // push rbx
+    EMIT(code, 0x48, 0x89, 0xE3);           // mov rbx, rsp
+}
+
+// Store the result through rsi and return -1
+static void emit_define(CodeBuffer* code) {
+    EMIT(code, POP_RAX);
+    EMIT(code, 0x48, 0x89, 0x06);           // mov [rsi], rax
+    EMIT(code, 0x48, 0xC7, 0xC0);           // mov rax, -1
+    emit_u32(code, 0xFFFFFFFFu);
+    EMIT(code, 0x5B, 0xC3);                 // pop rbx; ret
+}
+
+// Return the index of the failing instruction
+static void emit_error_exit(CodeBuffer* code, int ip) {
+    EMIT(code, 0x48, 0xC7, 0xC0);           // mov rax, ip
+    emit_u32(code, (uint32_t)ip);
+    EMIT(code, 0x48, 0x89, 0xDC);           // mov rsp, rbx
+    EMIT(code, 0x5B, 0xC3);                 // pop rbx; ret
+}
+
+// Integer division and modulo with the same results as int_arithmetic
+static void emit_divide_int(CodeBuffer* code, bool modulo, int ip, bool right_in_rcx) {
+    emit_operands(code, right_in_rcx);
+    EMIT(code, 0x48, 0x85, 0xC9);           // test rcx, rcx
+    size_t nonzero = emit_jump8(code, 0x75); // jnz
+    emit_error_exit(code, ip);
+    patch_jump8(code, nonzero);
+    
+    // idiv faults on INT64_MIN / -1, which wraps instead
+    EMIT(code, 0x48, 0x83, 0xF9, 0xFF);     // cmp rcx, -1
+    size_t general = emit_jump8(code, 0x75); // jne
+    if (modulo) {
+        EMIT(code, 0x31, 0xC0);             // xor eax, eax
+    } else {
+        EMIT(code, 0x48, 0xF7, 0xD8);       // neg rax
+    }
+    size_t done = emit_jump8(code, 0xEB);   // jmp
+    patch_jump8(code, general);
+    EMIT(code, 0x48, 0x99);                 // cqo
+    EMIT(code, 0x48, 0xF7, 0xF9);           // idiv rcx
+    if (modulo) {
+        EMIT(code, 0x48, 0x89, 0xD0);       // mov rax, rdx
+    }
+    patch_jump8(code, done);
+    EMIT(code, PUSH_RAX);
+}
+
+static void emit_float_operator(CodeBuffer* code, uint8_t opcode, bool right_in_rcx) {
+    emit_operands(code, right_in_rcx);
+    EMIT(code, 0x66, 0x48, 0x0F, 0x6E, 0xC0);  // movq xmm0, rax
+    EMIT(code, 0x66, 0x48, 0x0F, 0x6E, 0xC9);  // movq xmm1, rcx
+    EMIT(code, 0xF2, 0x0F, opcode, 0xC1);      // op xmm0, xmm1
+    EMIT(code, 0x66, 0x48, 0x0F, 0x7E, 0xC0);  // movq rax, xmm0
+    EMIT(code, PUSH_RAX);
+}
+
+// Float comparisons test the flags of ucomisd directly, like float_compare:
+// unordered operands (NaN) set ZF, PF and CF, so only != is true for them
+static void emit_float_comparison(CodeBuffer* code, TokenType relation) {
+    EMIT(code, 0x66, 0x48, 0x0F, 0x6E, 0xC0);      // movq xmm0, rax
+    EMIT(code, 0x66, 0x48, 0x0F, 0x6E, 0xC9);      // movq xmm1, rcx
+    
+    switch (relation) {
+        case TOKEN_LESS:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC8);    // ucomisd xmm1, xmm0
+            EMIT(code, 0x0F, 0x97, 0xC0);          // seta al
+            break;
+        case TOKEN_LESS_EQUAL:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC8);    // ucomisd xmm1, xmm0
+            EMIT(code, 0x0F, 0x93, 0xC0);          // setae al
+            break;
+        case TOKEN_GREATER:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC1);    // ucomisd xmm0, xmm1
+            EMIT(code, 0x0F, 0x97, 0xC0);          // seta al
+            break;
+        case TOKEN_GREATER_EQUAL:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC1);    // ucomisd xmm0, xmm1
+            EMIT(code, 0x0F, 0x93, 0xC0);          // setae al
+            break;
+        case TOKEN_EQUAL_EQUAL:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC1);    // ucomisd xmm0, xmm1
+            EMIT(code, 0x0F, 0x94, 0xC0);          // sete al
+            EMIT(code, 0x0F, 0x9B, 0xC1);          // setnp cl
+            EMIT(code, 0x20, 0xC8);                // and al, cl
+            break;
+        default:
+            EMIT(code, 0x66, 0x0F, 0x2E, 0xC1);    // ucomisd xmm0, xmm1
+            EMIT(code, 0x0F, 0x95, 0xC0);          // setne al
+            EMIT(code, 0x0F, 0x9A, 0xC1);          // setp cl
+            EMIT(code, 0x08, 0xC8);                // or al, cl
+            break;
+    }
+    EMIT(code, 0x0F, 0xB6, 0xC0);                  // movzx eax, al
+    EMIT(code, PUSH_RAX);
+}
+
+// Integer and bool comparisons leave left > right in dl and left < right
+// in cl, then combine them like compare_result does with a three-way
+// comparison
+static void emit_comparison(CodeBuffer* code, OpCode op, TokenType relation, bool right_in_rcx) {
+    emit_operands(code, right_in_rcx);
+    if (op == OP_COMPARE_FLOAT) {
+        emit_float_comparison(code, relation);
+        return;
+    }
+    
+    switch (op) {
+        case OP_COMPARE_INT:
+            EMIT(code, 0x48, 0x39, 0xC8);              // cmp rax, rcx
+            EMIT(code, 0x0F, 0x9F, 0xC2);              // setg dl
+            EMIT(code, 0x0F, 0x9C, 0xC1);              // setl cl
+            break;
+        default:
+            // Booleans are only equal or not
+            EMIT(code, 0x48, 0x39, 0xC8);              // cmp rax, rcx
+            EMIT(code, 0x0F, 0x95, 0xC2);              // setne dl
+            EMIT(code, 0x31, 0xC9);                    // xor ecx, ecx
+            break;
+    }
+    
+    switch (relation) {
+        case TOKEN_LESS:
+            EMIT(code, 0x0F, 0xB6, 0xC1);              // movzx eax, cl
+            break;
+        case TOKEN_GREATER:
+            EMIT(code, 0x0F, 0xB6, 0xC2);              // movzx eax, dl
+            break;
+        case TOKEN_LESS_EQUAL:
+            EMIT(code, 0x0F, 0xB6, 0xC2);              // movzx eax, dl
+            EMIT(code, 0x83, 0xF0, 0x01);              // xor eax, 1
+            break;
+        case TOKEN_GREATER_EQUAL:
+            EMIT(code, 0x0F, 0xB6, 0xC1);              // movzx eax, cl
+            EMIT(code, 0x83, 0xF0, 0x01);              // xor eax, 1
+            break;
+        case TOKEN_EQUAL_EQUAL:
+            EMIT(code, 0x08, 0xCA);                    // or dl, cl
+            EMIT(code, 0x0F, 0xB6, 0xC2);              // movzx eax, dl
+            EMIT(code, 0x83, 0xF0, 0x01);              // xor eax, 1
+            break;
+        default:
+            EMIT(code, 0x08, 0xCA);                    // or dl, cl
+            EMIT(code, 0x0F, 0xB6, 0xC2);              // movzx eax, dl
+            break;
+    }
+    EMIT(code, PUSH_RAX);
+}
+
+static bool is_binary(OpCode op) {
+    return (op >= OP_ADD_INT && op <= OP_DIVIDE_FLOAT) ||
+           op == OP_COMPARE_INT || op == OP_COMPARE_FLOAT || op == OP_COMPARE_BOOL;
+}
+
+static bool is_relation(int relation) {
+    return relation == TOKEN_LESS || relation == TOKEN_LESS_EQUAL ||
+           relation == TOKEN_GREATER || relation == TOKEN_GREATER_EQUAL ||
+           relation == TOKEN_EQUAL_EQUAL || relation == TOKEN_BANG_EQUAL;
+}
+
+// Whether instructions start..end (an OP_DEFINE) only compute with
+// untagged values and keep the stack balanced, so that the native code
+// can never underflow it or jump out of the region
+static bool region_supported(const Chunk* chunk, int start, int end, int* load_count) {
+    int length = end - start + 1;
+    if (length < JIT_MIN_INSTRUCTIONS) {
+        return false;
+    }
+    
+    ValueType type = (ValueType)chunk->code[end].flags;
+    if (type != VALUE_INT && type != VALUE_FLOAT && type != VALUE_BOOL) {
+        return false;
+    }
+    
+    // Stack depth on entry to each instruction, or -1 until known
+    int* depth_at = malloc(sizeof(int) * length);
+    for (int i = 0; i < length; i++) {
+        depth_at[i] = -1;
+    }
+    
+    int depth = 0;
+    int loads = 0;
+    bool supported = true;
+    
+    for (int ip = start; ip <= end && supported; ip++) {
+        const Instruction* instruction = &chunk->code[ip];
+        
+        if (depth_at[ip - start] >= 0 && depth_at[ip - start] != depth) {
+            supported = false;
+            break;
+        }
+        depth_at[ip - start] = depth;
+        
+        switch (base_opcode(instruction->op)) {
+            case OP_CONSTANT: {
+                uint32_t constant_type = chunk->constants[instruction->operand].type;
+                supported = constant_type == VALUE_INT || constant_type == VALUE_FLOAT ||
+                            constant_type == VALUE_BOOL;
+                depth++;
+                break;
+            }
+            case OP_LOAD:
+                loads++;
+                depth++;
+                break;
+            case OP_NEGATE_INT:
+            case OP_NEGATE_FLOAT:
+            case OP_NOT:
+            case OP_INT_TO_FLOAT:
+                supported = depth >= 1;
+                break;
+            case OP_COMPARE_INT:
+            case OP_COMPARE_FLOAT:
+            case OP_COMPARE_BOOL:
+                supported = is_relation(instruction->flags);
+                // fall through
+            case OP_ADD_INT:
+            case OP_SUBTRACT_INT:
+            case OP_MULTIPLY_INT:
+            case OP_DIVIDE_INT:
+            case OP_MODULO_INT:
+            case OP_ADD_FLOAT:
+            case OP_SUBTRACT_FLOAT:
+            case OP_MULTIPLY_FLOAT:
+            case OP_DIVIDE_FLOAT:
+                supported = supported && depth >= 2;
+                depth--;
+                break;
+            case OP_POP:
+                supported = depth >= 1;
+                depth--;
+                break;
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE: {
+                int target = instruction->operand;
+                supported = depth >= 1 && target > ip && target <= end &&
+                            (depth_at[target - start] < 0 || depth_at[target - start] == depth);
+                if (supported) {
+                    depth_at[target - start] = depth;
+                }
+                break;
+            }
+            case OP_DEFINE:
+                supported = ip == end && depth == 1;
+                break;
+            default:
+                supported = false;
+                break;
+        }
+    }
+    
+    free(depth_at);
+    *load_count = loads;
+    return supported && loads <= JIT_MAX_INPUTS;
+}
+
+// Emit the native code for a supported region. Each variable it reads is
+// passed in once; returns how many there are.
+static int emit_region(CodeBuffer* code, const Chunk* chunk, int start, int end, int32_t* loads) {
+    int length = end - start + 1;
+    size_t* offsets = malloc(sizeof(size_t) * length);
+    size_t* patches = malloc(sizeof(size_t) * length);
+    int* patch_targets = malloc(sizeof(int) * length);
+    bool* is_target = calloc(length, sizeof(bool));
+    int patch_count = 0;
+    int load_count = 0;
+    bool right_in_rcx = false;
+    
+    for (int ip = start; ip <= end; ip++) {
+        OpCode op = (OpCode)chunk->code[ip].op;
+        if (op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE) {
+            is_target[chunk->code[ip].operand - start] = true;
+        }
+    }
+    
+    emit_prologue(code);
+    
+    for (int ip = start; ip <= end; ip++) {
+        const Instruction* instruction = &chunk->code[ip];
+        offsets[ip - start] = code->length;
+        
+        // A value consumed at once as a right operand goes straight to rcx,
+        // unless a jump also reaches the consumer
+        bool to_rcx = ip < end && is_binary((OpCode)chunk->code[ip + 1].op) && !is_target[ip + 1 - start];
+        bool operand_in_rcx = right_in_rcx;
+        right_in_rcx = false;
+        
+        switch (base_opcode(instruction->op)) {
+            case OP_CONSTANT: {
+                const Constant* constant = &chunk->constants[instruction->operand];
+                uint64_t bits = constant->type == VALUE_BOOL
+                    ? (constant->data.as_bool != 0) : (uint64_t)constant->data.as_int;
+                if (to_rcx) {
+                    EMIT(code, 0x48, 0xB9);                // mov rcx, imm64
+                    emit_u64(code, bits);
+                    right_in_rcx = true;
+                } else {
+                    EMIT(code, 0x48, 0xB8);                // mov rax, imm64
+                    emit_u64(code, bits);
+                    EMIT(code, PUSH_RAX);
+                }
+                break;
+            }
+            case OP_LOAD: {
+                int input = 0;
+                while (input < load_count && loads[input] != instruction->operand) {
+                    input++;
+                }
+                if (input == load_count) {
+                    loads[load_count++] = instruction->operand;
+                }
+                if (to_rcx) {
+                    EMIT(code, 0x48, 0x8B, 0x8F);          // mov rcx, [rdi + disp32]
+                    right_in_rcx = true;
+                } else {
+                    EMIT(code, 0xFF, 0xB7);                // push qword [rdi + disp32]
+                }
+                emit_u32(code, (uint32_t)(input * 8));
+                break;
+            }
+            case OP_POP:
+                EMIT(code, 0x48, 0x83, 0xC4, 0x08);        // add rsp, 8
+                break;
+            case OP_NEGATE_INT:
+                EMIT(code, 0x48, 0xF7, 0x1C, 0x24);        // neg qword [rsp]
+                break;
+            case OP_NEGATE_FLOAT:
+                EMIT(code, 0x48, 0x0F, 0xBA, 0x3C, 0x24, 0x3F);  // btc qword [rsp], 63
+                break;
+            case OP_NOT:
+                EMIT(code, 0x48, 0x83, 0x34, 0x24, 0x01);  // xor qword [rsp], 1
+                break;
+            case OP_INT_TO_FLOAT:
+                EMIT(code, POP_RAX);
+                EMIT(code, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);  // cvtsi2sd xmm0, rax
+                EMIT(code, 0x66, 0x48, 0x0F, 0x7E, 0xC0);  // movq rax, xmm0
+                EMIT(code, PUSH_RAX);
+                break;
+            case OP_ADD_INT:
+                emit_operands(code, operand_in_rcx);
+                EMIT(code, 0x48, 0x01, 0xC8, PUSH_RAX);        // add rax, rcx
+                break;
+            case OP_SUBTRACT_INT:
+                emit_operands(code, operand_in_rcx);
+                EMIT(code, 0x48, 0x29, 0xC8, PUSH_RAX);        // sub rax, rcx
+                break;
+            case OP_MULTIPLY_INT:
+                emit_operands(code, operand_in_rcx);
+                EMIT(code, 0x48, 0x0F, 0xAF, 0xC1, PUSH_RAX);  // imul rax, rcx
+                break;
+            case OP_DIVIDE_INT:
+            case OP_MODULO_INT:
+                emit_divide_int(code, instruction->op == OP_MODULO_INT, ip, operand_in_rcx);
+                break;
+            case OP_ADD_FLOAT:
+                emit_float_operator(code, 0x58, operand_in_rcx);  // addsd
+                break;
+            case OP_SUBTRACT_FLOAT:
+                emit_float_operator(code, 0x5C, operand_in_rcx);  // subsd
+                break;
+            case OP_MULTIPLY_FLOAT:
+                emit_float_operator(code, 0x59, operand_in_rcx);  // mulsd
+                break;
+            case OP_DIVIDE_FLOAT:
+                emit_float_operator(code, 0x5E, operand_in_rcx);  // divsd
+                break;
+            case OP_COMPARE_INT:
+            case OP_COMPARE_FLOAT:
+            case OP_COMPARE_BOOL:
+                emit_comparison(code, (OpCode)instruction->op, (TokenType)instruction->flags, operand_in_rcx);
+                break;
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
+                EMIT(code, 0x48, 0x83, 0x3C, 0x24, 0x00);  // cmp qword [rsp], 0
+                EMIT(code, 0x0F, instruction->op == OP_JUMP_IF_FALSE ? 0x84 : 0x85);  // je / jne
+                patches[patch_count] = code->length;
+                patch_targets[patch_count++] = instruction->operand;
+                emit_u32(code, 0);
+                break;
+            default:
+                emit_define(code);
+                break;
+        }
+    }
+    
+    // Jumps only go forward within the region, so every target is known now
+    for (int i = 0; i < patch_count; i++) {
+        int32_t displacement = (int32_t)(offsets[patch_targets[i] - start] - (patches[i] + 4));
+        memcpy(code->bytes + patches[i], &displacement, sizeof(displacement));
+    }
+    
+    free(offsets);
+    free(patches);
+    free(patch_targets);
+    free(is_target);
+    return load_count;
+}
+
+bool jit_available(void) {
+    return true;
+}
+
+// Copy generated code into a fresh mapping, then make it executable and
+// read-only; returns NULL on failure
+static void* map_code(const CodeBuffer* code, size_t* size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *size = (code->length + page - 1) / page * page;
+    
+    void* mapping = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    
+    memcpy(mapping, code->bytes, code->length);
+    if (mprotect(mapping, *size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapping, *size);
+        return NULL;
+    }
+    return mapping;
+}
+
+JitCode* jit_compile(const Chunk* chunk) {
+    uint64_t compile_start = now_ns();
+    CodeBuffer code = {NULL, 0, 0};
+    size_t* offsets = malloc(sizeof(size_t) * (chunk->code_count + 1));
+    int total_loads = 0;
+    
+    JitCode* jit = malloc(sizeof(JitCode));
+    jit->regions = malloc(sizeof(JitRegion) * (chunk->code_count + 1));
+    jit->region_count = 0;
+    jit->region_at = malloc(sizeof(int) * (chunk->code_count + 1));
+    jit->loads = malloc(sizeof(int32_t) * (chunk->code_count + 1));
+    jit->code = NULL;
+    memset(&jit->stats, 0, sizeof(JitStats));
+    jit->timed = false;
+    
+    // Each declaration ends at its OP_DEFINE
+    int start = 0;
+    for (int ip = 0; ip < chunk->code_count; ip++) {
+        jit->region_at[ip] = -1;
+        if (chunk->code[ip].op != OP_DEFINE) {
+            continue;
+        }
+        jit->stats.declarations++;
+        
+        JitRegion* region = &jit->regions[jit->region_count];
+        int load_count;
+        if (region_supported(chunk, start, ip, &load_count)) {
+            region->start = start;
+            region->end = ip;
+            region->loads = jit->loads + total_loads;
+            jit->region_at[start] = jit->region_count;
+            
+            // Align entry points for the decoder
+            while (code.length % 16 != 0) {
+                EMIT(&code, 0xCC);                  // int3
+            }
+            offsets[jit->region_count++] = code.length;
+            region->load_count = emit_region(&code, chunk, start, ip, jit->loads + total_loads);
+            total_loads += region->load_count;
+        }
+        start = ip + 1;
+    }
+    
+    if (jit->region_count > 0) {
+        jit->code = map_code(&code, &jit->code_size);
+    }
+    free(code.bytes);
+    
+    if (jit->code == NULL) {
+        free(offsets);
+        jit_free(jit);
+        return NULL;
+    }
+    
+    for (int i = 0; i < jit->region_count; i++) {
+        jit->regions[i].function = (JitFunction)(void*)((uint8_t*)jit->code + offsets[i]);
+    }
+    free(offsets);
+    
+    jit->stats.compiled = jit->region_count;
+    jit->stats.compile_ns = now_ns() - compile_start;
+    return jit;
+}
+
+void jit_free(JitCode* jit) {
+    if (jit == NULL) {
+        return;
+    }
+    
+    if (jit->code != NULL) {
+        munmap(jit->code, jit->code_size);
+    }
+    free(jit->regions);
+    free(jit->region_at);
+    free(jit->loads);
+    free(jit);
+}
+
+#else
+
+// Other platforms always interpret
+
+bool jit_available(void) {
+    return false;
+}
+
+JitCode* jit_compile(const Chunk* chunk) {
+    (void)chunk;
+    return NULL;
+}
+
+void jit_free(JitCode* jit) {
+    (void)jit;
+}
+
+#endif
+
+int64_t jit_call(JitCode* jit, const JitRegion* region, const uint64_t* inputs, uint64_t* result) {
+    if (!jit->timed) {
+        return region->function(inputs, result);
+    }
+    
+    uint64_t start = now_ns();
+    int64_t failed = region->function(inputs, result);
+    jit->stats.native_ns += now_ns() - start;
+    return failed;
+}
+
+void print_jit_stats(const JitCode* jit) {
+    fprintf(stderr, "JIT statistics:\n");
+    if (jit == NULL) {
+        fprintf(stderr, "  No native code (%s)\n", jit_available() ? "nothing eligible or --jit=off" : "unsupported platform");
+        return;
+    }
+    
+    const JitStats* stats = &jit->stats;
+    fprintf(stderr, "  Declarations compiled: %d of %d\n", stats->compiled, stats->declarations);
+    fprintf(stderr, "  Compile time:          %.3f ms\n", (double)stats->compile_ns / 1e6);
+    fprintf(stderr, "  Native entries:        %llu\n", (unsigned long long)stats->entries);
+    fprintf(stderr, "  Side exits:            %llu (%.1f%%)\n", (unsigned long long)stats->side_exits,
+            stats->entries > 0 ? 100.0 * (double)stats->side_exits / (double)stats->entries : 0.0);
+    if (jit->timed) {
+        fprintf(stderr, "  Time in native code:   %.3f ms\n", (double)stats->native_ns / 1e6);
+    }
+}
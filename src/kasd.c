@@ -0,0 +1,278 @@
+#include "../include/kasd.h"
+#include "../include/session.h"
+#include "../include/cache.h"
+#include "../include/pool.h"
+#include "../include/region.h"
+
+// KASD context
+struct KasdContext {
+    KasdState state;  // Owned by the context; contexts share nothing
+    Session session;
+    Region* region;  // Backs the environment of a region context, or NULL
+    char* error;  // Last error message, owned
+};
+
+// Compiled KASD script
+struct KasdScript {
+    CompiledScript* compiled;  // Shared with the cache and other contexts
+};
+
+// Move the current error into the context
+static void capture_error(KasdContext* context) {
+    free(context->error);
+    context->error = format_error(&context->state);
+    clear_error(&context->state);
+}
+
+// Set the allocator behind the runtime object pools
+bool kasd_set_allocator(const KasdAllocator* allocator) {
+    if (allocator == NULL) {
+        return pool_set_allocator(NULL);
+    }
+    
+    PoolAllocator pool_allocator = {allocator->allocate, allocator->deallocate, allocator->user_data};
+    return pool_set_allocator(&pool_allocator);
+}
+
+// Create a new KASD context
+KasdContext* kasd_create_context(int log_level) {
+    KasdContext* context = malloc(sizeof(KasdContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    
+    init_kasd_state(&context->state, log_level);
+    init_session(&context->session, &context->state, OPT_LEVEL_BASIC, false, true);
+    context->region = NULL;
+    context->error = NULL;
+    return context;
+}
+
+// Create a context whose runtime state lives in a region
+KasdContext* kasd_create_region_context(int log_level) {
+    KasdContext* context = kasd_create_context(log_level);
+    if (context == NULL) {
+        return NULL;
+    }
+    
+    context->region = malloc(sizeof(Region));
+    init_region(context->region);
+    context->session.interpreter.env.region = context->region;
+    return context;
+}
+
+// Forget every variable
+void kasd_reset_context(KasdContext* context) {
+    Session* session = &context->session;
+    
+    // Only kasd_execute leaves programs and constants behind; kasd_run
+    // leaves just the symbols it declared
+    if (session->program_count > 0) {
+        int opt_level = session->optimizer.level;
+        free_session(session);
+        init_session(session, &context->state, opt_level, false, true);
+        session->interpreter.env.region = context->region;
+    } else {
+        rollback_symbols(&session->analyzer, NULL);
+        env_clear(&session->interpreter.env);
+    }
+    
+    clear_error(&context->state);
+}
+
+// Free a KASD context
+void kasd_free_context(KasdContext* context) {
+    if (context == NULL) {
+        return;
+    }
+    
+    free_session(&context->session);
+    if (context->region != NULL) {
+        free_region(context->region);
+        free(context->region);
+    }
+    clear_error(&context->state);
+    free(context->error);
+    free(context);
+}
+
+// Execute KASD code
+bool kasd_execute(KasdContext* context, const char* source) {
+    if (!session_execute(&context->session, source)) {
+        capture_error(context);
+        return false;
+    }
+    return true;
+}
+
+// Execute KASD code in REPL mode, echoing each declaration
+bool kasd_execute_repl(KasdContext* context, const char* source) {
+    context->session.interpreter.repl_mode = true;
+    bool result = kasd_execute(context, source);
+    context->session.interpreter.repl_mode = false;
+    return result;
+}
+
+// Compile KASD code into a reusable script
+KasdScript* kasd_compile(KasdContext* context, const char* source) {
+    int opt_level = context->session.optimizer.level;
+    
+    // Reuse an earlier compilation of the same source from any context
+    CompiledScript* compiled = cache_lookup(source, opt_level);
+    if (compiled != NULL) {
+        KasdScript* script = malloc(sizeof(KasdScript));
+        script->compiled = compiled;
+        return script;
+    }
+    
+    Lexer lexer;
+    Parser parser;
+    SemanticAnalyzer analyzer;
+    Optimizer optimizer;
+    
+    init_lexer(&lexer, source, &context->state);
+    init_parser(&parser, &lexer);
+    
+    AstNode* program = parse(&parser);
+    if (parser.had_error || program == NULL) {
+        free_ast(program);
+        capture_error(context);
+        return NULL;
+    }
+    
+    init_semantic_analyzer(&analyzer, &context->state);
+    bool analyzed = analyze(&analyzer, program);
+    free_semantic_analyzer(&analyzer);
+    
+    if (!analyzed) {
+        free_ast(program);
+        capture_error(context);
+        return NULL;
+    }
+    
+    // Declarations stay so the host can read them back
+    init_optimizer(&optimizer, &context->state, opt_level, true);
+    optimize(&optimizer, program);
+    free_optimizer(&optimizer);
+    
+    KasdScript* script = malloc(sizeof(KasdScript));
+    script->compiled = cache_insert(create_compiled_script(source, opt_level, program));
+    return script;
+}
+
+// Run a compiled script in a context
+bool kasd_run(KasdContext* context, const KasdScript* script) {
+    if (!session_run(&context->session, script->compiled->program, script->compiled->closures)) {
+        capture_error(context);
+        return false;
+    }
+    return true;
+}
+
+// Free a compiled script
+void kasd_free_script(KasdScript* script) {
+    if (script == NULL) {
+        return;
+    }
+    
+    release_compiled_script(script->compiled);
+    free(script);
+}
+
+// Read a context's garbage collector counters
+void kasd_get_gc_stats(KasdContext* context, KasdGcStats* stats) {
+    const GcStats* gc_stats = &context->session.interpreter.env.heap.stats;
+    
+    stats->collections = gc_stats->collections;
+    stats->total_pause_ns = gc_stats->total_pause_ns;
+    stats->max_pause_ns = gc_stats->max_pause_ns;
+    stats->bytes_allocated = gc_stats->bytes_allocated;
+    stats->bytes_promoted = gc_stats->bytes_promoted;
+}
+
+// Copy a variable's value out of a context
+bool kasd_get_variable(KasdContext* context, const char* name, KasdValue* value) {
+    Value found;
+    if (!lookup_variable(&context->session.interpreter, name, &found)) {
+        return false;
+    }
+    
+    switch (found.type) {
+        case VALUE_INT:    *value = kasd_int(found.data.as_int); break;
+        case VALUE_FLOAT:  *value = kasd_float(found.data.as_float); break;
+        case VALUE_BOOL:   *value = kasd_bool(found.data.as_bool); break;
+        case VALUE_STRING: *value = kasd_string(string_chars(&found)); break;
+        default:           *value = kasd_null(); break;
+    }
+    return true;
+}
+
+// Read the compiled script cache counters
+void kasd_cache_get_stats(KasdCacheStats* stats) {
+    CacheStats cache_stats;
+    cache_get_stats(&cache_stats);
+    
+    stats->hits = cache_stats.hits;
+    stats->misses = cache_stats.misses;
+    stats->evictions = cache_stats.evictions;
+    stats->entries = cache_stats.entries;
+    stats->bytes = cache_stats.bytes;
+    stats->budget = cache_stats.budget;
+}
+
+// Set the compiled script cache memory budget
+void kasd_cache_set_budget(size_t bytes) {
+    cache_set_budget(bytes);
+}
+
+// Empty the compiled script cache
+void kasd_cache_clear(void) {
+    cache_clear();
+}
+
+// Get the last error message
+const char* kasd_get_error(KasdContext* context) {
+    return context->error;
+}
+
+// Create KASD values
+KasdValue kasd_null(void) {
+    KasdValue value;
+    value.type = KASD_VALUE_NULL;
+    return value;
+}
+
+KasdValue kasd_int(long long val) {
+    KasdValue value;
+    value.type = KASD_VALUE_INT;
+    value.data.as_int = val;
+    return value;
+}
+
+KasdValue kasd_float(double val) {
+    KasdValue value;
+    value.type = KASD_VALUE_FLOAT;
+    value.data.as_float = val;
+    return value;
+}
+
+KasdValue kasd_bool(bool val) {
+    KasdValue value;
+    value.type = KASD_VALUE_BOOL;
+    value.data.as_bool = val;
+    return value;
+}
+
+KasdValue kasd_string(const char* val) {
+    KasdValue value;
+    value.type = KASD_VALUE_STRING;
+    value.data.as_string = strdup(val);
+    return value;
+}
+
+// Free a KASD value
+void kasd_free_value(KasdValue value) {
+    if (value.type == KASD_VALUE_STRING && value.data.as_string != NULL) {
+        free(value.data.as_string);
+    }
+}
@@ -0,0 +1,208 @@
+#define _DEFAULT_SOURCE  // realpath
+#include "../include/kasdc.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define KASDC_MAGIC "KSDC"
+#define KASDC_BYTE_ORDER 0x01020304u
+
+// File header. Sections follow it, each 8-byte aligned, in the same
+// layout as the Chunk arrays they are mapped as.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;      // Rejects files from the other endianness
+    int32_t opt_level;
+    uint64_t snapshot_hash;
+    uint64_t source_hash;
+    uint64_t source_length;
+    
+    uint32_t code_count;      // Instructions and source positions
+    uint32_t constant_count;
+    uint32_t name_count;
+    uint32_t strings_length;
+    uint32_t max_stack;
+    uint32_t local_count;
+    uint32_t export_globals;
+    
+    uint64_t code_offset;
+    uint64_t positions_offset;
+    uint64_t constants_offset;
+    uint64_t names_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+    uint64_t file_hash;       // Whole file with this field zeroed, against corruption
+} KasdcHeader;
+
+// Hash of a file image, chained from its header to its sections
+static uint64_t hash_file(const KasdcHeader* header, const char* image, size_t size) {
+    KasdcHeader unsealed = *header;
+    unsealed.file_hash = 0;
+    
+    uint64_t header_hash = hash_bytes(&unsealed, sizeof(KasdcHeader), 0);
+    return hash_bytes(image + sizeof(KasdcHeader), size - sizeof(KasdcHeader), header_hash);
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Path of the compiled file for a source file
+char* compiled_file_path(const char* source_path, const char* cache_dir) {
+    char* path;
+    
+    if (cache_dir == NULL) {
+        // config.kasd -> config.kasdc; anything else gets the extension appended
+        size_t length = strlen(source_path);
+        bool has_extension = length >= 5 && strcmp(source_path + length - 5, ".kasd") == 0;
+        
+        path = malloc(length + sizeof(KASDC_EXTENSION));
+        strcpy(path, source_path);
+        strcpy(path + (has_extension ? length - 5 : length), KASDC_EXTENSION);
+        return path;
+    }
+    
+    // One flat directory for every source: name entries by the full path
+    char resolved[PATH_MAX];
+    const char* full_path = realpath(source_path, resolved) != NULL ? resolved : source_path;
+    const char* base = strrchr(full_path, '/');
+    base = (base != NULL) ? base + 1 : full_path;
+    
+    size_t size = strlen(cache_dir) + strlen(base) + sizeof(KASDC_EXTENSION) + 20;
+    path = malloc(size);
+    snprintf(path, size, "%s/%s-%016llx" KASDC_EXTENSION, cache_dir, base,
+             (unsigned long long)hash_bytes(full_path, strlen(full_path), 0));
+    return path;
+}
+
+// Check that a section lies inside the file and is aligned for its type
+static bool section_in_bounds(uint64_t offset, uint64_t count, size_t element_size, size_t file_size) {
+    return offset % 8 == 0 && offset <= file_size &&
+           count <= (file_size - offset) / element_size;
+}
+
+// Map a compiled file
+bool load_compiled_file(const char* path, Chunk* chunk, const char* source, const CompileKey* key,
+                        const Snapshot* snapshot) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(KasdcHeader)) {
+        close(fd);
+        return false;
+    }
+    
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    
+    const KasdcHeader* header = mapping;
+    size_t source_length = strlen(source);
+    bool valid = memcmp(header->magic, KASDC_MAGIC, 4) == 0 &&
+                 header->version == KASDC_VERSION &&
+                 header->byte_order == KASDC_BYTE_ORDER &&
+                 header->opt_level == key->opt_level &&
+                 header->export_globals == (uint32_t)key->export_globals &&
+                 header->snapshot_hash == key->snapshot_hash &&
+                 header->file_size == size &&
+                 header->source_length == source_length &&
+                 header->code_count <= INT_MAX && header->constant_count <= INT_MAX &&
+                 header->name_count <= INT_MAX && header->max_stack <= INT_MAX &&
+                 header->local_count <= INT_MAX &&
+                 section_in_bounds(header->code_offset, header->code_count, sizeof(Instruction), size) &&
+                 section_in_bounds(header->positions_offset, header->code_count, sizeof(SourcePosition), size) &&
+                 section_in_bounds(header->constants_offset, header->constant_count, sizeof(Constant), size) &&
+                 section_in_bounds(header->names_offset, header->name_count, sizeof(uint32_t), size) &&
+                 section_in_bounds(header->strings_offset, header->strings_length, 1, size) &&
+                 header->source_hash == hash_bytes(source, source_length, KASDC_VERSION) &&
+                 header->file_hash == hash_file(header, mapping, size);
+    
+    if (!valid) {
+        munmap(mapping, size);
+        return false;
+    }
+    
+    // Point the chunk straight into the mapping
+    char* base = mapping;
+    init_chunk(chunk);
+    chunk->code = (Instruction*)(base + header->code_offset);
+    chunk->positions = (SourcePosition*)(base + header->positions_offset);
+    chunk->code_count = (int)header->code_count;
+    chunk->constants = (Constant*)(base + header->constants_offset);
+    chunk->constant_count = (int)header->constant_count;
+    chunk->names = (uint32_t*)(base + header->names_offset);
+    chunk->name_count = (int)header->name_count;
+    chunk->strings = base + header->strings_offset;
+    chunk->strings_length = header->strings_length;
+    chunk->max_stack = (int)header->max_stack;
+    chunk->local_count = (int)header->local_count;
+    chunk->mapping = mapping;
+    chunk->mapping_size = size;
+    
+    if (!verify_chunk(chunk, snapshot)) {
+        free_chunk(chunk);
+        return false;
+    }
+    return true;
+}
+
+// Write a compiled file atomically
+bool write_compiled_file(const char* path, const Chunk* chunk, const char* source, const CompileKey* key) {
+    KasdcHeader header;
+    memset(&header, 0, sizeof(KasdcHeader));
+    
+    size_t source_length = strlen(source);
+    memcpy(header.magic, KASDC_MAGIC, 4);
+    header.version = KASDC_VERSION;
+    header.byte_order = KASDC_BYTE_ORDER;
+    header.opt_level = key->opt_level;
+    header.export_globals = key->export_globals;
+    header.snapshot_hash = key->snapshot_hash;
+    header.source_hash = hash_bytes(source, source_length, KASDC_VERSION);
+    header.source_length = source_length;
+    header.code_count = (uint32_t)chunk->code_count;
+    header.constant_count = (uint32_t)chunk->constant_count;
+    header.name_count = (uint32_t)chunk->name_count;
+    header.strings_length = chunk->strings_length;
+    header.max_stack = (uint32_t)chunk->max_stack;
+    header.local_count = (uint32_t)chunk->local_count;
+    
+    header.code_offset = align8(sizeof(KasdcHeader));
+    header.positions_offset = align8(header.code_offset + sizeof(Instruction) * header.code_count);
+    header.constants_offset = align8(header.positions_offset + sizeof(SourcePosition) * header.code_count);
+    header.names_offset = align8(header.constants_offset + sizeof(Constant) * header.constant_count);
+    header.strings_offset = align8(header.names_offset + sizeof(uint32_t) * header.name_count);
+    header.file_size = header.strings_offset + header.strings_length;
+    
+    // Lay the file out in memory exactly as it will be mapped
+    char* image = calloc(1, header.file_size);
+    if (header.code_count > 0) {
+        memcpy(image + header.code_offset, chunk->code, sizeof(Instruction) * header.code_count);
+        memcpy(image + header.positions_offset, chunk->positions, sizeof(SourcePosition) * header.code_count);
+    }
+    if (header.constant_count > 0) {
+        memcpy(image + header.constants_offset, chunk->constants, sizeof(Constant) * header.constant_count);
+    }
+    if (header.name_count > 0) {
+        memcpy(image + header.names_offset, chunk->names, sizeof(uint32_t) * header.name_count);
+    }
+    if (header.strings_length > 0) {
+        memcpy(image + header.strings_offset, chunk->strings, header.strings_length);
+    }
+    header.file_hash = hash_file(&header, image, header.file_size);
+    memcpy(image, &header, sizeof(KasdcHeader));
+    
+    bool written = write_file_atomically(path, image, header.file_size);
+    
+    free(image);
+    return written;
+}
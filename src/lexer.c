@@ -1,5 +1,4 @@
 #include "../include/lexer.h"
-#include <ctype.h>
 
 // Keyword table
 typedef struct {
@@ -9,7 +8,7 @@ typedef struct {
 } Keyword;
 
 // Keyword lookup table
-static Keyword keywords[] = {
+static const Keyword keywords[] = {
     {"let", TOKEN_LET, 3},
     {"true", TOKEN_TRUE, 4},
     {"false", TOKEN_FALSE, 5},
@@ -33,41 +32,48 @@ typedef enum {
     CHAR_EOF
 } CharClass;
 
-static CharClass char_classes[256];
+// Runs of consecutive characters in one class, in standard C: CLASS_n
+// covers n characters starting at c
+#define CLASS_1(c, k) [(c)] = (k)
+#define CLASS_2(c, k) CLASS_1(c, k), CLASS_1((c) + 1, k)
+#define CLASS_4(c, k) CLASS_2(c, k), CLASS_2((c) + 2, k)
+#define CLASS_8(c, k) CLASS_4(c, k), CLASS_4((c) + 4, k)
+#define CLASS_16(c, k) CLASS_8(c, k), CLASS_8((c) + 8, k)
+#define CLASS_32(c, k) CLASS_16(c, k), CLASS_16((c) + 16, k)
+#define CLASS_64(c, k) CLASS_32(c, k), CLASS_32((c) + 32, k)
+#define CLASS_128(c, k) CLASS_64(c, k), CLASS_64((c) + 64, k)
 
-// Initialize character class table
-static void init_char_classes(void) {
-    // Default all to special
-    for (int i = 0; i < 256; i++) {
-        char_classes[i] = CHAR_SPECIAL;
-    }
-    
-    // Set specific classes
-    for (int i = 0; i < 256; i++) {
-        if (isspace(i) && i != '\n') char_classes[i] = CHAR_WHITESPACE;
-        if (isalpha(i) || i == '_') char_classes[i] = CHAR_ALPHA;
-        if (isdigit(i)) char_classes[i] = CHAR_DIGIT;
-        if (i == '"') char_classes[i] = CHAR_QUOTE;
-        if (i == '\n') char_classes[i] = CHAR_NEWLINE;
-        if (i == 0) char_classes[i] = CHAR_EOF;
-    }
-}
+// Character classes are constant so lexers on different threads can share
+// them without any initialization step
+static const CharClass char_classes[256] = {
+    ['\0'] = CHAR_EOF,
+    [' '] = CHAR_WHITESPACE, ['\t'] = CHAR_WHITESPACE, ['\r'] = CHAR_WHITESPACE,
+    ['\v'] = CHAR_WHITESPACE, ['\f'] = CHAR_WHITESPACE,
+    ['\n'] = CHAR_NEWLINE,
+    CLASS_16('a', CHAR_ALPHA), CLASS_8('q', CHAR_ALPHA), CLASS_2('y', CHAR_ALPHA),  // a-z
+    CLASS_16('A', CHAR_ALPHA), CLASS_8('Q', CHAR_ALPHA), CLASS_2('Y', CHAR_ALPHA),  // A-Z
+    ['_'] = CHAR_ALPHA,
+    CLASS_8('0', CHAR_DIGIT), CLASS_2('8', CHAR_DIGIT),                             // 0-9
+    ['"'] = CHAR_QUOTE,
+    ['!'] = CHAR_SPECIAL, ['`'] = CHAR_SPECIAL,
+    CLASS_8('#', CHAR_SPECIAL), CLASS_4('+', CHAR_SPECIAL), CLASS_1('/', CHAR_SPECIAL),  // # to /
+    CLASS_4(':', CHAR_SPECIAL), CLASS_2('>', CHAR_SPECIAL), CLASS_1('@', CHAR_SPECIAL),  // : to @
+    CLASS_4('[', CHAR_SPECIAL),                                                        // [ to ^
+    CLASS_4('{', CHAR_SPECIAL),                                                        // { to ~
+    CLASS_8(0x01, CHAR_SPECIAL),                                                       // 0x01 to 0x08
+    CLASS_16(0x0E, CHAR_SPECIAL), CLASS_2(0x1E, CHAR_SPECIAL),                         // 0x0E to 0x1F
+    CLASS_1(0x7F, CHAR_SPECIAL), CLASS_128(0x80, CHAR_SPECIAL),                        // 0x7F to 0xFF
+};
 
 // Initialize lexer with source code
-void init_lexer(Lexer* lexer, const char* source) {
-    static bool classes_initialized = false;
-    
-    if (!classes_initialized) {
-        init_char_classes();
-        classes_initialized = true;
-    }
-    
+void init_lexer(Lexer* lexer, const char* source, KasdState* state) {
     lexer->source = source;
     lexer->current = source;
     lexer->start = source;
     lexer->line = 1;
     lexer->column = 1;
     lexer->had_error = false;
+    lexer->state = state;
 }
 
 // Check if we're at the end of the source
@@ -102,11 +108,18 @@ static void skip_whitespace(Lexer* lexer) {
                 advance(lexer);
                 break;
             case CHAR_NEWLINE:
+                advance(lexer);
                 lexer->line++;
                 lexer->column = 1;
-                advance(lexer);
                 break;
             default:
+                // Line comments run to the end of the line
+                if (c == '/' && peek_next(lexer) == '/') {
+                    while (peek(lexer) != '\n' && !is_at_end(lexer)) {
+                        advance(lexer);
+                    }
+                    break;
+                }
                 return;
         }
     }
@@ -123,11 +136,20 @@ static Token make_token(Lexer* lexer, TokenType type) {
     return token;
 }
 
+// Consume the current character if it matches the expected one
+static bool match_char(Lexer* lexer, char expected) {
+    if (*lexer->current != expected) {
+        return false;
+    }
+    advance(lexer);
+    return true;
+}
+
 // Make an error token
 static Token error_token(Lexer* lexer, const char* message) {
     lexer->had_error = true;
     
-    set_error(ERROR_SYNTAX, lexer->line, lexer->column, message, 
+    set_error(lexer->state, ERROR_SYNTAX, lexer->line, lexer->column, message, 
               lexer->source, (int)(lexer->start - lexer->source), 
               (int)(lexer->current - lexer->start));
     
@@ -200,19 +222,17 @@ static Token number(Lexer* lexer) {
 
 // Handle strings
 static Token string(Lexer* lexer) {
-    // Skip the opening quote
-    advance(lexer);
+    // The opening quote was consumed by scan_token()
     
     // Mark the start of the string content
     const char* start = lexer->current;
     
     // Consume characters until closing quote or end of file
     while (peek(lexer) != '"' && !is_at_end(lexer)) {
-        if (peek(lexer) == '\n') {
+        if (advance(lexer) == '\n') {
             lexer->line++;
             lexer->column = 1;
         }
-        advance(lexer);
     }
     
     // Check for unterminated string
@@ -226,10 +246,9 @@ static Token string(Lexer* lexer) {
     // Create the token
     Token token = make_token(lexer, TOKEN_STRING);
     
-    // Copy the string value (without quotes)
-    token.value.as_string = malloc(length + 1);
-    memcpy(token.value.as_string, start, length);
-    token.value.as_string[length] = '\0';
+    // The string value (without quotes) is read straight from the source
+    token.value.as_string.chars = start;
+    token.value.as_string.length = length;
     
     // Skip the closing quote
     advance(lexer);
@@ -265,11 +284,31 @@ Token scan_token(Lexer* lexer) {
             break; // Fall through to handle special characters below
     }
     
-    // Handle single-character tokens
+    // Handle single and double character tokens
     switch (c) {
         case ':': return make_token(lexer, TOKEN_COLON);
-        case '=': return make_token(lexer, TOKEN_EQUAL);
         case ';': return make_token(lexer, TOKEN_SEMICOLON);
+        case '(': return make_token(lexer, TOKEN_LEFT_PAREN);
+        case ')': return make_token(lexer, TOKEN_RIGHT_PAREN);
+        case '+': return make_token(lexer, TOKEN_PLUS);
+        case '-': return make_token(lexer, TOKEN_MINUS);
+        case '*': return make_token(lexer, TOKEN_STAR);
+        case '/': return make_token(lexer, TOKEN_SLASH);
+        case '%': return make_token(lexer, TOKEN_PERCENT);
+        case '=':
+            return make_token(lexer, match_char(lexer, '=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+        case '!':
+            return make_token(lexer, match_char(lexer, '=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+        case '<':
+            return make_token(lexer, match_char(lexer, '=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+        case '>':
+            return make_token(lexer, match_char(lexer, '=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+        case '&':
+            if (match_char(lexer, '&')) return make_token(lexer, TOKEN_AND_AND);
+            break;
+        case '|':
+            if (match_char(lexer, '|')) return make_token(lexer, TOKEN_OR_OR);
+            break;
     }
     
     // Unrecognized character
@@ -297,7 +336,23 @@ const char* token_type_to_string(TokenType type) {
         "TYPE_FLOAT",
         "TYPE_BOOL",
         "TYPE_STRING",
-        "TYPE_NULL"
+        "TYPE_NULL",
+        "LEFT_PAREN",
+        "RIGHT_PAREN",
+        "PLUS",
+        "MINUS",
+        "STAR",
+        "SLASH",
+        "PERCENT",
+        "BANG",
+        "BANG_EQUAL",
+        "EQUAL_EQUAL",
+        "LESS",
+        "LESS_EQUAL",
+        "GREATER",
+        "GREATER_EQUAL",
+        "AND_AND",
+        "OR_OR"
     };
     
     return token_names[type];
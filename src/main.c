@@ -2,31 +2,66 @@
 #include "../include/lexer.h"
 #include "../include/parser.h"
 #include "../include/semantic.h"
-#include "../include/interpreter.h"
+#include "../include/session.h"
+#include "../include/vm.h"
+#include "../include/kasdc.h"
+#include "../include/pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #define MAX_LINE_LENGTH 1024
 
+// Growable buffer holding one (possibly multi-line) REPL input
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} InputBuffer;
+
+// Command line options
+typedef struct {
+    int log_level;
+    int opt_level;
+    bool show_stats;
+    bool show_gc_stats;
+    bool use_vm;            // Run files on the bytecode VM
+    Engine engine;          // Otherwise, and in the REPL, how to run programs
+    bool use_jit;           // Compile numeric declarations to native code
+    bool show_jit_stats;
+    bool use_cache;         // Reuse and write .kasdc compiled files
+    const char* cache_dir;  // Where compiled files go; NULL for next to the source
+    const char* snapshot_out;    // Write the environment here after running
+    const Snapshot* snapshot;    // Environment to continue from, or NULL
+    bool emit_c;            // Print the file translated to C instead of running it
+    bool dump_ir;           // Print the file's optimized IR instead of running it
+    const char* profile_path;    // Add the VM instruction profile to this file
+} RunOptions;
+
 // Forward declarations
 static void usage(const char* program_name);
-static void repl(int log_level);
-static bool run_file(const char* filename, int log_level);
-static bool run_source(const char* source, int log_level, bool repl_mode);
+static void repl(KasdState* state, const RunOptions* options);
+static bool run_file(KasdState* state, const char* filename, const RunOptions* options);
+static bool emit_file(KasdState* state, const char* filename, const RunOptions* options);
+static bool dump_ir_file(KasdState* state, const char* filename, const RunOptions* options);
+static bool read_line(InputBuffer* input);
+static bool is_input_complete(const char* source);
+static bool save_snapshot(const Environment* env, const char* path);
 static char* read_file(const char* filename);
 
 int main(int argc, char* argv[]) {
-    int log_level = LOG_ERROR;
+    RunOptions options = {LOG_ERROR, OPT_LEVEL_BASIC, false, false, true, ENGINE_CLOSURE, false, false, true, NULL, NULL, NULL, false, false, NULL};
+    const char* snapshot_in = NULL;
     char* filename = NULL;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--log-level") == 0 || strcmp(argv[i], "-l") == 0) {
             if (i + 1 < argc) {
-                log_level = atoi(argv[++i]);
-                if (log_level < LOG_NONE || log_level > LOG_DEBUG) {
-                    fprintf(stderr, "Invalid log level: %d\n", log_level);
+                options.log_level = atoi(argv[++i]);
+                if (options.log_level < LOG_NONE || options.log_level > LOG_DEBUG) {
+                    fprintf(stderr, "Invalid log level: %d\n", options.log_level);
                     usage(argv[0]);
                     return 1;
                 }
@@ -35,6 +70,65 @@ int main(int argc, char* argv[]) {
                 usage(argv[0]);
                 return 1;
             }
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            options.opt_level = OPT_LEVEL_NONE;
+        } else if (strcmp(argv[i], "-O1") == 0) {
+            options.opt_level = OPT_LEVEL_BASIC;
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            options.opt_level = OPT_LEVEL_FULL;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.show_stats = true;
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            options.show_gc_stats = true;
+        } else if (strcmp(argv[i], "--engine") == 0) {
+            const char* engine = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(engine, "vm") == 0) {
+                options.use_vm = true;
+            } else if (strcmp(engine, "closure") == 0 || strcmp(engine, "ast") == 0) {
+                options.use_vm = false;
+                options.engine = strcmp(engine, "ast") == 0 ? ENGINE_AST : ENGINE_CLOSURE;
+            } else {
+                fprintf(stderr, "Invalid engine: %s\n", engine);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--jit=on") == 0 || strcmp(argv[i], "--jit=off") == 0) {
+            options.use_jit = strcmp(argv[i], "--jit=on") == 0;
+        } else if (strcmp(argv[i], "--jit-stats") == 0) {
+            options.show_jit_stats = true;
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            options.emit_c = true;
+        } else if (strcmp(argv[i], "--dump-ir") == 0) {
+            options.dump_ir = true;
+        } else if (strcmp(argv[i], "--profile-ops") == 0) {
+            if (i + 1 < argc) {
+                options.profile_path = argv[++i];
+            } else {
+                fprintf(stderr, "Missing profile file\n");
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.use_cache = false;
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 < argc) {
+                options.cache_dir = argv[++i];
+            } else {
+                fprintf(stderr, "Missing cache directory\n");
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--snapshot") == 0 || strcmp(argv[i], "--from-snapshot") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing snapshot file\n");
+                usage(argv[0]);
+                return 1;
+            }
+            if (strcmp(argv[i], "--snapshot") == 0) {
+                options.snapshot_out = argv[++i];
+            } else {
+                snapshot_in = argv[++i];
+            }
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             usage(argv[0]);
             return 0;
@@ -52,16 +146,61 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // Initialize KASD state
-    init_kasd_state(log_level);
+    if (options.snapshot_out != NULL && filename == NULL) {
+        fprintf(stderr, "--snapshot needs a file to run\n");
+        usage(argv[0]);
+        return 1;
+    }
     
-    // Run file or REPL
-    if (filename != NULL) {
-        if (!run_file(filename, log_level)) {
+    if (options.emit_c && (filename == NULL || options.snapshot_out != NULL || snapshot_in != NULL)) {
+        fprintf(stderr, "--emit-c needs a file and cannot be used with snapshots\n");
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (options.dump_ir && (filename == NULL || options.emit_c || options.snapshot_out != NULL)) {
+        fprintf(stderr, "--dump-ir needs a file and cannot be used with --emit-c or --snapshot\n");
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (options.profile_path != NULL && (filename == NULL || !options.use_vm || options.emit_c || options.dump_ir)) {
+        fprintf(stderr, "--profile-ops needs a file to run on the vm\n");
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // Map the environment to continue from
+    Snapshot* snapshot = NULL;
+    if (snapshot_in != NULL) {
+        snapshot = load_snapshot(snapshot_in);
+        if (snapshot == NULL) {
+            fprintf(stderr, "Could not load snapshot: %s\n", snapshot_in);
             return 1;
         }
+        options.snapshot = snapshot;
+    }
+    
+    // Initialize KASD state
+    KasdState state;
+    init_kasd_state(&state, options.log_level);
+    
+    // Run file or REPL
+    bool result = true;
+    if (options.emit_c) {
+        result = emit_file(&state, filename, &options);
+    } else if (options.dump_ir) {
+        result = dump_ir_file(&state, filename, &options);
+    } else if (filename != NULL) {
+        result = run_file(&state, filename, &options);
     } else {
-        repl(log_level);
+        repl(&state, &options);
+    }
+    
+    clear_error(&state);
+    free_snapshot(snapshot);
+    if (!result) {
+        return 1;
     }
     
     return 0;
@@ -72,6 +211,19 @@ static void usage(const char* program_name) {
     printf("Usage: %s [options] [file]\n", program_name);
     printf("Options:\n");
     printf("  -l, --log-level LEVEL  Set log level (0-4, default: 1)\n");
+    printf("  -O0, -O1, -O2          Set optimization level (default: -O1)\n");
+    printf("      --stats            Print optimizer and allocation statistics\n");
+    printf("      --gc-stats         Print garbage collector statistics\n");
+    printf("      --engine ENGINE    Run files with vm (default), closure or ast\n");
+    printf("      --jit=off|on       Compile numeric declarations to x86-64 code on the vm (default: off)\n");
+    printf("      --jit-stats        Print native code statistics\n");
+    printf("      --emit-c           Print the file translated to C instead of running it\n");
+    printf("      --dump-ir          Print the file's optimized IR instead of running it\n");
+    printf("      --profile-ops FILE Count instruction pairs and triples the vm runs into FILE\n");
+    printf("      --no-cache         Do not read or write compiled .kasdc files\n");
+    printf("      --cache-dir DIR    Keep compiled .kasdc files in DIR instead of next to the source\n");
+    printf("      --snapshot FILE    Save the environment built by the file to a snapshot\n");
+    printf("      --from-snapshot FILE  Start from the environment saved in a snapshot\n");
     printf("  -h, --help             Show this help message\n");
     printf("\n");
     printf("Log Levels:\n");
@@ -83,90 +235,304 @@ static void usage(const char* program_name) {
 }
 
 // Run the REPL
-static void repl(int log_level) {
-    char line[MAX_LINE_LENGTH];
+static void repl(KasdState* state, const RunOptions* options) {
+    InputBuffer input = {NULL, 0, 0};
+    Session session;
+    
+    init_session(&session, state, options->opt_level, true, true);
+    session.engine = options->engine;
+    session_attach_snapshot(&session, options->snapshot);
     
     printf("KASD Language Interpreter v0.1\n");
     printf("Type 'exit' to quit\n");
     
     while (1) {
-        printf("> ");
-        if (!fgets(line, sizeof(line), stdin)) {
+        printf(input.length == 0 ? "> " : "... ");
+        fflush(stdout);
+        
+        size_t line_start = input.length;
+        if (!read_line(&input)) {
             break;
         }
         
         // Check for exit command
-        if (strcmp(line, "exit\n") == 0) {
+        if (line_start == 0 && strcmp(input.data, "exit\n") == 0) {
             break;
         }
         
-        // Run the line
-        run_source(line, log_level, true);
+        // Keep reading until the input is complete; an empty line submits it anyway
+        bool blank_line = strspn(input.data + line_start, " \t\r\n") == input.length - line_start;
+        if (!is_input_complete(input.data) && !blank_line) {
+            continue;
+        }
+        
+        // Run the input in the persistent session
+        if (!session_execute(&session, input.data)) {
+            print_error(state);
+        }
         
         // Clear any errors
-        clear_error();
+        clear_error(state);
+        input.length = 0;
+        input.data[0] = '\0';
+    }
+    
+    if (options->show_stats) {
+        print_optimizer_stats(&session.optimizer);
+    }
+    if (options->show_gc_stats) {
+        print_gc_stats(&session.interpreter.env.heap);
+    }
+    
+    free_session(&session);
+    free(input.data);
+    
+    // After teardown, so every runtime object shows up as freed
+    if (options->show_stats) {
+        print_pool_stats();
     }
 }
 
-// Run a file
-static bool run_file(const char* filename, int log_level) {
+// Append one line of standard input to the buffer; false at end of input
+static bool read_line(InputBuffer* input) {
+    bool read_any = false;
+    
+    while (1) {
+        if (input->capacity - input->length < MAX_LINE_LENGTH) {
+            input->capacity = input->capacity == 0 ? MAX_LINE_LENGTH : input->capacity * 2;
+            input->data = realloc(input->data, input->capacity);
+            input->data[input->length] = '\0';
+        }
+        
+        if (!fgets(input->data + input->length, (int)(input->capacity - input->length), stdin)) {
+            return read_any;
+        }
+        
+        read_any = true;
+        input->length += strlen(input->data + input->length);
+        
+        // A full buffer without a newline means the line continues
+        if (input->length > 0 && input->data[input->length - 1] == '\n') {
+            return true;
+        }
+    }
+}
+
+// Whether an input ends a statement outside of strings and parentheses
+static bool is_input_complete(const char* source) {
+    bool in_string = false;
+    int depth = 0;
+    char last = ';';
+    
+    for (const char* c = source; *c != '\0'; c++) {
+        if (in_string) {
+            in_string = *c != '"';
+            continue;
+        }
+        
+        if (c[0] == '/' && c[1] == '/') {
+            while (c[1] != '\0' && c[1] != '\n') {
+                c++;
+            }
+            continue;
+        }
+        
+        if (*c == '"') in_string = true;
+        if (*c == '(') depth++;
+        if (*c == ')') depth--;
+        if (!isspace((unsigned char)*c)) last = *c;
+    }
+    
+    return !in_string && depth <= 0 && last == ';';
+}
+
+// Run a file, from its compiled form when an up-to-date one exists
+static bool run_file(KasdState* state, const char* filename, const RunOptions* options) {
     char* source = read_file(filename);
     if (source == NULL) {
         fprintf(stderr, "Could not read file: %s\n", filename);
         return false;
     }
     
-    bool result = run_source(source, log_level, false);
+    // Compiled files hold bytecode, so the other engines start from source
+    bool use_cache = options->use_cache && options->use_vm;
+    
+    // A snapshot needs every declaration, read or not. Hashing the snapshot
+    // reads all of it, so only do that for a key that is used.
+    CompileKey key = {options->opt_level, options->snapshot_out != NULL,
+                      use_cache && options->snapshot != NULL ? snapshot_hash(options->snapshot) : 0};
+    
+    Session session;
+    init_session(&session, state, key.opt_level, false, key.export_globals);
+    session_attach_snapshot(&session, options->snapshot);
+    
+    char* compiled_path = use_cache ? compiled_file_path(filename, options->cache_dir) : NULL;
+    Chunk chunk;
+    bool loaded = compiled_path != NULL &&
+                  load_compiled_file(compiled_path, &chunk, source, &key, options->snapshot);
+    bool compiled = loaded;
+    bool result;
+    
+    if (!options->use_vm) {
+        session.engine = options->engine;
+        result = session_execute(&session, source);
+    } else {
+        if (loaded) {
+            log_message(state, LOG_INFO, "Loaded compiled script from %s", compiled_path);
+        } else {
+            compiled = session_compile(&session, source, &chunk);
+            if (compiled && compiled_path != NULL &&
+                !write_compiled_file(compiled_path, &chunk, source, &key)) {
+                log_message(state, LOG_WARNING, "Could not write compiled script to %s", compiled_path);
+            }
+        }
+        
+        JitCode* jit = NULL;
+        if (compiled && options->use_jit) {
+            jit = jit_compile(&chunk);
+            if (!jit_available()) {
+                log_message(state, LOG_WARNING, "No JIT for this platform; interpreting instead");
+            }
+            if (jit != NULL) {
+                jit->timed = options->show_jit_stats;
+            }
+        }
+        
+        // Profiles accumulate over runs, so one file can cover a corpus
+        OpProfile profile;
+        bool profiling = options->profile_path != NULL;
+        if (profiling) {
+            init_profile(&profile);
+            if (!load_profile(&profile, options->profile_path)) {
+                log_message(state, LOG_WARNING, "Could not read profile %s; starting a new one",
+                            options->profile_path);
+                free_profile(&profile);
+                init_profile(&profile);
+            }
+        }
+        
+        result = compiled && run_chunk(&session.interpreter, &chunk, jit, profiling ? &profile : NULL);
+        if (options->show_jit_stats) {
+            print_jit_stats(jit);
+        }
+        jit_free(jit);
+        
+        if (profiling) {
+            if (!save_profile(&profile, options->profile_path)) {
+                fprintf(stderr, "Could not write profile: %s\n", options->profile_path);
+            }
+            print_profile(&profile);
+            free_profile(&profile);
+        }
+    }
+    
+    if (!result) {
+        print_error(state);
+    } else if (options->snapshot_out != NULL) {
+        result = save_snapshot(&session.interpreter.env, options->snapshot_out);
+        if (!result) {
+            fprintf(stderr, "Could not write snapshot: %s\n", options->snapshot_out);
+        }
+    }
     
+    if (options->show_stats) {
+        if (loaded) {
+            fprintf(stderr, "Compiled script loaded from %s; nothing was recompiled\n", compiled_path);
+        } else {
+            print_optimizer_stats(&session.optimizer);
+            if (compiled && key.opt_level >= OPT_LEVEL_FULL) {
+                print_ir_stats(&session.ir_stats);
+            }
+            if (compiled && key.opt_level >= OPT_LEVEL_BASIC) {
+                print_peephole_stats(&session.peephole_stats);
+            }
+        }
+    }
+    if (options->show_gc_stats) {
+        print_gc_stats(&session.interpreter.env.heap);
+    }
+    
+    // Variables may share strings with the chunk, so they go first
+    free_session(&session);
+    if (compiled) {
+        free_chunk(&chunk);
+    }
+    free(compiled_path);
     free(source);
+    
+    if (options->show_stats) {
+        print_pool_stats();
+    }
     return result;
 }
 
-// Run source code
-static bool run_source(const char* source, int log_level, bool repl_mode) {
-    // Initialize components
-    Lexer lexer;
-    Parser parser;
-    SemanticAnalyzer analyzer;
-    Interpreter interpreter;
-    
-    init_lexer(&lexer, source);
-    init_parser(&parser, &lexer);
-    init_semantic_analyzer(&analyzer);
-    init_interpreter(&interpreter, repl_mode);
-    
-    // Parse
-    AstNode* ast = parse(&parser);
-    
-    // Check for parsing errors
-    if (parser.had_error || ast == NULL) {
-        print_error();
-        free_ast(ast);
+// Translate a file to C on standard output
+static bool emit_file(KasdState* state, const char* filename, const RunOptions* options) {
+    char* source = read_file(filename);
+    if (source == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
         return false;
     }
     
-    // Analyze
-    if (!analyze(&analyzer, ast)) {
-        print_error();
-        free_ast(ast);
+    // Every declaration is printed, so none may be dropped
+    Session session;
+    init_session(&session, state, options->opt_level, false, true);
+    
+    bool result = session_emit_c(&session, source, filename, stdout);
+    if (!result) {
+        print_error(state);
+    }
+    
+    if (options->show_stats) {
+        print_optimizer_stats(&session.optimizer);
+    }
+    
+    free_session(&session);
+    free(source);
+    return result;
+}
+
+// Print a file's optimized IR without running it
+static bool dump_ir_file(KasdState* state, const char* filename, const RunOptions* options) {
+    char* source = read_file(filename);
+    if (source == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
         return false;
     }
     
-    // Debug print AST if log level is high enough
-    if (log_level >= LOG_DEBUG) {
-        printf("AST:\n");
-        print_ast(ast, 0);
+    // The tree is optimized at the chosen level, keeping every declaration,
+    // and the IR passes always run
+    Session session;
+    init_session(&session, state, options->opt_level, false, true);
+    session_attach_snapshot(&session, options->snapshot);
+    
+    bool result = session_dump_ir(&session, source);
+    if (!result) {
+        print_error(state);
     }
     
-    // Interpret
-    interpret(&interpreter, ast);
+    if (options->show_stats) {
+        print_optimizer_stats(&session.optimizer);
+        print_ir_stats(&session.ir_stats);
+    }
     
-    // Clean up
-    free_ast(ast);
-    free_semantic_analyzer(&analyzer);
-    free_interpreter(&interpreter);
+    free_session(&session);
+    free(source);
+    return result;
+}
+
+// Write an environment and the snapshot under it to a new snapshot
+static bool save_snapshot(const Environment* env, const char* path) {
+    SnapshotBuilder* builder = create_snapshot_builder();
+    
+    for (EnvEntry* entry = env->head; entry != NULL; entry = entry->next) {
+        snapshot_builder_add(builder, entry->name, entry->value);
+    }
+    if (env->base != NULL) {
+        snapshot_builder_add_snapshot(builder, env->base);
+    }
     
-    return true;
+    return finish_snapshot(builder, path);
 }
 
 // Read a file into memory
@@ -0,0 +1,215 @@
+#include "../include/operators.h"
+#include <math.h>
+
+// Integer arithmetic wraps on overflow instead of invoking undefined behaviour
+static int64_t wrap_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static int64_t wrap_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static int64_t wrap_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+
+static bool is_numeric(ValueType type) {
+    return type == VALUE_INT || type == VALUE_FLOAT;
+}
+
+static double as_double(Value value) {
+    return value.type == VALUE_INT ? (double)value.data.as_int : value.data.as_float;
+}
+
+// Integer operators; the divisor has already been checked for zero
+int64_t int_arithmetic(TokenType op, int64_t a, int64_t b) {
+    switch (op) {
+        case TOKEN_PLUS:  return wrap_add(a, b);
+        case TOKEN_MINUS: return wrap_sub(a, b);
+        case TOKEN_STAR:  return wrap_mul(a, b);
+        case TOKEN_SLASH: return (b == -1) ? wrap_sub(0, a) : a / b;
+        case TOKEN_PERCENT: return (b == -1) ? 0 : a % b;
+        default: return 0;
+    }
+}
+
+double float_arithmetic(TokenType op, double a, double b) {
+    switch (op) {
+        case TOKEN_PLUS:  return a + b;
+        case TOKEN_MINUS: return a - b;
+        case TOKEN_STAR:  return a * b;
+        case TOKEN_SLASH: return a / b;
+        case TOKEN_PERCENT: return fmod(a, b);
+        default: return 0.0;
+    }
+}
+
+// Map a three-way comparison to the result of a relational operator
+bool compare_result(TokenType op, int cmp) {
+    switch (op) {
+        case TOKEN_LESS:          return cmp < 0;
+        case TOKEN_LESS_EQUAL:    return cmp <= 0;
+        case TOKEN_GREATER:       return cmp > 0;
+        case TOKEN_GREATER_EQUAL: return cmp >= 0;
+        case TOKEN_EQUAL_EQUAL:   return cmp == 0;
+        case TOKEN_BANG_EQUAL:    return cmp != 0;
+        default:                  return false;
+    }
+}
+
+// Floats compare as IEEE 754 does: NaN is unordered, so every relation
+// with it is false, except !=
+bool float_compare(TokenType op, double a, double b) {
+    switch (op) {
+        case TOKEN_LESS:          return a < b;
+        case TOKEN_LESS_EQUAL:    return a <= b;
+        case TOKEN_GREATER:       return a > b;
+        case TOKEN_GREATER_EQUAL: return a >= b;
+        case TOKEN_EQUAL_EQUAL:   return a == b;
+        case TOKEN_BANG_EQUAL:    return a != b;
+        default:                  return false;
+    }
+}
+
+// Relational operator on two values of comparable types
+static bool compare_values(TokenType op, Value left, Value right) {
+    if (left.type == VALUE_STRING) {
+        return compare_result(op, compare_string_values(left, right));
+    }
+    
+    if (left.type == VALUE_INT && right.type == VALUE_INT) {
+        return compare_result(op, (left.data.as_int > right.data.as_int) - (left.data.as_int < right.data.as_int));
+    }
+    
+    return float_compare(op, as_double(left), as_double(right));
+}
+
+static bool values_equal(Value left, Value right) {
+    if (left.type == VALUE_NULL || right.type == VALUE_NULL) {
+        return left.type == right.type;
+    }
+    
+    switch (left.type) {
+        case VALUE_BOOL:   return left.data.as_bool == right.data.as_bool;
+        case VALUE_STRING: return string_values_equal(left, right);
+        case VALUE_INT:
+            if (right.type == VALUE_INT) {
+                return left.data.as_int == right.data.as_int;
+            }
+            return as_double(left) == as_double(right);
+        default:
+            return as_double(left) == as_double(right);
+    }
+}
+
+// Apply a binary operator to two values
+bool apply_binary_operator(TokenType op, Value left, Value right, Value* result) {
+    switch (op) {
+        case TOKEN_PLUS:
+            if (left.type == VALUE_STRING && right.type == VALUE_STRING) {
+                *result = concat_string_values(left, right, NULL);
+                return true;
+            }
+            // Numeric addition
+            // fall through
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+            if (!is_numeric(left.type) || !is_numeric(right.type)) {
+                return false;
+            }
+            
+            if (left.type == VALUE_INT && right.type == VALUE_INT) {
+                if ((op == TOKEN_SLASH || op == TOKEN_PERCENT) && right.data.as_int == 0) {
+                    return false;
+                }
+                *result = create_int_value(int_arithmetic(op, left.data.as_int, right.data.as_int));
+                return true;
+            }
+            
+            *result = create_float_value(float_arithmetic(op, as_double(left), as_double(right)));
+            return true;
+            
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL: {
+            bool comparable = (is_numeric(left.type) && is_numeric(right.type)) ||
+                              (left.type == VALUE_STRING && right.type == VALUE_STRING);
+            if (!comparable) {
+                return false;
+            }
+            
+            *result = create_bool_value(compare_values(op, left, right));
+            return true;
+        }
+        
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL: {
+            bool comparable = left.type == right.type ||
+                              left.type == VALUE_NULL || right.type == VALUE_NULL ||
+                              (is_numeric(left.type) && is_numeric(right.type));
+            if (!comparable) {
+                return false;
+            }
+            
+            bool equal = values_equal(left, right);
+            *result = create_bool_value(op == TOKEN_EQUAL_EQUAL ? equal : !equal);
+            return true;
+        }
+        
+        case TOKEN_AND_AND:
+        case TOKEN_OR_OR:
+            if (left.type != VALUE_BOOL || right.type != VALUE_BOOL) {
+                return false;
+            }
+            *result = create_bool_value(op == TOKEN_AND_AND
+                                        ? left.data.as_bool && right.data.as_bool
+                                        : left.data.as_bool || right.data.as_bool);
+            return true;
+            
+        default:
+            return false;
+    }
+}
+
+// Apply a unary operator to a value
+bool apply_unary_operator(TokenType op, Value operand, Value* result) {
+    switch (op) {
+        case TOKEN_MINUS:
+            if (operand.type == VALUE_INT) {
+                *result = create_int_value(wrap_sub(0, operand.data.as_int));
+                return true;
+            }
+            if (operand.type == VALUE_FLOAT) {
+                *result = create_float_value(-operand.data.as_float);
+                return true;
+            }
+            return false;
+            
+        case TOKEN_BANG:
+            if (operand.type != VALUE_BOOL) {
+                return false;
+            }
+            *result = create_bool_value(!operand.data.as_bool);
+            return true;
+            
+        default:
+            return false;
+    }
+}
+
+// Source spelling of an operator token
+const char* operator_to_string(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS:          return "+";
+        case TOKEN_MINUS:         return "-";
+        case TOKEN_STAR:          return "*";
+        case TOKEN_SLASH:         return "/";
+        case TOKEN_PERCENT:       return "%";
+        case TOKEN_BANG:          return "!";
+        case TOKEN_BANG_EQUAL:    return "!=";
+        case TOKEN_EQUAL_EQUAL:   return "==";
+        case TOKEN_LESS:          return "<";
+        case TOKEN_LESS_EQUAL:    return "<=";
+        case TOKEN_GREATER:       return ">";
+        case TOKEN_GREATER_EQUAL: return ">=";
+        case TOKEN_AND_AND:       return "&&";
+        case TOKEN_OR_OR:         return "||";
+        default:                  return "?";
+    }
+}
@@ -0,0 +1,367 @@
+#include "../include/optimizer.h"
+#include "../include/operators.h"
+#include "../include/intern.h"
+
+// Forward declarations
+static AstNode* optimize_expression(Optimizer* optimizer, AstNode* node);
+static void optimize_variable_declaration(Optimizer* optimizer, AstNode* node);
+static void remove_dead_declarations(Optimizer* optimizer, AstNode* program);
+static int count_nodes(AstNode* node);
+
+// Constant table operations
+static void add_constant(Optimizer* optimizer, const char* name, AstNode* literal);
+static bool find_constant(Optimizer* optimizer, const char* name, Value* value);
+
+// Initialize optimizer
+void init_optimizer(Optimizer* optimizer, KasdState* state, int level, bool export_globals) {
+    optimizer->state = state;
+    optimizer->level = level;
+    optimizer->export_globals = export_globals;
+    optimizer->constants = NULL;
+    optimizer->snapshot = NULL;
+    memset(&optimizer->stats, 0, sizeof(optimizer->stats));
+}
+
+// Optimize an analyzed AST in place
+void optimize(Optimizer* optimizer, AstNode* node) {
+    int nodes = count_nodes(node);
+    optimizer->stats.nodes_before += nodes;
+    
+    if (optimizer->level >= OPT_LEVEL_BASIC && node != NULL) {
+        log_message(optimizer->state, LOG_DEBUG, "Starting optimization");
+        
+        if (node->type == NODE_PROGRAM) {
+            for (int i = 0; i < node->as.program.count; i++) {
+                optimize_variable_declaration(optimizer, node->as.program.declarations[i]);
+            }
+            
+            if (!optimizer->export_globals) {
+                remove_dead_declarations(optimizer, node);
+            }
+        } else if (node->type == NODE_VARIABLE_DECLARATION) {
+            optimize_variable_declaration(optimizer, node);
+        }
+        
+        nodes = count_nodes(node);
+    }
+    
+    optimizer->stats.nodes_after += nodes;
+}
+
+// Fold a declaration's initializer and remember it if it became constant.
+// Variables are never reassigned, so a literal initializer holds for
+// every later use.
+static void optimize_variable_declaration(Optimizer* optimizer, AstNode* node) {
+    node->as.var_decl.initializer = optimize_expression(optimizer, node->as.var_decl.initializer);
+    
+    if (node->as.var_decl.initializer->type == NODE_LITERAL) {
+        add_constant(optimizer, node->as.var_decl.name, node->as.var_decl.initializer);
+    }
+}
+
+// Turn node into a literal holding value, releasing its children
+static AstNode* replace_with_literal(Optimizer* optimizer, AstNode* node, Value value) {
+    AstNode* literal = create_node(NODE_LITERAL, node->line, node->column);
+    literal->value_type = node->value_type;
+    literal->as.literal = intern_value(value);
+    
+    free_ast(node);
+    optimizer->stats.expressions_folded++;
+    return literal;
+}
+
+// Keep one child of a node, releasing the node and its other children
+static AstNode* replace_with_child(AstNode* node, AstNode* child) {
+    if (node->as.binary.left == child) {
+        node->as.binary.left = NULL;
+    } else {
+        node->as.binary.right = NULL;
+    }
+    
+    free_ast(node);
+    return child;
+}
+
+// Propagate constants into an expression and fold the result bottom-up
+static AstNode* optimize_expression(Optimizer* optimizer, AstNode* node) {
+    Value result;
+    
+    switch (node->type) {
+        case NODE_VARIABLE: {
+            Value value;
+            if (!find_constant(optimizer, node->as.variable.name, &value)) {
+                return node;
+            }
+            
+            AstNode* copy = create_node(NODE_LITERAL, node->line, node->column);
+            copy->value_type = node->value_type;
+            copy->as.literal = copy_value(value);
+            
+            free_ast(node);
+            optimizer->stats.constants_propagated++;
+            return copy;
+        }
+        
+        case NODE_UNARY: {
+            node->as.unary.operand = optimize_expression(optimizer, node->as.unary.operand);
+            AstNode* operand = node->as.unary.operand;
+            
+            if (operand->type == NODE_LITERAL &&
+                apply_unary_operator(node->as.unary.op, operand->as.literal, &result)) {
+                return replace_with_literal(optimizer, node, result);
+            }
+            return node;
+        }
+        
+        case NODE_CONVERT: {
+            node->as.convert.operand = optimize_expression(optimizer, node->as.convert.operand);
+            AstNode* operand = node->as.convert.operand;
+            
+            if (operand->type == NODE_LITERAL) {
+                result = create_float_value((double)operand->as.literal.data.as_int);
+                return replace_with_literal(optimizer, node, result);
+            }
+            return node;
+        }
+        
+        case NODE_BINARY: {
+            TokenType op = node->as.binary.op;
+            node->as.binary.left = optimize_expression(optimizer, node->as.binary.left);
+            node->as.binary.right = optimize_expression(optimizer, node->as.binary.right);
+            AstNode* left = node->as.binary.left;
+            AstNode* right = node->as.binary.right;
+            
+            // A constant left operand decides && and || on its own
+            if ((op == TOKEN_AND_AND || op == TOKEN_OR_OR) && left->type == NODE_LITERAL) {
+                optimizer->stats.expressions_folded++;
+                bool decided = left->as.literal.data.as_bool == (op == TOKEN_OR_OR);
+                return replace_with_child(node, decided ? left : right);
+            }
+            
+            // Division by a zero constant is left to fail at runtime
+            if (left->type == NODE_LITERAL && right->type == NODE_LITERAL &&
+                apply_binary_operator(op, left->as.literal, right->as.literal, &result)) {
+                return replace_with_literal(optimizer, node, result);
+            }
+            return node;
+        }
+        
+        default:
+            return node;
+    }
+}
+
+// Whether evaluating an expression can fail at runtime. Only integer
+// division and modulo can, unless the divisor is a non-zero constant.
+static bool may_trap(AstNode* node) {
+    switch (node->type) {
+        case NODE_UNARY:
+            return may_trap(node->as.unary.operand);
+        case NODE_CONVERT:
+            return may_trap(node->as.convert.operand);
+        case NODE_BINARY: {
+            AstNode* right = node->as.binary.right;
+            TokenType op = node->as.binary.op;
+            
+            if ((op == TOKEN_SLASH || op == TOKEN_PERCENT) && node->value_type == VALUE_INT &&
+                (right->type != NODE_LITERAL || right->as.literal.data.as_int == 0)) {
+                return true;
+            }
+            return may_trap(node->as.binary.left) || may_trap(right);
+        }
+        default:
+            return false;
+    }
+}
+
+// Find the liveness entry for a variable
+static LivenessEntry* find_liveness(LivenessEntry* list, const char* name) {
+    for (LivenessEntry* entry = list; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Add delta to the read count of every variable an expression reads
+static void count_reads(LivenessEntry* list, AstNode* node, int delta) {
+    switch (node->type) {
+        case NODE_VARIABLE: {
+            LivenessEntry* entry = find_liveness(list, node->as.variable.name);
+            if (entry != NULL) {
+                entry->reads += delta;
+            }
+            break;
+        }
+        case NODE_UNARY:
+            count_reads(list, node->as.unary.operand, delta);
+            break;
+        case NODE_CONVERT:
+            count_reads(list, node->as.convert.operand, delta);
+            break;
+        case NODE_BINARY:
+            count_reads(list, node->as.binary.left, delta);
+            count_reads(list, node->as.binary.right, delta);
+            break;
+        default:
+            break;
+    }
+}
+
+// Forget the constant recorded for a literal initializer, which points
+// into the declaration about to be freed
+static void remove_constant(Optimizer* optimizer, const AstNode* literal) {
+    for (ConstantEntry** link = &optimizer->constants; *link != NULL; link = &(*link)->next) {
+        if ((*link)->literal == literal) {
+            ConstantEntry* entry = *link;
+            *link = entry->next;
+            free(entry);
+            return;
+        }
+    }
+}
+
+// Drop declarations that are never read and cannot fail. Declarations
+// only read earlier ones, so one backward sweep also catches variables
+// whose only readers were removed.
+static void remove_dead_declarations(Optimizer* optimizer, AstNode* program) {
+    AstNode** declarations = program->as.program.declarations;
+    int count = program->as.program.count;
+    LivenessEntry* liveness = NULL;
+    
+    for (int i = 0; i < count; i++) {
+        LivenessEntry* entry = malloc(sizeof(LivenessEntry));
+        entry->name = declarations[i]->as.var_decl.name;
+        entry->reads = 0;
+        entry->next = liveness;
+        liveness = entry;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        count_reads(liveness, declarations[i]->as.var_decl.initializer, 1);
+    }
+    
+    for (int i = count - 1; i >= 0; i--) {
+        AstNode* decl = declarations[i];
+        LivenessEntry* entry = find_liveness(liveness, decl->as.var_decl.name);
+        
+        if (entry->reads > 0 || may_trap(decl->as.var_decl.initializer)) {
+            continue;
+        }
+        
+        log_message(optimizer->state, LOG_INFO, "Removed unused declaration '%s' at line %d",
+                    decl->as.var_decl.name, decl->line);
+        
+        count_reads(liveness, decl->as.var_decl.initializer, -1);
+        entry->name = "";  // The name is freed with the declaration
+        remove_constant(optimizer, decl->as.var_decl.initializer);
+        free_ast(decl);
+        declarations[i] = NULL;
+        optimizer->stats.declarations_removed++;
+    }
+    
+    // Compact the surviving declarations
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (declarations[i] != NULL) {
+            declarations[kept++] = declarations[i];
+        }
+    }
+    program->as.program.count = kept;
+    
+    while (liveness != NULL) {
+        LivenessEntry* next = liveness->next;
+        free(liveness);
+        liveness = next;
+    }
+}
+
+// Count the nodes in a tree
+static int count_nodes(AstNode* node) {
+    if (node == NULL) {
+        return 0;
+    }
+    
+    switch (node->type) {
+        case NODE_PROGRAM: {
+            int count = 1;
+            for (int i = 0; i < node->as.program.count; i++) {
+                count += count_nodes(node->as.program.declarations[i]);
+            }
+            return count;
+        }
+        case NODE_VARIABLE_DECLARATION:
+            return 1 + count_nodes(node->as.var_decl.initializer);
+        case NODE_UNARY:
+            return 1 + count_nodes(node->as.unary.operand);
+        case NODE_BINARY:
+            return 1 + count_nodes(node->as.binary.left) + count_nodes(node->as.binary.right);
+        case NODE_CONVERT:
+            return 1 + count_nodes(node->as.convert.operand);
+        default:
+            return 1;
+    }
+}
+
+// Print optimizer statistics
+void print_optimizer_stats(Optimizer* optimizer) {
+    fprintf(stderr, "Optimizer statistics (-O%d):\n", optimizer->level);
+    fprintf(stderr, "  Nodes before:          %d\n", optimizer->stats.nodes_before);
+    fprintf(stderr, "  Nodes after:           %d\n", optimizer->stats.nodes_after);
+    fprintf(stderr, "  Nodes eliminated:      %d\n",
+            optimizer->stats.nodes_before - optimizer->stats.nodes_after);
+    fprintf(stderr, "  Constants propagated:  %d\n", optimizer->stats.constants_propagated);
+    fprintf(stderr, "  Expressions folded:    %d\n", optimizer->stats.expressions_folded);
+    fprintf(stderr, "  Declarations removed:  %d\n", optimizer->stats.declarations_removed);
+}
+
+// Remember a constant; the literal stays owned by its declaration
+static void add_constant(Optimizer* optimizer, const char* name, AstNode* literal) {
+    ConstantEntry* entry = malloc(sizeof(ConstantEntry));
+    entry->name = name;
+    entry->literal = literal;
+    entry->next = optimizer->constants;
+    optimizer->constants = entry;
+    
+    log_message(optimizer->state, LOG_DEBUG, "Tracking constant: %s", name);
+}
+
+// Find a constant by variable name; the value is borrowed
+static bool find_constant(Optimizer* optimizer, const char* name, Value* value) {
+    for (ConstantEntry* entry = optimizer->constants; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            *value = entry->literal->as.literal;
+            return true;
+        }
+    }
+    return snapshot_lookup(optimizer->snapshot, name, value);
+}
+
+// Forget the constant recorded for a variable
+void forget_constant(Optimizer* optimizer, const char* name) {
+    for (ConstantEntry** link = &optimizer->constants; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            ConstantEntry* entry = *link;
+            *link = entry->next;
+            free(entry);
+            return;
+        }
+    }
+}
+
+// Forget constants recorded after mark
+void rollback_constants(Optimizer* optimizer, ConstantEntry* mark) {
+    ConstantEntry* current = optimizer->constants;
+    while (current != NULL && current != mark) {
+        ConstantEntry* next = current->next;
+        free(current);
+        current = next;
+    }
+    optimizer->constants = mark;
+}
+
+// Clean up optimizer
+void free_optimizer(Optimizer* optimizer) {
+    rollback_constants(optimizer, NULL);
+}
@@ -1,18 +1,83 @@
 #include "../include/parser.h"
+#include "../include/operators.h"
+#include "../include/intern.h"
+
+// Operator precedence, lowest to highest
+typedef enum {
+    PREC_NONE,
+    PREC_OR,          // ||
+    PREC_AND,         // &&
+    PREC_EQUALITY,    // == !=
+    PREC_COMPARISON,  // < <= > >=
+    PREC_TERM,        // + -
+    PREC_FACTOR,      // * / %
+    PREC_UNARY,       // ! -
+    PREC_PRIMARY
+} Precedence;
+
+typedef AstNode* (*PrefixParseFn)(Parser* parser);
+typedef AstNode* (*InfixParseFn)(Parser* parser, AstNode* left);
+
+// Pratt parse rule for a token
+typedef struct {
+    PrefixParseFn prefix;
+    InfixParseFn infix;
+    Precedence precedence;
+} ParseRule;
 
 // Forward declarations
 static AstNode* parse_declaration(Parser* parser);
 static AstNode* parse_variable_declaration(Parser* parser);
 static AstNode* parse_expression(Parser* parser);
+static AstNode* parse_precedence(Parser* parser, Precedence precedence);
 static AstNode* parse_literal(Parser* parser);
+static AstNode* parse_variable(Parser* parser);
+static AstNode* parse_grouping(Parser* parser);
+static AstNode* parse_unary(Parser* parser);
+static AstNode* parse_binary(Parser* parser, AstNode* left);
+static AstNode* fold_constants(Parser* parser, AstNode* node);
 static ValueType token_to_value_type(TokenType type);
 
+// Parse rule table, indexed by token type
+static const ParseRule rules[] = {
+    [TOKEN_IDENTIFIER]    = {parse_variable, NULL,         PREC_NONE},
+    [TOKEN_INT]           = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_FLOAT]         = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_STRING]        = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_TRUE]          = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_FALSE]         = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_NULL]          = {parse_literal,  NULL,         PREC_NONE},
+    [TOKEN_LEFT_PAREN]    = {parse_grouping, NULL,         PREC_NONE},
+    [TOKEN_PLUS]          = {NULL,           parse_binary, PREC_TERM},
+    [TOKEN_MINUS]         = {parse_unary,    parse_binary, PREC_TERM},
+    [TOKEN_STAR]          = {NULL,           parse_binary, PREC_FACTOR},
+    [TOKEN_SLASH]         = {NULL,           parse_binary, PREC_FACTOR},
+    [TOKEN_PERCENT]       = {NULL,           parse_binary, PREC_FACTOR},
+    [TOKEN_BANG]          = {parse_unary,    NULL,         PREC_NONE},
+    [TOKEN_BANG_EQUAL]    = {NULL,           parse_binary, PREC_EQUALITY},
+    [TOKEN_EQUAL_EQUAL]   = {NULL,           parse_binary, PREC_EQUALITY},
+    [TOKEN_LESS]          = {NULL,           parse_binary, PREC_COMPARISON},
+    [TOKEN_LESS_EQUAL]    = {NULL,           parse_binary, PREC_COMPARISON},
+    [TOKEN_GREATER]       = {NULL,           parse_binary, PREC_COMPARISON},
+    [TOKEN_GREATER_EQUAL] = {NULL,           parse_binary, PREC_COMPARISON},
+    [TOKEN_AND_AND]       = {NULL,           parse_binary, PREC_AND},
+    [TOKEN_OR_OR]         = {NULL,           parse_binary, PREC_OR},
+};
+
+#define RULES_COUNT (sizeof(rules) / sizeof(rules[0]))
+
+// Get the parse rule for a token type
+static const ParseRule* get_rule(TokenType type) {
+    static const ParseRule no_rule = {NULL, NULL, PREC_NONE};
+    return (size_t)type < RULES_COUNT ? &rules[type] : &no_rule;
+}
+
 // Advance to the next token
 static void advance(Parser* parser) {
     parser->previous = parser->current;
     parser->current = scan_token(parser->lexer);
     
-    log_message(LOG_DEBUG, "Advanced to token: %s", token_type_to_string(parser->current.type));
+    log_message(parser->lexer->state, LOG_DEBUG, "Advanced to token: %s", token_type_to_string(parser->current.type));
 }
 
 // Check if the current token is of the given type
@@ -36,7 +101,7 @@ static bool consume(Parser* parser, TokenType type, const char* message) {
         return true;
     }
     
-    set_error(ERROR_SYNTAX, parser->current.line, parser->current.column, 
+    set_error(parser->lexer->state, ERROR_SYNTAX, parser->current.line, parser->current.column, 
               message, parser->lexer->source, 
               (int)(parser->current.start - parser->lexer->source), 
               parser->current.length);
@@ -46,9 +111,11 @@ static bool consume(Parser* parser, TokenType type, const char* message) {
 }
 
 // Create a new AST node
-static AstNode* create_node(NodeType type, int line, int column) {
+AstNode* create_node(NodeType type, int line, int column) {
     AstNode* node = malloc(sizeof(AstNode));
     node->type = type;
+    node->value_type = VALUE_NULL;
+    node->quick = QUICK_NONE;
     node->line = line;
     node->column = column;
     return node;
@@ -62,27 +129,46 @@ void init_parser(Parser* parser, Lexer* lexer) {
     advance(parser); // Prime the parser with the first token
 }
 
+// Append a declaration to a program node
+static void add_declaration(AstNode* program, AstNode* declaration) {
+    if (program->as.program.count == program->as.program.capacity) {
+        int capacity = program->as.program.capacity < 8 ? 8 : program->as.program.capacity * 2;
+        program->as.program.declarations = realloc(program->as.program.declarations,
+                                                   sizeof(AstNode*) * capacity);
+        program->as.program.capacity = capacity;
+    }
+    program->as.program.declarations[program->as.program.count++] = declaration;
+}
+
 // Parse source code into AST
 AstNode* parse(Parser* parser) {
-    log_message(LOG_DEBUG, "Starting parsing");
+    log_message(parser->lexer->state, LOG_DEBUG, "Starting parsing");
     
-    AstNode* node = parse_declaration(parser);
+    AstNode* program = create_node(NODE_PROGRAM, 1, 1);
+    program->as.program.declarations = NULL;
+    program->as.program.count = 0;
+    program->as.program.capacity = 0;
     
-    // Check for end of file
-    if (!check(parser, TOKEN_EOF) && !parser->had_error) {
-        set_error(ERROR_SYNTAX, parser->current.line, parser->current.column,
-                 "Expected end of file.", parser->lexer->source,
-                 (int)(parser->current.start - parser->lexer->source),
-                 parser->current.length);
+    // Parse declarations until end of file or the first error
+    while (!check(parser, TOKEN_EOF) && !parser->had_error) {
+        AstNode* declaration = parse_declaration(parser);
+        if (declaration == NULL) {
+            break;
+        }
+        add_declaration(program, declaration);
+    }
+    
+    // A lexer error surfaces as an EOF token
+    if (parser->lexer->had_error) {
         parser->had_error = true;
     }
     
-    return node;
+    return program;
 }
 
 // Parse a declaration
 static AstNode* parse_declaration(Parser* parser) {
-    log_message(LOG_DEBUG, "Parsing declaration");
+    log_message(parser->lexer->state, LOG_DEBUG, "Parsing declaration");
     
     // Currently we only support variable declarations
     return parse_variable_declaration(parser);
@@ -90,7 +176,7 @@ static AstNode* parse_declaration(Parser* parser) {
 
 // Parse a variable declaration: let name: type = value;
 static AstNode* parse_variable_declaration(Parser* parser) {
-    log_message(LOG_DEBUG, "Parsing variable declaration");
+    log_message(parser->lexer->state, LOG_DEBUG, "Parsing variable declaration");
     
     // Check for 'let' keyword
     if (!consume(parser, TOKEN_LET, "Expected 'let' keyword.")) {
@@ -110,16 +196,16 @@ static AstNode* parse_variable_declaration(Parser* parser) {
         return NULL;
     }
     
-    // Get variable type
-    TokenType type_tokens[] = {
+    // Get variable type ('null' lexes as the null literal keyword)
+    static const TokenType type_tokens[] = {
         TOKEN_TYPE_INT, TOKEN_TYPE_FLOAT, TOKEN_TYPE_BOOL, 
-        TOKEN_TYPE_STRING, TOKEN_TYPE_NULL
+        TOKEN_TYPE_STRING, TOKEN_TYPE_NULL, TOKEN_NULL
     };
     
     bool found_type = false;
     TokenType type_token = TOKEN_EOF;
     
-    for (int i = 0; i < 5; i++) {
+    for (size_t i = 0; i < sizeof(type_tokens) / sizeof(type_tokens[0]); i++) {
         if (match(parser, type_tokens[i])) {
             found_type = true;
             type_token = type_tokens[i];
@@ -128,7 +214,7 @@ static AstNode* parse_variable_declaration(Parser* parser) {
     }
     
     if (!found_type) {
-        set_error(ERROR_SYNTAX, parser->current.line, parser->current.column,
+        set_error(parser->lexer->state, ERROR_SYNTAX, parser->current.line, parser->current.column,
                  "Expected type (int, float, bool, string, or null).", 
                  parser->lexer->source,
                  (int)(parser->current.start - parser->lexer->source),
@@ -168,15 +254,130 @@ static AstNode* parse_variable_declaration(Parser* parser) {
 
 // Parse an expression
 static AstNode* parse_expression(Parser* parser) {
-    log_message(LOG_DEBUG, "Parsing expression");
+    log_message(parser->lexer->state, LOG_DEBUG, "Parsing expression");
     
-    // Currently we only support literals
-    return parse_literal(parser);
+    return parse_precedence(parser, PREC_OR);
+}
+
+// Parse an expression whose operators bind at least as tightly as precedence
+static AstNode* parse_precedence(Parser* parser, Precedence precedence) {
+    PrefixParseFn prefix = get_rule(parser->current.type)->prefix;
+    if (prefix == NULL) {
+        set_error(parser->lexer->state, ERROR_SYNTAX, parser->current.line, parser->current.column,
+                 "Expected expression.", parser->lexer->source,
+                 (int)(parser->current.start - parser->lexer->source),
+                 parser->current.length);
+        parser->had_error = true;
+        return NULL;
+    }
+    
+    AstNode* left = prefix(parser);
+    
+    while (left != NULL && precedence <= get_rule(parser->current.type)->precedence) {
+        left = get_rule(parser->current.type)->infix(parser, left);
+    }
+    
+    return left;
+}
+
+// Parse a variable reference
+static AstNode* parse_variable(Parser* parser) {
+    AstNode* node = create_node(NODE_VARIABLE, parser->current.line, parser->current.column);
+    node->as.variable.name = strndup(parser->current.start, parser->current.length);
+    advance(parser);
+    return node;
+}
+
+// Parse a parenthesized expression
+static AstNode* parse_grouping(Parser* parser) {
+    advance(parser); // Consume '('
+    
+    AstNode* node = parse_expression(parser);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    if (!consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after expression.")) {
+        free_ast(node);
+        return NULL;
+    }
+    
+    return node;
+}
+
+// Parse a prefix operator: -x or !x
+static AstNode* parse_unary(Parser* parser) {
+    Token op = parser->current;
+    advance(parser);
+    
+    AstNode* operand = parse_precedence(parser, PREC_UNARY);
+    if (operand == NULL) {
+        return NULL;
+    }
+    
+    AstNode* node = create_node(NODE_UNARY, op.line, op.column);
+    node->as.unary.op = op.type;
+    node->as.unary.operand = operand;
+    
+    return fold_constants(parser, node);
+}
+
+// Parse a left-associative infix operator
+static AstNode* parse_binary(Parser* parser, AstNode* left) {
+    Token op = parser->current;
+    advance(parser);
+    
+    AstNode* right = parse_precedence(parser, get_rule(op.type)->precedence + 1);
+    if (right == NULL) {
+        free_ast(left);
+        return NULL;
+    }
+    
+    AstNode* node = create_node(NODE_BINARY, op.line, op.column);
+    node->as.binary.op = op.type;
+    node->as.binary.left = left;
+    node->as.binary.right = right;
+    
+    return fold_constants(parser, node);
+}
+
+// Collapse an operator whose operands are all literals into a single literal.
+// Ill-typed or trapping operations are left in place for the semantic
+// analyzer and interpreter to report.
+static AstNode* fold_constants(Parser* parser, AstNode* node) {
+    Value result;
+    
+    if (node->type == NODE_UNARY) {
+        AstNode* operand = node->as.unary.operand;
+        if (operand->type != NODE_LITERAL ||
+            !apply_unary_operator(node->as.unary.op, operand->as.literal, &result)) {
+            return node;
+        }
+        free_ast(operand);
+    } else if (node->type == NODE_BINARY) {
+        AstNode* left = node->as.binary.left;
+        AstNode* right = node->as.binary.right;
+        if (left->type != NODE_LITERAL || right->type != NODE_LITERAL ||
+            !apply_binary_operator(node->as.binary.op, left->as.literal,
+                                   right->as.literal, &result)) {
+            return node;
+        }
+        free_ast(left);
+        free_ast(right);
+    } else {
+        return node;
+    }
+    
+    log_message(parser->lexer->state, LOG_DEBUG, "Folded constant expression at line %d", node->line);
+    
+    node->type = NODE_LITERAL;
+    node->as.literal = intern_value(result);
+    return node;
 }
 
 // Parse a literal value
 static AstNode* parse_literal(Parser* parser) {
-    log_message(LOG_DEBUG, "Parsing literal");
+    log_message(parser->lexer->state, LOG_DEBUG, "Parsing literal");
     
     AstNode* node = NULL;
     
@@ -196,7 +397,8 @@ static AstNode* parse_literal(Parser* parser) {
         }
         case TOKEN_STRING: {
             node = create_node(NODE_LITERAL, parser->current.line, parser->current.column);
-            node->as.literal = create_string_value(parser->current.value.as_string);
+            node->as.literal = create_interned_string_value(parser->current.value.as_string.chars,
+                                                            parser->current.value.as_string.length);
             advance(parser);
             break;
         }
@@ -219,8 +421,8 @@ static AstNode* parse_literal(Parser* parser) {
             break;
         }
         default: {
-            set_error(ERROR_SYNTAX, parser->current.line, parser->current.column,
-                     "Expected literal value.", parser->lexer->source,
+            set_error(parser->lexer->state, ERROR_SYNTAX, parser->current.line, parser->current.column,
+                     "Expected expression.", parser->lexer->source,
                      (int)(parser->current.start - parser->lexer->source),
                      parser->current.length);
             parser->had_error = true;
@@ -238,7 +440,8 @@ static ValueType token_to_value_type(TokenType type) {
         [TOKEN_TYPE_FLOAT] = VALUE_FLOAT,
         [TOKEN_TYPE_BOOL] = VALUE_BOOL,
         [TOKEN_TYPE_STRING] = VALUE_STRING,
-        [TOKEN_TYPE_NULL] = VALUE_NULL
+        [TOKEN_TYPE_NULL] = VALUE_NULL,
+        [TOKEN_NULL] = VALUE_NULL
     };
     
     return type_map[type];
@@ -251,6 +454,12 @@ void free_ast(AstNode* node) {
     }
     
     switch (node->type) {
+        case NODE_PROGRAM:
+            for (int i = 0; i < node->as.program.count; i++) {
+                free_ast(node->as.program.declarations[i]);
+            }
+            free(node->as.program.declarations);
+            break;
         case NODE_VARIABLE_DECLARATION:
             free(node->as.var_decl.name);
             free_ast(node->as.var_decl.initializer);
@@ -258,6 +467,19 @@ void free_ast(AstNode* node) {
         case NODE_LITERAL:
             free_value(node->as.literal);
             break;
+        case NODE_VARIABLE:
+            free(node->as.variable.name);
+            break;
+        case NODE_UNARY:
+            free_ast(node->as.unary.operand);
+            break;
+        case NODE_BINARY:
+            free_ast(node->as.binary.left);
+            free_ast(node->as.binary.right);
+            break;
+        case NODE_CONVERT:
+            free_ast(node->as.convert.operand);
+            break;
     }
     
     free(node);
@@ -275,6 +497,14 @@ void print_ast(AstNode* node, int indent) {
     }
     
     switch (node->type) {
+        case NODE_PROGRAM: {
+            printf("Program (%d declarations)\n", node->as.program.count);
+            
+            for (int i = 0; i < node->as.program.count; i++) {
+                print_ast(node->as.program.declarations[i], indent + 1);
+            }
+            break;
+        }
         case NODE_VARIABLE_DECLARATION: {
             printf("VariableDeclaration: %s (type: %s)\n", 
                    node->as.var_decl.name, 
@@ -291,5 +521,25 @@ void print_ast(AstNode* node, int indent) {
             free(value_str);
             break;
         }
+        case NODE_VARIABLE: {
+            printf("Variable: %s\n", node->as.variable.name);
+            break;
+        }
+        case NODE_UNARY: {
+            printf("Unary: %s\n", operator_to_string(node->as.unary.op));
+            print_ast(node->as.unary.operand, indent + 1);
+            break;
+        }
+        case NODE_BINARY: {
+            printf("Binary: %s\n", operator_to_string(node->as.binary.op));
+            print_ast(node->as.binary.left, indent + 1);
+            print_ast(node->as.binary.right, indent + 1);
+            break;
+        }
+        case NODE_CONVERT: {
+            printf("Convert: %s\n", value_type_to_string(node->value_type));
+            print_ast(node->as.convert.operand, indent + 1);
+            break;
+        }
     }
 }
@@ -0,0 +1,228 @@
+#include "../include/peephole.h"
+
+// Rewriting state for one round over a chunk
+typedef struct {
+    Chunk* chunk;
+    bool* removed;  // Dropped when the round ends
+    bool* target;   // Some jump lands here; one entry past the end
+    int* reads;     // OP_GET_LOCAL instructions reading each slot
+} Peephole;
+
+static void remove_instruction(Peephole* peephole, int i) {
+    const Instruction* instruction = &peephole->chunk->code[i];
+    if (instruction->op == OP_GET_LOCAL) {
+        peephole->reads[instruction->operand]--;
+    }
+    peephole->removed[i] = true;
+}
+
+static bool is_jump(uint8_t op) {
+    return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+// A pair whose second instruction undoes the first
+static bool drop_pair(Peephole* peephole, int i) {
+    remove_instruction(peephole, i);
+    remove_instruction(peephole, i + 1);
+    return true;
+}
+
+// GET_LOCAL n; SET_LOCAL n stores what the slot already holds
+static bool drop_same_local(Peephole* peephole, int i) {
+    const Instruction* code = peephole->chunk->code;
+    return code[i].operand == code[i + 1].operand && drop_pair(peephole, i);
+}
+
+// SET_LOCAL n; GET_LOCAL n with no other read leaves the value on the stack
+static bool drop_only_read(Peephole* peephole, int i) {
+    const Instruction* code = peephole->chunk->code;
+    return code[i].operand == code[i + 1].operand && peephole->reads[code[i].operand] == 1 &&
+           drop_pair(peephole, i);
+}
+
+// A jump to a jump on the same condition, which is still on the stack,
+// goes straight to where that one goes; a jump to a jump on the opposite
+// condition goes past it
+static bool thread_jump(Peephole* peephole, int i) {
+    Chunk* chunk = peephole->chunk;
+    int next = chunk->code[i].operand;
+    if (next >= chunk->code_count || peephole->removed[next] || !is_jump(chunk->code[next].op)) {
+        return false;
+    }
+    
+    int target = chunk->code[next].op == chunk->code[i].op ? chunk->code[next].operand : next + 1;
+    chunk->code[i].operand = target;
+    peephole->target[target] = true;
+    return true;
+}
+
+// A jump on a constant condition: one never taken is dropped; one always
+// taken drops the code it skips, unless another jump lands in it
+static bool fold_constant_jump(Peephole* peephole, int i) {
+    Chunk* chunk = peephole->chunk;
+    const Constant* constant = &chunk->constants[chunk->code[i].operand];
+    if (constant->type != VALUE_BOOL) {
+        return false;
+    }
+    
+    int jump = i + 1;
+    bool taken = (chunk->code[jump].op == OP_JUMP_IF_TRUE) == (constant->data.as_bool != 0);
+    if (!taken) {
+        remove_instruction(peephole, jump);
+        return true;
+    }
+    
+    int end = chunk->code[jump].operand;
+    for (int j = 0; j < chunk->code_count; j++) {
+        bool outside = j < jump || j >= end;
+        int landing = chunk->code[j].operand;
+        if (outside && !peephole->removed[j] && is_jump(chunk->code[j].op) && landing > jump && landing < end) {
+            return false;
+        }
+    }
+    
+    for (int j = jump; j < end; j++) {
+        if (!peephole->removed[j]) {
+            remove_instruction(peephole, j);
+        }
+    }
+    return true;
+}
+
+// A rule rewrites a sequence of instructions starting with pattern. No
+// instruction of the sequence but the first may be a jump target, so every
+// path into the sequence runs all of it.
+typedef struct {
+    const char* name;
+    int length;
+    OpCode pattern[2];
+    bool (*apply)(Peephole* peephole, int i);  // Rewrite at i; false if it does not apply
+} PeepholeRule;
+
+static const PeepholeRule rules[PEEPHOLE_RULE_COUNT] = {
+    // Loads and stores with no effect
+    {"constant-pop", 2, {OP_CONSTANT, OP_POP}, drop_pair},
+    {"get-local-pop", 2, {OP_GET_LOCAL, OP_POP}, drop_pair},
+    {"get-set-local", 2, {OP_GET_LOCAL, OP_SET_LOCAL}, drop_same_local},
+    {"set-get-local", 2, {OP_SET_LOCAL, OP_GET_LOCAL}, drop_only_read},
+    
+    // Jumps
+    {"thread-jump-if-false", 1, {OP_JUMP_IF_FALSE}, thread_jump},
+    {"thread-jump-if-true", 1, {OP_JUMP_IF_TRUE}, thread_jump},
+    {"constant-jump-if-false", 2, {OP_CONSTANT, OP_JUMP_IF_FALSE}, fold_constant_jump},
+    {"constant-jump-if-true", 2, {OP_CONSTANT, OP_JUMP_IF_TRUE}, fold_constant_jump},
+    
+    // Operators that cancel out
+    {"not-not", 2, {OP_NOT, OP_NOT}, drop_pair},
+    {"negate-negate-int", 2, {OP_NEGATE_INT, OP_NEGATE_INT}, drop_pair},
+    {"negate-negate-float", 2, {OP_NEGATE_FLOAT, OP_NEGATE_FLOAT}, drop_pair},
+};
+
+static bool matches(const Peephole* peephole, const PeepholeRule* rule, int i) {
+    const Chunk* chunk = peephole->chunk;
+    if (i + rule->length > chunk->code_count) {
+        return false;
+    }
+    
+    for (int k = 0; k < rule->length; k++) {
+        if (chunk->code[i + k].op != rule->pattern[k] ||
+            (k > 0 && (peephole->removed[i + k] || peephole->target[i + k]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Record the jump targets and local reads of the chunk as it is
+static void scan_chunk(Peephole* peephole) {
+    const Chunk* chunk = peephole->chunk;
+    
+    memset(peephole->removed, 0, sizeof(bool) * (chunk->code_count + 1));
+    memset(peephole->target, 0, sizeof(bool) * (chunk->code_count + 1));
+    memset(peephole->reads, 0, sizeof(int) * (chunk->local_count + 1));
+    for (int i = 0; i < chunk->code_count; i++) {
+        const Instruction* instruction = &chunk->code[i];
+        if (is_jump(instruction->op)) {
+            peephole->target[instruction->operand] = true;
+        } else if (instruction->op == OP_GET_LOCAL) {
+            peephole->reads[instruction->operand]++;
+        }
+    }
+}
+
+// Drop the removed instructions and move jumps to where their targets went:
+// a jump to a removed instruction lands on the next one kept
+static void compact(Peephole* peephole) {
+    Chunk* chunk = peephole->chunk;
+    int* index = malloc(sizeof(int) * (chunk->code_count + 1));
+    int kept = 0;
+    
+    for (int i = 0; i < chunk->code_count; i++) {
+        index[i] = kept;
+        if (!peephole->removed[i]) {
+            chunk->code[kept] = chunk->code[i];
+            chunk->positions[kept] = chunk->positions[i];
+            kept++;
+        }
+    }
+    index[chunk->code_count] = kept;
+    
+    for (int i = 0; i < kept; i++) {
+        if (is_jump(chunk->code[i].op)) {
+            chunk->code[i].operand = index[chunk->code[i].operand];
+        }
+    }
+    chunk->code_count = kept;
+    free(index);
+}
+
+// Rewrite a chunk until no rule applies. A round tries the rules at every
+// instruction left to right; the next instruction tried is the one after
+// the sequence rewritten.
+void optimize_peephole(Chunk* chunk, PeepholeStats* stats) {
+    Peephole peephole = {chunk, NULL, NULL, NULL};
+    bool changed = true;
+    
+    // The code only shrinks, so the first size holds every round
+    peephole.removed = malloc(sizeof(bool) * (chunk->code_count + 1));
+    peephole.target = malloc(sizeof(bool) * (chunk->code_count + 1));
+    peephole.reads = malloc(sizeof(int) * (chunk->local_count + 1));
+    stats->instructions_before += chunk->code_count;
+    
+    while (changed) {
+        changed = false;
+        scan_chunk(&peephole);
+        
+        for (int i = 0; i < chunk->code_count; i++) {
+            if (peephole.removed[i]) {
+                continue;
+            }
+            for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+                if (matches(&peephole, &rules[r], i) && rules[r].apply(&peephole, i)) {
+                    stats->hits[r]++;
+                    changed = true;
+                    i += rules[r].length - 1;
+                    break;
+                }
+            }
+        }
+        
+        if (changed) {
+            compact(&peephole);
+        }
+    }
+    
+    stats->instructions_after += chunk->code_count;
+    free(peephole.removed);
+    free(peephole.target);
+    free(peephole.reads);
+}
+
+void print_peephole_stats(const PeepholeStats* stats) {
+    fprintf(stderr, "Peephole rules:\n");
+    fprintf(stderr, "  Instructions before:   %d\n", stats->instructions_before);
+    fprintf(stderr, "  Instructions after:    %d\n", stats->instructions_after);
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+        fprintf(stderr, "  %-22s %d hits\n", rules[r].name, stats->hits[r]);
+    }
+}
@@ -0,0 +1,239 @@
+#include "../include/pool.h"
+#include <pthread.h>
+
+// Size classes: 16, 32, 64, 128 and 256 bytes
+#define POOL_CLASS_COUNT 5
+#define POOL_MIN_SHIFT 4
+
+// Bytes requested from the backing allocator at a time
+#define POOL_SLAB_SIZE (64 * 1024)
+
+// Objects a thread keeps per class before returning a batch to the depot,
+// and the batch size moved either way
+#define POOL_CACHE_LIMIT 256
+#define POOL_BATCH 64
+
+// Free slot, linked through its first word
+typedef struct FreeSlot {
+    struct FreeSlot* next;
+} FreeSlot;
+
+typedef struct {
+    FreeSlot* head;
+    int count;
+} FreeList;
+
+// Per-thread caches, so most allocations and frees take no lock
+static _Thread_local FreeList thread_cache[POOL_CLASS_COUNT];
+static _Thread_local bool thread_registered = false;
+
+// Shared depot and slab carving, under the depot lock
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static FreeList depot[POOL_CLASS_COUNT];
+static char* slab_cursor = NULL;
+static size_t slab_left = 0;
+static size_t slab_bytes = 0;
+
+// Flushes a thread's cache into the depot when the thread exits
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+// Backing allocator
+static void* default_allocate(void* user_data, size_t size) {
+    (void)user_data;
+    return malloc(size);
+}
+
+static void default_deallocate(void* user_data, void* pointer, size_t size) {
+    (void)user_data;
+    (void)size;
+    free(pointer);
+}
+
+static PoolAllocator backing = {default_allocate, default_deallocate, NULL};
+static atomic_bool pool_used = false;
+
+// Counters
+static atomic_uint_fast64_t allocation_counts[POOL_KIND_COUNT];
+static atomic_uint_fast64_t free_counts[POOL_KIND_COUNT];
+
+bool pool_set_allocator(const PoolAllocator* allocator) {
+    if (atomic_load(&pool_used)) {
+        return false;
+    }
+    
+    if (allocator == NULL) {
+        backing = (PoolAllocator){default_allocate, default_deallocate, NULL};
+    } else {
+        backing = *allocator;
+    }
+    return true;
+}
+
+// Size class of an object no larger than POOL_MAX_OBJECT
+static int size_class(size_t size) {
+    int bucket = 0;
+    while (((size_t)1 << (bucket + POOL_MIN_SHIFT)) < size) {
+        bucket++;
+    }
+    return bucket;
+}
+
+static size_t class_size(int bucket) {
+    return (size_t)1 << (bucket + POOL_MIN_SHIFT);
+}
+
+// Move up to count slots from one list to another
+static void move_slots(FreeList* from, FreeList* to, int count) {
+    while (count-- > 0 && from->head != NULL) {
+        FreeSlot* slot = from->head;
+        from->head = slot->next;
+        from->count--;
+        slot->next = to->head;
+        to->head = slot;
+        to->count++;
+    }
+}
+
+// Return every cached slot of an exiting thread to the depot
+static void flush_thread_cache(void* unused) {
+    (void)unused;
+    
+    pthread_mutex_lock(&depot_lock);
+    for (int bucket = 0; bucket < POOL_CLASS_COUNT; bucket++) {
+        move_slots(&thread_cache[bucket], &depot[bucket], thread_cache[bucket].count);
+    }
+    pthread_mutex_unlock(&depot_lock);
+}
+
+static void create_thread_key(void) {
+    pthread_key_create(&thread_key, flush_thread_cache);
+}
+
+// Arrange for the calling thread's cache to be flushed when it exits.
+// Called before a thread first caches a slot, whether it allocated or
+// only freed it.
+static void register_thread(void) {
+    if (!thread_registered) {
+        pthread_once(&thread_key_once, create_thread_key);
+        pthread_setspecific(thread_key, thread_cache);
+        thread_registered = true;
+    }
+}
+
+// Refill a thread's list from the depot, carving new slots when it is empty
+static void refill(int bucket) {
+    FreeList* cache = &thread_cache[bucket];
+    size_t size = class_size(bucket);
+    
+    register_thread();
+    pthread_mutex_lock(&depot_lock);
+    move_slots(&depot[bucket], cache, POOL_BATCH);
+    
+    for (int i = cache->count; i < POOL_BATCH; i++) {
+        if (slab_left < size) {
+            // The rest of the old slab is too small for this class and is left unused
+            slab_cursor = backing.allocate(backing.user_data, POOL_SLAB_SIZE);
+            slab_left = POOL_SLAB_SIZE;
+            slab_bytes += POOL_SLAB_SIZE;
+            atomic_store(&pool_used, true);
+        }
+        
+        FreeSlot* slot = (FreeSlot*)slab_cursor;
+        slab_cursor += size;
+        slab_left -= size;
+        slot->next = cache->head;
+        cache->head = slot;
+        cache->count++;
+    }
+    pthread_mutex_unlock(&depot_lock);
+}
+
+void* pool_alloc(PoolKind kind, size_t size) {
+    atomic_fetch_add_explicit(&allocation_counts[kind], 1, memory_order_relaxed);
+    
+    if (size > POOL_MAX_OBJECT) {
+        atomic_store(&pool_used, true);
+        return backing.allocate(backing.user_data, size);
+    }
+    
+    int bucket = size_class(size);
+    FreeList* cache = &thread_cache[bucket];
+    if (cache->head == NULL) {
+        refill(bucket);
+    }
+    
+    FreeSlot* slot = cache->head;
+    cache->head = slot->next;
+    cache->count--;
+    return slot;
+}
+
+void pool_free(PoolKind kind, void* pointer, size_t size) {
+    if (pointer == NULL) {
+        return;
+    }
+    
+    atomic_fetch_add_explicit(&free_counts[kind], 1, memory_order_relaxed);
+    
+    if (size > POOL_MAX_OBJECT) {
+        backing.deallocate(backing.user_data, pointer, size);
+        return;
+    }
+    
+    register_thread();
+    int bucket = size_class(size);
+    FreeList* cache = &thread_cache[bucket];
+    FreeSlot* slot = pointer;
+    slot->next = cache->head;
+    cache->head = slot;
+    cache->count++;
+    
+    // Objects freed by a thread other than the allocating one flow back
+    // through the depot instead of piling up here
+    if (cache->count > POOL_CACHE_LIMIT) {
+        pthread_mutex_lock(&depot_lock);
+        move_slots(cache, &depot[bucket], POOL_BATCH);
+        pthread_mutex_unlock(&depot_lock);
+    }
+}
+
+char* pool_strdup(PoolKind kind, const char* string) {
+    size_t size = strlen(string) + 1;
+    char* copy = pool_alloc(kind, size);
+    memcpy(copy, string, size);
+    return copy;
+}
+
+void pool_free_string(PoolKind kind, char* string) {
+    if (string != NULL) {
+        pool_free(kind, string, strlen(string) + 1);
+    }
+}
+
+void pool_get_stats(PoolStats* stats) {
+    for (int kind = 0; kind < POOL_KIND_COUNT; kind++) {
+        stats->allocations[kind] = atomic_load_explicit(&allocation_counts[kind], memory_order_relaxed);
+        stats->frees[kind] = atomic_load_explicit(&free_counts[kind], memory_order_relaxed);
+    }
+    
+    pthread_mutex_lock(&depot_lock);
+    stats->slab_bytes = slab_bytes;
+    pthread_mutex_unlock(&depot_lock);
+}
+
+void print_pool_stats(void) {
+    static const char* kind_names[POOL_KIND_COUNT] = {
+        "Environment entries:", "Symbol entries:", "Strings:", "Names:", "Region blocks:"
+    };
+    
+    PoolStats stats;
+    pool_get_stats(&stats);
+    
+    fprintf(stderr, "Allocation statistics:\n");
+    for (int kind = 0; kind < POOL_KIND_COUNT; kind++) {
+        fprintf(stderr, "  %-22s %llu allocated, %llu freed\n", kind_names[kind],
+                (unsigned long long)stats.allocations[kind], (unsigned long long)stats.frees[kind]);
+    }
+    fprintf(stderr, "  %-22s %zu bytes\n", "Slab memory:", stats.slab_bytes);
+}
@@ -0,0 +1,214 @@
+#include "../include/profile.h"
+
+#define TRIPLE_INDEX(a, b, c) (((size_t)(a) * OP_COUNT + (size_t)(b)) * OP_COUNT + (size_t)(c))
+
+void init_profile(OpProfile* profile) {
+    memset(profile, 0, sizeof(OpProfile));
+    profile->triples = calloc((size_t)OP_COUNT * OP_COUNT * OP_COUNT, sizeof(uint64_t));
+    profile_start_run(profile);
+}
+
+void profile_start_run(OpProfile* profile) {
+    profile->previous[0] = -1;
+    profile->previous[1] = -1;
+}
+
+static void count_instruction(OpProfile* profile, int op) {
+    int last = profile->previous[1];
+    int before = profile->previous[0];
+    
+    profile->instructions++;
+    profile->counts[op]++;
+    if (last >= 0) {
+        profile->pairs[last][op]++;
+        if (before >= 0) {
+            profile->triples[TRIPLE_INDEX(before, last, op)]++;
+        }
+    }
+    profile->previous[0] = last;
+    profile->previous[1] = op;
+}
+
+void profile_dispatch(OpProfile* profile, const Chunk* chunk, int ip) {
+    profile->dispatches++;
+    
+    // The instructions a superinstruction runs are still in place after it
+    int length = superinstruction_length(chunk->code[ip].op);
+    for (int i = 0; i < length; i++) {
+        count_instruction(profile, base_opcode(chunk->code[ip + i].op));
+    }
+}
+
+// Opcode by disassembly name, or -1
+static int find_opcode(const char* name) {
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (strcmp(opcode_name((OpCode)op), name) == 0) {
+            return op;
+        }
+    }
+    return -1;
+}
+
+// Text file, one count per line:
+//   dispatches N
+//   instructions N
+//   count OP N
+//   pair OP OP N
+//   triple OP OP OP N
+// Lines naming instructions this build does not have are skipped.
+bool load_profile(OpProfile* profile, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return true;
+    }
+    
+    char line[256];
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file) != NULL) {
+        char kind[16];
+        char names[3][32];
+        unsigned long long n;
+        
+        if (sscanf(line, "dispatches %llu", &n) == 1) {
+            profile->dispatches += n;
+        } else if (sscanf(line, "instructions %llu", &n) == 1) {
+            profile->instructions += n;
+        } else if (sscanf(line, "%15s", kind) == 1) {
+            int wanted = strcmp(kind, "count") == 0 ? 1 : strcmp(kind, "pair") == 0 ? 2
+                       : strcmp(kind, "triple") == 0 ? 3 : 0;
+            int read = 0;
+            if (wanted == 1) {
+                read = sscanf(line, "%*s %31s %llu", names[0], &n);
+            } else if (wanted == 2) {
+                read = sscanf(line, "%*s %31s %31s %llu", names[0], names[1], &n);
+            } else if (wanted == 3) {
+                read = sscanf(line, "%*s %31s %31s %31s %llu", names[0], names[1], names[2], &n);
+            }
+            if (read != wanted + 1) {
+                valid = false;
+                break;
+            }
+            
+            int ops[3];
+            bool known = true;
+            for (int i = 0; i < wanted; i++) {
+                ops[i] = find_opcode(names[i]);
+                known = known && ops[i] >= 0;
+            }
+            if (!known) {
+                continue;
+            }
+            
+            if (wanted == 1) {
+                profile->counts[ops[0]] += n;
+            } else if (wanted == 2) {
+                profile->pairs[ops[0]][ops[1]] += n;
+            } else {
+                profile->triples[TRIPLE_INDEX(ops[0], ops[1], ops[2])] += n;
+            }
+        }
+    }
+    
+    fclose(file);
+    return valid;
+}
+
+bool save_profile(const OpProfile* profile, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    
+    fprintf(file, "dispatches %llu\n", (unsigned long long)profile->dispatches);
+    fprintf(file, "instructions %llu\n", (unsigned long long)profile->instructions);
+    for (int a = 0; a < OP_COUNT; a++) {
+        if (profile->counts[a] > 0) {
+            fprintf(file, "count %s %llu\n", opcode_name((OpCode)a), (unsigned long long)profile->counts[a]);
+        }
+    }
+    for (int a = 0; a < OP_COUNT; a++) {
+        for (int b = 0; b < OP_COUNT; b++) {
+            if (profile->pairs[a][b] > 0) {
+                fprintf(file, "pair %s %s %llu\n", opcode_name((OpCode)a), opcode_name((OpCode)b),
+                        (unsigned long long)profile->pairs[a][b]);
+            }
+        }
+    }
+    for (int a = 0; a < OP_COUNT; a++) {
+        for (int b = 0; b < OP_COUNT; b++) {
+            for (int c = 0; c < OP_COUNT; c++) {
+                uint64_t n = profile->triples[TRIPLE_INDEX(a, b, c)];
+                if (n > 0) {
+                    fprintf(file, "triple %s %s %s %llu\n", opcode_name((OpCode)a), opcode_name((OpCode)b),
+                            opcode_name((OpCode)c), (unsigned long long)n);
+                }
+            }
+        }
+    }
+    
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+// Most frequent sequences of a given length: indexes into the pair or
+// triple counts, in decreasing order
+static int top_sequences(const uint64_t* counts, size_t count, size_t* top) {
+    int found = 0;
+    
+    for (size_t i = 0; i < count; i++) {
+        if (counts[i] == 0 || (found == PROFILE_TOP && counts[i] <= counts[top[found - 1]])) {
+            continue;
+        }
+        
+        // Insertion into the sorted list, dropping the last when it is full
+        int position = found < PROFILE_TOP ? found++ : PROFILE_TOP - 1;
+        while (position > 0 && counts[top[position - 1]] < counts[i]) {
+            top[position] = top[position - 1];
+            position--;
+        }
+        top[position] = i;
+    }
+    return found;
+}
+
+static void print_sequence(const OpProfile* profile, size_t index, int length, uint64_t n) {
+    int ops[3] = {(int)(index / OP_COUNT / OP_COUNT), (int)(index / OP_COUNT % OP_COUNT), (int)(index % OP_COUNT)};
+    char text[96] = "";
+    
+    for (int i = 3 - length; i < 3; i++) {
+        if (i > 3 - length) {
+            strcat(text, " ");
+        }
+        strcat(text, opcode_name((OpCode)ops[i]));
+    }
+    fprintf(stderr, "    %-44s %12llu  %5.1f%%\n", text, (unsigned long long)n,
+            profile->instructions > 0 ? 100.0 * (double)n / (double)profile->instructions : 0.0);
+}
+
+void print_profile(const OpProfile* profile) {
+    size_t top[PROFILE_TOP];
+    
+    fprintf(stderr, "Instruction profile:\n");
+    fprintf(stderr, "  Instructions:          %llu\n", (unsigned long long)profile->instructions);
+    fprintf(stderr, "  Dispatches:            %llu (%.1f%% fused away)\n", (unsigned long long)profile->dispatches,
+            profile->instructions > 0
+                ? 100.0 * (double)(profile->instructions - profile->dispatches) / (double)profile->instructions
+                : 0.0);
+    
+    fprintf(stderr, "  Top pairs:\n");
+    int found = top_sequences(&profile->pairs[0][0], (size_t)OP_COUNT * OP_COUNT, top);
+    for (int i = 0; i < found; i++) {
+        print_sequence(profile, top[i], 2, (&profile->pairs[0][0])[top[i]]);
+    }
+    
+    fprintf(stderr, "  Top triples:\n");
+    found = top_sequences(profile->triples, (size_t)OP_COUNT * OP_COUNT * OP_COUNT, top);
+    for (int i = 0; i < found; i++) {
+        print_sequence(profile, top[i], 3, profile->triples[top[i]]);
+    }
+}
+
+void free_profile(OpProfile* profile) {
+    free(profile->triples);
+    profile->triples = NULL;
+}
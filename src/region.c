@@ -0,0 +1,90 @@
+#include "../include/region.h"
+#include "../include/pool.h"
+
+void init_region(Region* region) {
+    region->first = NULL;
+    region->current = NULL;
+    region->cursor = NULL;
+    region->end = NULL;
+}
+
+// Make block the current one
+static void enter_block(Region* region, RegionBlock* block) {
+    region->current = block;
+    region->cursor = block->data;
+    region->end = block->data + block->size;
+}
+
+// Move to a block with room for size bytes: the next retained block if it
+// is big enough, otherwise a new one linked in after the current block
+static void next_block(Region* region, size_t size) {
+    RegionBlock* current = region->current;
+    
+    if (current != NULL && current->next != NULL && current->next->size >= size) {
+        enter_block(region, current->next);
+        return;
+    }
+    
+    size_t block_size = current == NULL ? REGION_BLOCK_SIZE : current->size * 2;
+    if (block_size > REGION_MAX_BLOCK_SIZE) {
+        block_size = REGION_MAX_BLOCK_SIZE;
+    }
+    while (block_size < size) {
+        block_size *= 2;
+    }
+    
+    RegionBlock* block = pool_alloc(POOL_REGION_BLOCK, sizeof(RegionBlock) + block_size);
+    block->size = block_size;
+    
+    if (current == NULL) {
+        block->next = NULL;
+        region->first = block;
+    } else {
+        block->next = current->next;
+        current->next = block;
+    }
+    enter_block(region, block);
+}
+
+void* region_alloc(Region* region, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    
+    if ((size_t)(region->end - region->cursor) < size) {
+        next_block(region, size);
+    }
+    
+    void* memory = region->cursor;
+    region->cursor += size;
+    return memory;
+}
+
+// Only blocks up to the current one can hold live allocations
+bool region_contains(const Region* region, const void* pointer) {
+    const char* address = pointer;
+    
+    for (const RegionBlock* block = region->first; block != NULL; block = block->next) {
+        if (address >= block->data && address < block->data + block->size) {
+            return block != region->current || address < region->cursor;
+        }
+        if (block == region->current) {
+            break;
+        }
+    }
+    return false;
+}
+
+void reset_region(Region* region) {
+    if (region->first != NULL) {
+        enter_block(region, region->first);
+    }
+}
+
+void free_region(Region* region) {
+    RegionBlock* block = region->first;
+    while (block != NULL) {
+        RegionBlock* next = block->next;
+        pool_free(POOL_REGION_BLOCK, block, sizeof(RegionBlock) + block->size);
+        block = next;
+    }
+    init_region(region);
+}
@@ -0,0 +1,92 @@
+#include "../../include/kasd_runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Same format and colors as print_error
+void kasd_rt_division_by_zero(int line, int column) {
+    fflush(stdout);
+    fprintf(stderr, "\x1b[31mRuntime Error at line %d, column %d: Division by zero\x1b[0m\n", line, column);
+    exit(1);
+}
+
+// Byte order, shorter strings first on a common prefix
+int kasd_rt_compare_string(KasdString left, KasdString right) {
+    size_t length = left.length < right.length ? left.length : right.length;
+    
+    int cmp = memcmp(left.chars, right.chars, length);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (left.length > right.length) - (left.length < right.length);
+}
+
+void kasd_rt_concat_into(char* chars, KasdString left, KasdString right) {
+    memcpy(chars, left.chars, left.length);
+    memcpy(chars + left.length, right.chars, right.length);
+    chars[left.length + right.length] = '\0';
+}
+
+static void* allocate(size_t size) {
+    void* memory = malloc(size);
+    if (memory == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+KasdString kasd_rt_concat(KasdString left, KasdString right) {
+    char* chars = allocate(left.length + right.length + 1);
+    kasd_rt_concat_into(chars, left, right);
+    return (KasdString){chars, left.length + right.length};
+}
+
+void kasd_rt_format_int(char* buffer, int64_t value) {
+    snprintf(buffer, KASD_RT_NUMBER_SIZE, "%lld", (long long)value);
+}
+
+// Every NaN prints as nan: its sign depends on whether the C compiler or
+// the processor computed it, which differs between engines
+void kasd_rt_format_float(char* buffer, double value) {
+    if (isnan(value)) {
+        strcpy(buffer, "nan");
+        return;
+    }
+    snprintf(buffer, KASD_RT_NUMBER_SIZE, "%g", value);
+}
+
+const char* kasd_rt_format_bool(bool value) {
+    return value ? "true" : "false";
+}
+
+// Quoted, and cut at the first NUL like any C string
+void kasd_rt_format_string(char* buffer, KasdString value) {
+    sprintf(buffer, "\"%s\"", value.chars);
+}
+
+void kasd_rt_print_int(const char* name, int64_t value) {
+    char text[KASD_RT_NUMBER_SIZE];
+    kasd_rt_format_int(text, value);
+    printf("%s: int = %s\n", name, text);
+}
+
+void kasd_rt_print_float(const char* name, double value) {
+    char text[KASD_RT_NUMBER_SIZE];
+    kasd_rt_format_float(text, value);
+    printf("%s: float = %s\n", name, text);
+}
+
+void kasd_rt_print_bool(const char* name, bool value) {
+    printf("%s: bool = %s\n", name, kasd_rt_format_bool(value));
+}
+
+void kasd_rt_print_string(const char* name, KasdString value) {
+    char* text = allocate(value.length + 3);
+    kasd_rt_format_string(text, value);
+    printf("%s: string = %s\n", name, text);
+    free(text);
+}
+
+void kasd_rt_print_null(const char* name, const char* type) {
+    printf("%s: %s = null\n", name, type);
+}
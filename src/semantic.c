@@ -1,25 +1,31 @@
 #include "../include/semantic.h"
+#include "../include/operators.h"
+#include "../include/pool.h"
 
 // Forward declarations
 static bool analyze_node(SemanticAnalyzer* analyzer, AstNode* node);
 static bool analyze_variable_declaration(SemanticAnalyzer* analyzer, AstNode* node);
+static bool analyze_expression(SemanticAnalyzer* analyzer, AstNode* node, ValueType* type);
 static bool check_types_compatible(ValueType expected, ValueType actual);
-static ValueType get_node_type(AstNode* node);
+static AstNode* coerce(AstNode* node, ValueType target);
 
 // Symbol table operations
-static void add_symbol(SymbolTable* table, const char* name, ValueType type);
+static void add_symbol(SemanticAnalyzer* analyzer, const char* name, ValueType type, ValueType value_type);
 static SymbolEntry* find_symbol(SymbolTable* table, const char* name);
+static bool lookup_symbol_type(SemanticAnalyzer* analyzer, const char* name, ValueType* value_type);
 static void free_symbol_table(SymbolTable* table);
 
 // Initialize semantic analyzer
-void init_semantic_analyzer(SemanticAnalyzer* analyzer) {
+void init_semantic_analyzer(SemanticAnalyzer* analyzer, KasdState* state) {
     analyzer->symbol_table.head = NULL;
+    analyzer->snapshot = NULL;
     analyzer->had_error = false;
+    analyzer->state = state;
 }
 
 // Analyze AST for semantic errors
 bool analyze(SemanticAnalyzer* analyzer, AstNode* node) {
-    log_message(LOG_DEBUG, "Starting semantic analysis");
+    log_message(analyzer->state, LOG_DEBUG, "Starting semantic analysis");
     
     bool result = analyze_node(analyzer, node);
     
@@ -33,36 +39,50 @@ static bool analyze_node(SemanticAnalyzer* analyzer, AstNode* node) {
     }
     
     switch (node->type) {
+        case NODE_PROGRAM:
+            for (int i = 0; i < node->as.program.count; i++) {
+                if (!analyze_node(analyzer, node->as.program.declarations[i])) {
+                    return false;
+                }
+            }
+            return true;
         case NODE_VARIABLE_DECLARATION:
             return analyze_variable_declaration(analyzer, node);
         case NODE_LITERAL:
-            return true; // Literals are always valid
+        case NODE_VARIABLE:
+        case NODE_UNARY:
+        case NODE_BINARY: {
+            ValueType type;
+            return analyze_expression(analyzer, node, &type);
+        }
         default:
-            log_message(LOG_ERROR, "Unknown node type in semantic analysis");
+            log_message(analyzer->state, LOG_ERROR, "Unknown node type in semantic analysis");
             return false;
     }
 }
 
 // Analyze variable declaration
 static bool analyze_variable_declaration(SemanticAnalyzer* analyzer, AstNode* node) {
-    log_message(LOG_DEBUG, "Analyzing variable declaration: %s", node->as.var_decl.name);
+    log_message(analyzer->state, LOG_DEBUG, "Analyzing variable declaration: %s", node->as.var_decl.name);
     
     // Check if variable already exists
-    if (find_symbol(&analyzer->symbol_table, node->as.var_decl.name) != NULL) {
-        set_error(ERROR_NAME, node->line, node->column,
+    ValueType existing_type;
+    if (lookup_symbol_type(analyzer, node->as.var_decl.name, &existing_type)) {
+        set_error(analyzer->state, ERROR_NAME, node->line, node->column,
                  "Variable already declared", NULL, 0, 0);
         analyzer->had_error = true;
         return false;
     }
     
-    // Add variable to symbol table
-    add_symbol(&analyzer->symbol_table, node->as.var_decl.name, node->as.var_decl.var_type);
-    
-    // Check initializer
+    // Check initializer before the variable comes into scope
     AstNode* initializer = node->as.var_decl.initializer;
+    ValueType value_type = VALUE_NULL;
     if (initializer != NULL) {
         // Get initializer type
-        ValueType init_type = get_node_type(initializer);
+        ValueType init_type;
+        if (!analyze_expression(analyzer, initializer, &init_type)) {
+            return false;
+        }
         
         // Check if types are compatible
         if (!check_types_compatible(node->as.var_decl.var_type, init_type)) {
@@ -72,13 +92,171 @@ static bool analyze_variable_declaration(SemanticAnalyzer* analyzer, AstNode* no
                     value_type_to_string(init_type),
                     value_type_to_string(node->as.var_decl.var_type));
             
-            set_error(ERROR_TYPE, initializer->line, initializer->column,
+            set_error(analyzer->state, ERROR_TYPE, initializer->line, initializer->column,
                      message, NULL, 0, 0);
             analyzer->had_error = true;
             return false;
         }
+        
+        // Make the stored value carry the declared type (null stays null)
+        if (init_type != VALUE_NULL) {
+            node->as.var_decl.initializer = coerce(initializer, node->as.var_decl.var_type);
+            value_type = node->as.var_decl.var_type;
+        }
+    }
+    
+    // Add variable to symbol table
+    add_symbol(analyzer, node->as.var_decl.name,
+               node->as.var_decl.var_type, value_type);
+    
+    return true;
+}
+
+// Report an operator applied to operands it does not support
+static bool operand_type_error(SemanticAnalyzer* analyzer, AstNode* node, TokenType op,
+                               ValueType left, ValueType right, bool unary) {
+    char message[128];
+    if (unary) {
+        snprintf(message, sizeof(message), "Operator '%s' cannot be applied to %s",
+                 operator_to_string(op), value_type_to_string(left));
+    } else {
+        snprintf(message, sizeof(message), "Operator '%s' cannot be applied to %s and %s",
+                 operator_to_string(op), value_type_to_string(left),
+                 value_type_to_string(right));
+    }
+    
+    set_error(analyzer->state, ERROR_TYPE, node->line, node->column, message, NULL, 0, 0);
+    analyzer->had_error = true;
+    return false;
+}
+
+static bool is_numeric_type(ValueType type) {
+    return type == VALUE_INT || type == VALUE_FLOAT;
+}
+
+// Result type of a binary operator, or false if the operands are invalid
+static bool binary_result_type(TokenType op, ValueType left, ValueType right, ValueType* result) {
+    bool numeric = is_numeric_type(left) && is_numeric_type(right);
+    ValueType arithmetic = (left == VALUE_INT && right == VALUE_INT) ? VALUE_INT : VALUE_FLOAT;
+    
+    switch (op) {
+        case TOKEN_PLUS:
+            if (left == VALUE_STRING && right == VALUE_STRING) {
+                *result = VALUE_STRING;
+                return true;
+            }
+            *result = arithmetic;
+            return numeric;
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+            *result = arithmetic;
+            return numeric;
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+            *result = VALUE_BOOL;
+            return numeric || (left == VALUE_STRING && right == VALUE_STRING);
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL:
+            *result = VALUE_BOOL;
+            return numeric || left == right || left == VALUE_NULL || right == VALUE_NULL;
+        case TOKEN_AND_AND:
+        case TOKEN_OR_OR:
+            *result = VALUE_BOOL;
+            return left == VALUE_BOOL && right == VALUE_BOOL;
+        default:
+            return false;
+    }
+}
+
+// Wrap node in a conversion to target, if its static type differs.
+// Literals are converted in place. Only int -> float widening exists.
+static AstNode* coerce(AstNode* node, ValueType target) {
+    if (node->value_type == target) {
+        return node;
+    }
+    
+    if (node->type == NODE_LITERAL) {
+        node->as.literal = create_float_value((double)node->as.literal.data.as_int);
+        node->value_type = target;
+        return node;
+    }
+    
+    AstNode* convert = create_node(NODE_CONVERT, node->line, node->column);
+    convert->value_type = target;
+    convert->as.convert.operand = node;
+    return convert;
+}
+
+// Analyze an expression, compute its static type and record it in the node
+static bool analyze_expression(SemanticAnalyzer* analyzer, AstNode* node, ValueType* type) {
+    switch (node->type) {
+        case NODE_LITERAL:
+            *type = node->as.literal.type;
+            break;
+            
+        case NODE_VARIABLE: {
+            if (!lookup_symbol_type(analyzer, node->as.variable.name, type)) {
+                char message[128];
+                snprintf(message, sizeof(message), "Undefined variable '%s'",
+                         node->as.variable.name);
+                set_error(analyzer->state, ERROR_NAME, node->line, node->column, message, NULL, 0, 0);
+                analyzer->had_error = true;
+                return false;
+            }
+            break;
+        }
+        
+        case NODE_UNARY: {
+            ValueType operand;
+            if (!analyze_expression(analyzer, node->as.unary.operand, &operand)) {
+                return false;
+            }
+            
+            bool valid = (node->as.unary.op == TOKEN_MINUS) ? is_numeric_type(operand)
+                                                            : operand == VALUE_BOOL;
+            if (!valid) {
+                return operand_type_error(analyzer, node, node->as.unary.op,
+                                          operand, operand, true);
+            }
+            *type = operand;
+            break;
+        }
+        
+        case NODE_BINARY: {
+            ValueType left, right;
+            if (!analyze_expression(analyzer, node->as.binary.left, &left) ||
+                !analyze_expression(analyzer, node->as.binary.right, &right)) {
+                return false;
+            }
+            
+            if (!binary_result_type(node->as.binary.op, left, right, type)) {
+                return operand_type_error(analyzer, node, node->as.binary.op,
+                                          left, right, false);
+            }
+            
+            // Mixed int/float operands are both evaluated as float
+            if ((left == VALUE_INT && right == VALUE_FLOAT) ||
+                (left == VALUE_FLOAT && right == VALUE_INT)) {
+                node->as.binary.left = coerce(node->as.binary.left, VALUE_FLOAT);
+                node->as.binary.right = coerce(node->as.binary.right, VALUE_FLOAT);
+            }
+            break;
+        }
+        
+        case NODE_CONVERT:
+            *type = node->value_type;
+            return true;
+        
+        default:
+            log_message(analyzer->state, LOG_ERROR, "Unexpected node type in expression");
+            return false;
     }
     
+    node->value_type = *type;
     return true;
 }
 
@@ -94,12 +272,12 @@ static bool check_types_compatible(ValueType expected, ValueType actual) {
         return true;
     }
     
-    // Type conversion table
+    // Type conversion table: rows are the declared type, columns the value type
     static const bool compatibility_table[5][5] = {
         // NULL   INT    FLOAT  BOOL   STRING
         {  true,  false, false, false, false }, // NULL
-        {  false, true,  true,  false, false }, // INT
-        {  false, false, true,  false, false }, // FLOAT
+        {  false, true,  false, false, false }, // INT
+        {  false, true,  true,  false, false }, // FLOAT
         {  false, false, false, true,  false }, // BOOL
         {  false, false, false, false, true  }  // STRING
     };
@@ -107,27 +285,17 @@ static bool check_types_compatible(ValueType expected, ValueType actual) {
     return compatibility_table[expected][actual];
 }
 
-// Get the type of a node
-static ValueType get_node_type(AstNode* node) {
-    switch (node->type) {
-        case NODE_LITERAL:
-            return node->as.literal.type;
-        case NODE_VARIABLE_DECLARATION:
-            return node->as.var_decl.var_type;
-        default:
-            return VALUE_NULL;
-    }
-}
-
 // Add a symbol to the symbol table
-static void add_symbol(SymbolTable* table, const char* name, ValueType type) {
-    SymbolEntry* entry = malloc(sizeof(SymbolEntry));
-    entry->name = strdup(name);
+static void add_symbol(SemanticAnalyzer* analyzer, const char* name, ValueType type, ValueType value_type) {
+    SymbolTable* table = &analyzer->symbol_table;
+    SymbolEntry* entry = pool_alloc(POOL_SYMBOL_ENTRY, sizeof(SymbolEntry));
+    entry->name = pool_strdup(POOL_NAME, name);
     entry->type = type;
+    entry->value_type = value_type;
     entry->next = table->head;
     table->head = entry;
     
-    log_message(LOG_DEBUG, "Added symbol: %s (type: %s)", 
+    log_message(analyzer->state, LOG_DEBUG, "Added symbol: %s (type: %s)", 
                name, value_type_to_string(type));
 }
 
@@ -141,18 +309,93 @@ static SymbolEntry* find_symbol(SymbolTable* table, const char* name) {
     return NULL;
 }
 
+// Find the static type of a variable declared in this session or in the
+// snapshot it continues from
+static bool lookup_symbol_type(SemanticAnalyzer* analyzer, const char* name, ValueType* value_type) {
+    SymbolEntry* symbol = find_symbol(&analyzer->symbol_table, name);
+    if (symbol != NULL) {
+        *value_type = symbol->value_type;
+        return true;
+    }
+    
+    // A snapshot value carries its declared type, or null
+    Value value;
+    if (snapshot_lookup(analyzer->snapshot, name, &value)) {
+        *value_type = value.type;
+        return true;
+    }
+    return false;
+}
+
 // Free the symbol table
 static void free_symbol_table(SymbolTable* table) {
     SymbolEntry* current = table->head;
     while (current != NULL) {
         SymbolEntry* next = current->next;
-        free(current->name);
-        free(current);
+        pool_free_string(POOL_NAME, current->name);
+        pool_free(POOL_SYMBOL_ENTRY, current, sizeof(SymbolEntry));
         current = next;
     }
     table->head = NULL;
 }
 
+// Static type a declaration stores: its declared type, or null
+static ValueType stored_type(const AstNode* declaration) {
+    const AstNode* initializer = declaration->as.var_decl.initializer;
+    if (initializer == NULL || initializer->value_type == VALUE_NULL) {
+        return VALUE_NULL;
+    }
+    return declaration->as.var_decl.var_type;
+}
+
+// Declare the variables of a program analyzed elsewhere
+bool declare_program(SemanticAnalyzer* analyzer, const AstNode* program) {
+    // Check every declaration before adding any
+    for (int i = 0; i < program->as.program.count; i++) {
+        const AstNode* declaration = program->as.program.declarations[i];
+        const char* name = declaration->as.var_decl.name;
+        SymbolEntry* symbol = find_symbol(&analyzer->symbol_table, name);
+        Value value;
+        
+        bool clash;
+        if (symbol != NULL) {
+            clash = symbol->type != declaration->as.var_decl.var_type ||
+                    symbol->value_type != stored_type(declaration);
+        } else {
+            // Snapshot variables cannot be declared again
+            clash = snapshot_lookup(analyzer->snapshot, name, &value);
+        }
+        
+        if (clash) {
+            set_error(analyzer->state, ERROR_NAME, declaration->line, declaration->column,
+                     "Variable already declared", NULL, 0, 0);
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < program->as.program.count; i++) {
+        const AstNode* declaration = program->as.program.declarations[i];
+        if (find_symbol(&analyzer->symbol_table, declaration->as.var_decl.name) == NULL) {
+            add_symbol(analyzer, declaration->as.var_decl.name, declaration->as.var_decl.var_type,
+                       stored_type(declaration));
+        }
+    }
+    return true;
+}
+
+// Remove symbols added after mark
+void rollback_symbols(SemanticAnalyzer* analyzer, SymbolEntry* mark) {
+    SymbolEntry* current = analyzer->symbol_table.head;
+    while (current != NULL && current != mark) {
+        SymbolEntry* next = current->next;
+        pool_free_string(POOL_NAME, current->name);
+        pool_free(POOL_SYMBOL_ENTRY, current, sizeof(SymbolEntry));
+        current = next;
+    }
+    analyzer->symbol_table.head = mark;
+    analyzer->had_error = false;
+}
+
 // Clean up semantic analyzer
 void free_semantic_analyzer(SemanticAnalyzer* analyzer) {
     free_symbol_table(&analyzer->symbol_table);
@@ -0,0 +1,205 @@
+#include "../include/session.h"
+
+// Initialize a session
+void init_session(Session* session, KasdState* state, int opt_level, bool repl_mode, bool export_globals) {
+    session->state = state;
+    init_semantic_analyzer(&session->analyzer, state);
+    init_optimizer(&session->optimizer, state, opt_level, export_globals);
+    init_interpreter(&session->interpreter, state, repl_mode);
+    session->engine = ENGINE_CLOSURE;
+    memset(&session->ir_stats, 0, sizeof(IrStats));
+    memset(&session->peephole_stats, 0, sizeof(PeepholeStats));
+    session->programs = NULL;
+    session->program_count = 0;
+    session->program_capacity = 0;
+}
+
+// Continue from a snapshot
+void session_attach_snapshot(Session* session, const Snapshot* snapshot) {
+    session->analyzer.snapshot = snapshot;
+    session->optimizer.snapshot = snapshot;
+    session->interpreter.env.base = snapshot;
+}
+
+// Keep an executed program alive for the rest of the session
+static void retain_program(Session* session, AstNode* program) {
+    if (session->program_count == session->program_capacity) {
+        int capacity = session->program_capacity < 8 ? 8 : session->program_capacity * 2;
+        session->programs = realloc(session->programs, sizeof(AstNode*) * capacity);
+        session->program_capacity = capacity;
+    }
+    session->programs[session->program_count++] = program;
+}
+
+// Parse, analyze and optimize one input against the session's symbols and
+// constants; the returned program is retained by the session
+static AstNode* prepare_program(Session* session, const char* source, SymbolEntry** mark) {
+    Lexer lexer;
+    Parser parser;
+    
+    init_lexer(&lexer, source, session->state);
+    init_parser(&parser, &lexer);
+    
+    // Parse
+    AstNode* ast = parse(&parser);
+    if (parser.had_error || ast == NULL) {
+        free_ast(ast);
+        return NULL;
+    }
+    
+    // Analyze only the new declarations against the existing symbols
+    *mark = session->analyzer.symbol_table.head;
+    if (!analyze(&session->analyzer, ast)) {
+        rollback_symbols(&session->analyzer, *mark);
+        free_ast(ast);
+        return NULL;
+    }
+    
+    // Optimize, using constants from earlier inputs
+    optimize(&session->optimizer, ast);
+    retain_program(session, ast);
+    
+    // Debug print AST if log level is high enough
+    if (session->state->log_level >= LOG_DEBUG) {
+        printf("AST:\n");
+        print_ast(ast, 0);
+    }
+    
+    return ast;
+}
+
+// Run one input in the session
+bool session_execute(Session* session, const char* source) {
+    SymbolEntry* mark;
+    ConstantEntry* constants_mark = session->optimizer.constants;
+    EnvEntry* env_mark = session->interpreter.env.head;
+    
+    AstNode* ast = prepare_program(session, source, &mark);
+    if (ast == NULL) {
+        return false;
+    }
+    
+    if (session->engine == ENGINE_CLOSURE) {
+        ClosureProgram* closures = compile_closures(ast);
+        run_closures(&session->interpreter, closures);
+        free_closures(closures);
+    } else {
+        free_value(interpret(&session->interpreter, ast));
+    }
+    
+    if (session->interpreter.had_error) {
+        // Forget everything the input declared, including the variables
+        // it defined before the error, so the input can be corrected and
+        // entered again
+        rollback_symbols(&session->analyzer, mark);
+        rollback_constants(&session->optimizer, constants_mark);
+        env_rollback(&session->interpreter.env, env_mark);
+        session->interpreter.had_error = false;
+        return false;
+    }
+    
+    return true;
+}
+
+// Run a program analyzed and compiled outside the session
+bool session_run(Session* session, const AstNode* program, const ClosureProgram* closures) {
+    SymbolEntry* mark = session->analyzer.symbol_table.head;
+    EnvEntry* env_mark = session->interpreter.env.head;
+    
+    if (!declare_program(&session->analyzer, program)) {
+        return false;
+    }
+    
+    // A variable defined again no longer holds the constant an earlier
+    // input gave it
+    for (int i = 0; i < program->as.program.count; i++) {
+        forget_constant(&session->optimizer, program->as.program.declarations[i]->as.var_decl.name);
+    }
+    
+    if (!run_closures(&session->interpreter, closures)) {
+        rollback_symbols(&session->analyzer, mark);
+        env_rollback(&session->interpreter.env, env_mark);
+        session->interpreter.had_error = false;
+        return false;
+    }
+    return true;
+}
+
+// Compile one input in the session to bytecode without running it
+bool session_compile(Session* session, const char* source, Chunk* chunk) {
+    SymbolEntry* mark;
+    
+    AstNode* ast = prepare_program(session, source, &mark);
+    if (ast == NULL) {
+        return false;
+    }
+    
+    init_chunk(chunk);
+    if (session->optimizer.level >= OPT_LEVEL_FULL) {
+        IrProgram* ir = build_ir(ast);
+        optimize_ir(ir, &session->ir_stats);
+        if (session->state->log_level >= LOG_DEBUG) {
+            printf("IR:\n");
+            print_ir(ir);
+        }
+        compile_ir(chunk, ir);
+        free_ir(ir);
+    } else {
+        compile_program(chunk, ast);
+    }
+    if (session->optimizer.level >= OPT_LEVEL_BASIC) {
+        optimize_peephole(chunk, &session->peephole_stats);
+    }
+    fuse_superinstructions(chunk);
+    
+    if (session->state->log_level >= LOG_DEBUG) {
+        printf("Bytecode:\n");
+        disassemble_chunk(chunk);
+    }
+    
+    return true;
+}
+
+// Print the optimized IR of one input in the session without running it
+bool session_dump_ir(Session* session, const char* source) {
+    SymbolEntry* mark;
+    
+    AstNode* ast = prepare_program(session, source, &mark);
+    if (ast == NULL) {
+        return false;
+    }
+    
+    IrProgram* ir = build_ir(ast);
+    optimize_ir(ir, &session->ir_stats);
+    print_ir(ir);
+    free_ir(ir);
+    return true;
+}
+
+// Translate one input in the session to C without running it
+bool session_emit_c(Session* session, const char* source, const char* source_name, FILE* out) {
+    SymbolEntry* mark;
+    
+    AstNode* ast = prepare_program(session, source, &mark);
+    if (ast == NULL) {
+        return false;
+    }
+    
+    emit_c_program(out, ast, source_name);
+    return true;
+}
+
+// Clean up a session
+void free_session(Session* session) {
+    for (int i = 0; i < session->program_count; i++) {
+        free_ast(session->programs[i]);
+    }
+    free(session->programs);
+    session->programs = NULL;
+    session->program_count = 0;
+    session->program_capacity = 0;
+    
+    free_semantic_analyzer(&session->analyzer);
+    free_optimizer(&session->optimizer);
+    free_interpreter(&session->interpreter);
+}
@@ -0,0 +1,391 @@
+#include "../include/snapshot.h"
+#include "../include/bytecode.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "KSNP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// File header; the sections follow, 8-byte aligned. Everything inside
+// the file is addressed by offset, so the image is position independent.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t entry_count;
+    uint32_t table_capacity;   // Power of two
+    uint32_t strings_length;   // Static String objects, 8-byte aligned
+    uint64_t entries_offset;
+    uint64_t table_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+    uint64_t file_hash;        // Whole file with this field zeroed, as written; not checked at load
+} SnapshotHeader;
+
+// One variable
+typedef struct {
+    uint32_t name;             // String table offsets
+    uint32_t unused;
+    Constant value;
+} SnapshotEntry;
+
+struct Snapshot {
+    void* mapping;
+    size_t size;
+    const SnapshotHeader* header;
+    const SnapshotEntry* entries;
+    const uint32_t* table;     // Entry index + 1 per slot, 0 when empty
+    const char* strings;
+};
+
+// Open-addressed set of string table offsets, keyed by the characters
+typedef struct {
+    uint32_t* slots;           // Offset + 1, 0 when empty
+    uint32_t capacity;
+    uint32_t count;
+} StringIndex;
+
+struct SnapshotBuilder {
+    SnapshotEntry* entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    
+    char* strings;
+    uint32_t strings_length;
+    uint32_t strings_capacity;
+    
+    StringIndex string_index;  // Every stored string, for sharing
+    StringIndex name_index;    // Names of the entries, for shadowing
+};
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static uint64_t hash_string(const char* string) {
+    return hash_bytes(string, strlen(string), 0);
+}
+
+// Hash of a file image, chained from its header to its sections
+static uint64_t hash_image(const SnapshotHeader* header, const char* image, size_t size) {
+    SnapshotHeader unsealed = *header;
+    unsealed.file_hash = 0;
+    
+    uint64_t header_hash = hash_bytes(&unsealed, sizeof(SnapshotHeader), 0);
+    return hash_bytes(image + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader), header_hash);
+}
+
+// Map a snapshot file. Only the header is checked here; entries are
+// bounds-checked as they are looked up, so loading never walks the file.
+Snapshot* load_snapshot(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    
+    const SnapshotHeader* header = mapping;
+    const char* base = mapping;
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, 4) == 0 &&
+                 header->version == SNAPSHOT_VERSION &&
+                 header->byte_order == SNAPSHOT_BYTE_ORDER &&
+                 header->file_size == size &&
+                 header->table_capacity > 0 &&
+                 (header->table_capacity & (header->table_capacity - 1)) == 0 &&
+                 header->entries_offset % 8 == 0 && header->table_offset % 8 == 0 &&
+                 header->entries_offset <= size && header->table_offset <= size &&
+                 header->strings_offset <= size &&
+                 header->entry_count <= (size - header->entries_offset) / sizeof(SnapshotEntry) &&
+                 header->table_capacity <= (size - header->table_offset) / sizeof(uint32_t) &&
+                 header->strings_length <= size - header->strings_offset;
+    
+    if (!valid) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    
+    Snapshot* snapshot = malloc(sizeof(Snapshot));
+    snapshot->mapping = mapping;
+    snapshot->size = size;
+    snapshot->header = header;
+    snapshot->entries = (const SnapshotEntry*)(base + header->entries_offset);
+    snapshot->table = (const uint32_t*)(base + header->table_offset);
+    snapshot->strings = base + header->strings_offset;
+    return snapshot;
+}
+
+// String at a table offset, or NULL unless it is a whole, terminated
+// static string inside the table
+static const String* snapshot_string(const Snapshot* snapshot, uint64_t offset) {
+    uint32_t length = snapshot->header->strings_length;
+    if (offset % 8 != 0 || offset > length || length - offset < sizeof(String)) {
+        return NULL;
+    }
+    
+    const String* string = (const String*)(snapshot->strings + offset);
+    bool valid = atomic_load_explicit(&string->refcount, memory_order_relaxed) == STRING_STATIC &&
+                 !string->is_interned &&
+                 string->length < length - offset - sizeof(String) &&
+                 string->chars[string->length] == '\0';
+    return valid ? string : NULL;
+}
+
+// Decode an entry's value, rejecting anything out of bounds
+static bool entry_value(const Snapshot* snapshot, const SnapshotEntry* entry, Value* value) {
+    const Constant* constant = &entry->value;
+    
+    switch (constant->type) {
+        case VALUE_NULL:   *value = create_null_value(); return true;
+        case VALUE_INT:    *value = create_int_value(constant->data.as_int); return true;
+        case VALUE_FLOAT:  *value = create_float_value(constant->data.as_float); return true;
+        case VALUE_BOOL:   *value = create_bool_value(constant->data.as_bool != 0); return true;
+        case VALUE_STRING: {
+            const String* string = snapshot_string(snapshot, constant->data.as_string);
+            if (string == NULL) {
+                return false;
+            }
+            *value = create_shared_string_value((String*)string);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Look up a variable
+bool snapshot_lookup(const Snapshot* snapshot, const char* name, Value* value) {
+    if (snapshot == NULL) {
+        return false;
+    }
+    
+    uint32_t mask = snapshot->header->table_capacity - 1;
+    uint32_t slot = (uint32_t)hash_string(name) & mask;
+    
+    for (uint32_t probes = 0; probes <= mask; probes++, slot = (slot + 1) & mask) {
+        uint32_t index = snapshot->table[slot];
+        if (index == 0) {
+            return false;
+        }
+        if (index > snapshot->header->entry_count) {
+            return false;
+        }
+        
+        const SnapshotEntry* entry = &snapshot->entries[index - 1];
+        const String* entry_name = snapshot_string(snapshot, entry->name);
+        if (entry_name != NULL && strcmp(entry_name->chars, name) == 0) {
+            return entry_value(snapshot, entry, value);
+        }
+    }
+    return false;
+}
+
+// Hash the whole mapping now rather than trust the stored file_hash, which
+// loading does not check so that it never walks the file. A snapshot whose
+// bytes changed after it was written gets another hash.
+uint64_t snapshot_hash(const Snapshot* snapshot) {
+    return hash_image(snapshot->header, snapshot->mapping, snapshot->size);
+}
+
+int snapshot_count(const Snapshot* snapshot) {
+    return (int)snapshot->header->entry_count;
+}
+
+// Unmap a snapshot
+void free_snapshot(Snapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    
+    munmap(snapshot->mapping, snapshot->size);
+    free(snapshot);
+}
+
+// Characters of a string in a builder's table
+static const char* table_chars(const char* strings, uint32_t offset) {
+    return ((const String*)(strings + offset))->chars;
+}
+
+// Find a string in an index; returns its slot, empty if absent
+static uint32_t index_find(const StringIndex* index, const char* strings, const char* string) {
+    uint32_t mask = index->capacity - 1;
+    uint32_t slot = (uint32_t)hash_string(string) & mask;
+    
+    while (index->slots[slot] != 0 && strcmp(table_chars(strings, index->slots[slot] - 1), string) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Make room for one more string in an index
+static void index_reserve(StringIndex* index, const char* strings) {
+    if ((index->count + 1) * 2 <= index->capacity) {
+        return;
+    }
+    
+    uint32_t* old_slots = index->slots;
+    uint32_t old_capacity = index->capacity;
+    
+    index->capacity = index->capacity < 64 ? 64 : index->capacity * 2;
+    index->slots = calloc(index->capacity, sizeof(uint32_t));
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i] != 0) {
+            index->slots[index_find(index, strings, table_chars(strings, old_slots[i] - 1))] = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+// Store a string once, as a static String; returns its offset
+static uint32_t intern_string(SnapshotBuilder* builder, const char* chars, size_t length) {
+    index_reserve(&builder->string_index, builder->strings);
+    
+    uint32_t slot = index_find(&builder->string_index, builder->strings, chars);
+    if (builder->string_index.slots[slot] != 0) {
+        return builder->string_index.slots[slot] - 1;
+    }
+    
+    uint32_t offset = (builder->strings_length + 7) & ~7u;
+    uint32_t end = offset + (uint32_t)string_size(length);
+    if (end > builder->strings_capacity) {
+        uint32_t capacity = builder->strings_capacity < 256 ? 256 : builder->strings_capacity;
+        while (capacity < end) {
+            capacity *= 2;
+        }
+        builder->strings = realloc(builder->strings, capacity);
+        builder->strings_capacity = capacity;
+    }
+    
+    memset(builder->strings + builder->strings_length, 0, offset - builder->strings_length);
+    init_static_string(builder->strings + offset, chars, length);
+    builder->strings_length = end;
+    
+    builder->string_index.slots[slot] = offset + 1;
+    builder->string_index.count++;
+    return offset;
+}
+
+// Start a snapshot
+SnapshotBuilder* create_snapshot_builder(void) {
+    return calloc(1, sizeof(SnapshotBuilder));
+}
+
+// Add a variable unless one with the same name was added already
+void snapshot_builder_add(SnapshotBuilder* builder, const char* name, Value value) {
+    index_reserve(&builder->name_index, builder->strings);
+    uint32_t slot = index_find(&builder->name_index, builder->strings, name);
+    if (builder->name_index.slots[slot] != 0) {
+        return;
+    }
+    
+    SnapshotEntry entry;
+    memset(&entry, 0, sizeof(SnapshotEntry));
+    entry.name = intern_string(builder, name, strlen(name));
+    entry.value.type = value.type;
+    
+    switch (value.type) {
+        case VALUE_INT:    entry.value.data.as_int = value.data.as_int; break;
+        case VALUE_FLOAT:  entry.value.data.as_float = value.data.as_float; break;
+        case VALUE_BOOL:   entry.value.data.as_bool = value.data.as_bool; break;
+        case VALUE_STRING:
+            entry.value.data.as_string = intern_string(builder, string_chars(&value), string_length(&value));
+            break;
+        default: break;
+    }
+    
+    if (builder->entry_count == builder->entry_capacity) {
+        builder->entry_capacity = builder->entry_capacity < 64 ? 64 : builder->entry_capacity * 2;
+        builder->entries = realloc(builder->entries, sizeof(SnapshotEntry) * builder->entry_capacity);
+    }
+    builder->entries[builder->entry_count++] = entry;
+    
+    // The string table may have moved, but offsets are stable
+    builder->name_index.slots[slot] = entry.name + 1;
+    builder->name_index.count++;
+}
+
+// Add every variable of an existing snapshot not already added
+void snapshot_builder_add_snapshot(SnapshotBuilder* builder, const Snapshot* snapshot) {
+    for (uint32_t i = 0; i < snapshot->header->entry_count; i++) {
+        const SnapshotEntry* entry = &snapshot->entries[i];
+        const String* name = snapshot_string(snapshot, entry->name);
+        Value value;
+        
+        if (name != NULL && entry_value(snapshot, entry, &value)) {
+            snapshot_builder_add(builder, name->chars, value);
+        }
+    }
+}
+
+// Free a builder
+static void free_snapshot_builder(SnapshotBuilder* builder) {
+    free(builder->entries);
+    free(builder->strings);
+    free(builder->string_index.slots);
+    free(builder->name_index.slots);
+    free(builder);
+}
+
+// Write the snapshot atomically and free the builder
+bool finish_snapshot(SnapshotBuilder* builder, const char* path) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    
+    uint32_t capacity = 8;
+    while (capacity < builder->entry_count * 2) {
+        capacity *= 2;
+    }
+    
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.entry_count = builder->entry_count;
+    header.table_capacity = capacity;
+    header.strings_length = builder->strings_length;
+    header.entries_offset = align8(sizeof(SnapshotHeader));
+    header.table_offset = align8(header.entries_offset + sizeof(SnapshotEntry) * header.entry_count);
+    header.strings_offset = align8(header.table_offset + sizeof(uint32_t) * capacity);
+    header.file_size = header.strings_offset + header.strings_length;
+    
+    // Lay the file out in memory exactly as it will be mapped
+    char* image = calloc(1, header.file_size);
+    uint32_t* table = (uint32_t*)(image + header.table_offset);
+    
+    if (header.entry_count > 0) {
+        memcpy(image + header.entries_offset, builder->entries, sizeof(SnapshotEntry) * header.entry_count);
+    }
+    if (header.strings_length > 0) {
+        memcpy(image + header.strings_offset, builder->strings, header.strings_length);
+    }
+    
+    for (uint32_t i = 0; i < builder->entry_count; i++) {
+        uint32_t slot = (uint32_t)hash_string(table_chars(builder->strings, builder->entries[i].name)) &
+                        (capacity - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = i + 1;
+    }
+    
+    header.file_hash = hash_image(&header, image, header.file_size);
+    memcpy(image, &header, sizeof(SnapshotHeader));
+    
+    bool written = write_file_atomically(path, image, header.file_size);
+    
+    free(image);
+    free_snapshot_builder(builder);
+    return written;
+}
@@ -0,0 +1,329 @@
+#include "../include/vm.h"
+#include "../include/operators.h"
+
+// Materialize a constant as an owned value
+static Value constant_value(const Chunk* chunk, const Constant* constant) {
+    switch (constant->type) {
+        case VALUE_INT:    return create_int_value(constant->data.as_int);
+        case VALUE_FLOAT:  return create_float_value(constant->data.as_float);
+        case VALUE_BOOL:   return create_bool_value(constant->data.as_bool != 0);
+        case VALUE_STRING:
+            // Long strings share the static string in the table; nothing is allocated
+            return create_shared_string_value(chunk_string_object(chunk, constant->data.as_string));
+        default:           return create_null_value();
+    }
+}
+
+// Report a runtime error at an instruction
+static void runtime_error(Interpreter* interpreter, const Chunk* chunk, int ip, ErrorType type, const char* message) {
+    set_error(interpreter->state, type, chunk->positions[ip].line, chunk->positions[ip].column,
+              message, NULL, 0, 0);
+    interpreter->had_error = true;
+}
+
+// Define a global from an OP_DEFINE instruction
+static void define_global(Interpreter* interpreter, const Chunk* chunk, const Instruction* instruction, Value value) {
+    const char* name = chunk_string(chunk, chunk->names[instruction->operand]);
+    env_define(&interpreter->env, name, value);
+    
+    if (interpreter->repl_mode) {
+        char* value_str = value_to_string(value);
+        printf("%s: %s = %s\n", name, value_type_to_string((ValueType)instruction->flags), value_str);
+        free(value_str);
+    }
+}
+
+// Push the value of the global an OP_LOAD at ip names
+static bool load_global(Interpreter* interpreter, const Chunk* chunk, int ip, Value** top) {
+    const char* name = chunk_string(chunk, chunk->names[chunk->code[ip].operand]);
+    Value value;
+    if (!env_get(&interpreter->env, name, &value)) {
+        runtime_error(interpreter, chunk, ip, ERROR_NAME, "Undefined variable");
+        return false;
+    }
+    *(*top)++ = copy_value(value);
+    return true;
+}
+
+// Define the global an OP_DEFINE at ip names from the top of the stack
+static void define_from_stack(Interpreter* interpreter, const Chunk* chunk, int ip, Value* stack, Value** top) {
+    Value value = *--(*top);
+    define_global(interpreter, chunk, &chunk->code[ip], value);
+    free_value(value);
+    
+    // With the stack empty only variables hold values
+    if (*top == stack) {
+        gc_safepoint(&interpreter->env.heap);
+    }
+}
+
+// Run a declaration compiled to native code. Returns false, before doing
+// anything, if a variable it reads is not an untagged value; the VM then
+// runs the declaration instead.
+static bool run_native(Interpreter* interpreter, const Chunk* chunk, JitCode* jit, const JitRegion* region) {
+    uint64_t inputs[JIT_MAX_INPUTS];
+    
+    jit->stats.entries++;
+    
+    for (int i = 0; i < region->load_count; i++) {
+        const char* name = chunk_string(chunk, chunk->names[region->loads[i]]);
+        Value value;
+        if (!env_get(&interpreter->env, name, &value)) {
+            jit->stats.side_exits++;
+            return false;
+        }
+        
+        switch (value.type) {
+            case VALUE_INT:   inputs[i] = (uint64_t)value.data.as_int; break;
+            case VALUE_FLOAT: memcpy(&inputs[i], &value.data.as_float, sizeof(double)); break;
+            case VALUE_BOOL:  inputs[i] = value.data.as_bool; break;
+            default:
+                jit->stats.side_exits++;
+                return false;
+        }
+    }
+    
+    uint64_t bits;
+    int64_t failed = jit_call(jit, region, inputs, &bits);
+    if (failed >= 0) {
+        jit->stats.side_exits++;
+        runtime_error(interpreter, chunk, (int)failed, ERROR_RUNTIME, "Division by zero");
+        return true;
+    }
+    
+    const Instruction* define = &chunk->code[region->end];
+    Value value;
+    switch ((ValueType)define->flags) {
+        case VALUE_INT:
+            value = create_int_value((int64_t)bits);
+            break;
+        case VALUE_FLOAT: {
+            double number;
+            memcpy(&number, &bits, sizeof(double));
+            value = create_float_value(number);
+            break;
+        }
+        default:
+            value = create_bool_value(bits != 0);
+            break;
+    }
+    define_global(interpreter, chunk, define, value);
+    return true;
+}
+
+// Execute a compiled chunk
+bool run_chunk(Interpreter* interpreter, const Chunk* chunk, JitCode* jit, OpProfile* profile) {
+    Value* stack = malloc(sizeof(Value) * (chunk->max_stack + 1));
+    Value* top = stack;
+    int ip = 0;
+    
+    // Locals outlive statements, so young strings in them are remembered
+    Value* locals = malloc(sizeof(Value) * (chunk->local_count + 1));
+    for (int i = 0; i < chunk->local_count; i++) {
+        locals[i] = create_null_value();
+    }
+    
+    log_message(interpreter->state, LOG_DEBUG, "Running %d instructions", chunk->code_count);
+    if (profile != NULL) {
+        profile_start_run(profile);
+    }
+    
+    while (ip < chunk->code_count && !interpreter->had_error) {
+        const Instruction* instruction = &chunk->code[ip];
+        
+        // Native declarations start with an empty stack
+        if (jit != NULL && top == stack) {
+            const JitRegion* region = jit_region(jit, ip);
+            if (region != NULL && run_native(interpreter, chunk, jit, region)) {
+                ip = region->end + 1;
+                continue;
+            }
+        }
+        
+        if (profile != NULL) {
+            profile_dispatch(profile, chunk, ip);
+        }
+        
+        switch ((OpCode)instruction->op) {
+            case OP_CONSTANT:
+                *top++ = constant_value(chunk, &chunk->constants[instruction->operand]);
+                break;
+            
+            case OP_LOAD:
+                load_global(interpreter, chunk, ip, &top);
+                break;
+            
+            case OP_DEFINE:
+                define_from_stack(interpreter, chunk, ip, stack, &top);
+                break;
+            
+            // Superinstructions run the instruction after them too
+            case OP_CONSTANT_DEFINE:
+                *top++ = constant_value(chunk, &chunk->constants[instruction->operand]);
+                define_from_stack(interpreter, chunk, ip + 1, stack, &top);
+                ip += 2;
+                continue;
+            case OP_LOAD_DEFINE:
+                if (!load_global(interpreter, chunk, ip, &top)) {
+                    break;
+                }
+                define_from_stack(interpreter, chunk, ip + 1, stack, &top);
+                ip += 2;
+                continue;
+            case OP_LOAD_LOAD:
+                if (!load_global(interpreter, chunk, ip, &top) || !load_global(interpreter, chunk, ip + 1, &top)) {
+                    break;
+                }
+                ip += 2;
+                continue;
+            case OP_LOAD_CONSTANT:
+                if (!load_global(interpreter, chunk, ip, &top)) {
+                    break;
+                }
+                *top++ = constant_value(chunk, &chunk->constants[chunk->code[ip + 1].operand]);
+                ip += 2;
+                continue;
+            case OP_CONSTANT_LOAD:
+                *top++ = constant_value(chunk, &chunk->constants[instruction->operand]);
+                if (!load_global(interpreter, chunk, ip + 1, &top)) {
+                    break;
+                }
+                ip += 2;
+                continue;
+            
+            case OP_POP:
+                free_value(*--top);
+                break;
+            
+            case OP_NEGATE_INT:
+                top[-1].data.as_int = int_arithmetic(TOKEN_MINUS, 0, top[-1].data.as_int);
+                break;
+            case OP_NEGATE_FLOAT:
+                top[-1].data.as_float = -top[-1].data.as_float;
+                break;
+            case OP_NOT:
+                top[-1].data.as_bool = !top[-1].data.as_bool;
+                break;
+            case OP_INT_TO_FLOAT:
+                top[-1] = create_float_value((double)top[-1].data.as_int);
+                break;
+            
+            case OP_DIVIDE_INT:
+            case OP_MODULO_INT:
+                if (top[-1].data.as_int == 0) {
+                    runtime_error(interpreter, chunk, ip, ERROR_RUNTIME, "Division by zero");
+                    break;
+                }
+                // fall through
+            case OP_ADD_INT:
+            case OP_SUBTRACT_INT:
+            case OP_MULTIPLY_INT: {
+                static const TokenType int_ops[] = {TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR, TOKEN_SLASH, TOKEN_PERCENT};
+                top--;
+                top[-1].data.as_int = int_arithmetic(int_ops[instruction->op - OP_ADD_INT],
+                                                     top[-1].data.as_int, top[0].data.as_int);
+                break;
+            }
+            
+            case OP_ADD_FLOAT:
+            case OP_SUBTRACT_FLOAT:
+            case OP_MULTIPLY_FLOAT:
+            case OP_DIVIDE_FLOAT:
+            case OP_MODULO_FLOAT: {
+                static const TokenType float_ops[] = {TOKEN_PLUS, TOKEN_MINUS, TOKEN_STAR, TOKEN_SLASH, TOKEN_PERCENT};
+                top--;
+                top[-1].data.as_float = float_arithmetic(float_ops[instruction->op - OP_ADD_FLOAT],
+                                                         top[-1].data.as_float, top[0].data.as_float);
+                break;
+            }
+            
+            case OP_CONCAT: {
+                top--;
+                Value result = env_concat(&interpreter->env, top[-1], top[0]);
+                free_value(top[-1]);
+                free_value(top[0]);
+                top[-1] = result;
+                break;
+            }
+            
+            case OP_COMPARE_INT: {
+                top--;
+                int64_t a = top[-1].data.as_int;
+                int64_t b = top[0].data.as_int;
+                top[-1] = create_bool_value(compare_result((TokenType)instruction->flags, (a > b) - (a < b)));
+                break;
+            }
+            case OP_COMPARE_FLOAT: {
+                top--;
+                top[-1] = create_bool_value(float_compare((TokenType)instruction->flags,
+                                                          top[-1].data.as_float, top[0].data.as_float));
+                break;
+            }
+            case OP_COMPARE_BOOL: {
+                top--;
+                int cmp = top[-1].data.as_bool != top[0].data.as_bool;
+                top[-1] = create_bool_value(compare_result((TokenType)instruction->flags, cmp));
+                break;
+            }
+            case OP_COMPARE_STRING: {
+                top--;
+                TokenType op = (TokenType)instruction->flags;
+                int cmp = (op == TOKEN_EQUAL_EQUAL || op == TOKEN_BANG_EQUAL)
+                    ? !string_values_equal(top[-1], top[0])
+                    : compare_string_values(top[-1], top[0]);
+                free_value(top[-1]);
+                free_value(top[0]);
+                top[-1] = create_bool_value(compare_result((TokenType)instruction->flags, cmp));
+                break;
+            }
+            case OP_COMPARE_NULL:
+                top--;
+                free_value(top[-1]);
+                free_value(top[0]);
+                top[-1] = create_bool_value(compare_result((TokenType)instruction->flags, instruction->operand));
+                break;
+            
+            case OP_JUMP_IF_FALSE:
+                if (!top[-1].data.as_bool) {
+                    ip = instruction->operand;
+                    continue;
+                }
+                break;
+            case OP_JUMP_IF_TRUE:
+                if (top[-1].data.as_bool) {
+                    ip = instruction->operand;
+                    continue;
+                }
+                break;
+            
+            case OP_GET_LOCAL:
+                *top++ = copy_value(locals[instruction->operand]);
+                break;
+            case OP_SET_LOCAL:
+                free_value(locals[instruction->operand]);
+                locals[instruction->operand] = *--top;
+                gc_write_barrier(&interpreter->env.heap, &locals[instruction->operand]);
+                break;
+            
+            default:
+                runtime_error(interpreter, chunk, ip, ERROR_INTERNAL, "Invalid instruction");
+                break;
+        }
+        
+        ip++;
+    }
+    
+    // Release anything left behind by an error
+    while (top > stack) {
+        free_value(*--top);
+    }
+    free(stack);
+    
+    gc_forget(&interpreter->env.heap, locals, chunk->local_count);
+    for (int i = 0; i < chunk->local_count; i++) {
+        free_value(locals[i]);
+    }
+    free(locals);
+    
+    return !interpreter->had_error;
+}
@@ -0,0 +1,174 @@
+// Tests of the embedding API in include/kasd.h that the case programs
+// cannot reach: what a context keeps after errors and between calls, on a
+// heap context and on a region context, and where freed memory goes.
+
+#include "../include/kasd.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size of the slabs the object pools carve
+#define SLAB_SIZE (64 * 1024)
+
+static atomic_int slabs_allocated = 0;
+
+static int checks = 0;
+static int failures = 0;
+
+static void check(bool passed, const char* what, KasdContext* context) {
+    checks++;
+    if (!passed) {
+        const char* error = context != NULL ? kasd_get_error(context) : NULL;
+        fprintf(stderr, "FAIL %s%s%s\n", what, error != NULL ? ": " : "", error != NULL ? error : "");
+        failures++;
+    }
+}
+
+static bool has_variable(KasdContext* context, const char* name) {
+    KasdValue value;
+    if (!kasd_get_variable(context, name, &value)) {
+        return false;
+    }
+    kasd_free_value(value);
+    return true;
+}
+
+// A runtime error discards every variable of the failed input, also the
+// ones it defined before the error, and the input can be entered again
+static void test_rollback(KasdContext* context) {
+    check(kasd_execute(context, "let zero: int = 0;"), "rollback: setup", context);
+    check(!kasd_execute(context, "let before: string = \"a string on the heap, not inline\"; "
+                                 "let failed: int = 1 / zero;"),
+          "rollback: division by zero not reported", context);
+    check(!has_variable(context, "before"), "rollback: variable of failed input kept", context);
+    check(has_variable(context, "zero"), "rollback: earlier variable lost", context);
+    check(kasd_execute(context, "let before: int = 1; let failed: int = before + zero;"),
+          "rollback: input not accepted again", context);
+}
+
+// Variables defined by kasd_run are declared in the context: later code
+// reads them with their types, and cannot declare them again differently
+static void test_run_declares(KasdContext* context) {
+    KasdScript* script = kasd_compile(context, "let x: int = 41; let label: string = null;");
+    check(script != NULL && kasd_run(context, script), "run: script failed", context);
+    check(kasd_execute(context, "let y: int = x + 1;"), "run: variable not declared", context);
+    check(!kasd_execute(context, "let x: string = \"text\";"), "run: redeclared by execute", context);
+    check(!kasd_execute(context, "let z: string = label + \"text\";"), "run: null type lost", context);
+    check(kasd_run(context, script), "run: script not run again", context);
+    kasd_free_script(script);
+    
+    script = kasd_compile(context, "let fresh: int = 1; let x: string = \"text\";");
+    check(script != NULL && !kasd_run(context, script), "run: redeclared by run", context);
+    check(!has_variable(context, "fresh"), "run: ran despite clash", context);
+    kasd_free_script(script);
+    
+    // A runtime error discards what the script defined
+    script = kasd_compile(context, "let zero: int = 0; let before: int = 1; let failed: int = before / zero;");
+    check(script != NULL && !kasd_run(context, script), "run: division by zero not reported", context);
+    check(!kasd_execute(context, "let after: int = before;"), "run: variable of failed run declared", context);
+    kasd_free_script(script);
+}
+
+// Bytes the collector promotes after 1000 concatenations, each also
+// copied to a second variable when aliased
+static unsigned long long promoted_bytes(bool aliased) {
+    KasdContext* context = kasd_create_context(KASD_LOG_NONE);
+    char source[600];
+    
+    // A variable from kasd_run is not a known constant, so the
+    // concatenations are not folded
+    strcpy(source, "let part: string = \"");
+    memset(source + strlen(source), 'x', 500);
+    strcpy(source + strlen("let part: string = \"") + 500, "\";");
+    KasdScript* script = kasd_compile(context, source);
+    check(script != NULL && kasd_run(context, script), "gc: setup", context);
+    kasd_free_script(script);
+    
+    bool executed = true;
+    for (int i = 0; i < 1000 && executed; i++) {
+        snprintf(source, sizeof(source), aliased ? "let a_%d: string = part + part; let b_%d: string = a_%d;"
+                                                 : "let a_%d: string = part + part;", i, i, i);
+        executed = kasd_execute(context, source);
+    }
+    check(executed, "gc: concatenation failed", context);
+    
+    KasdGcStats stats;
+    kasd_get_gc_stats(context, &stats);
+    check(stats.collections > 0, "gc: no collection", context);
+    kasd_free_context(context);
+    return stats.bytes_promoted;
+}
+
+// A young string held by two variables is promoted once
+static void test_promote_aliased(void) {
+    check(promoted_bytes(true) == promoted_bytes(false), "gc: aliased string promoted twice", NULL);
+}
+
+static void* count_allocate(void* user_data, size_t size) {
+    (void)user_data;
+    if (size == SLAB_SIZE) {
+        atomic_fetch_add(&slabs_allocated, 1);
+    }
+    return aligned_alloc(16, (size + 15) & ~(size_t)15);
+}
+
+static void count_deallocate(void* user_data, void* pointer, size_t size) {
+    (void)user_data;
+    (void)size;
+    free(pointer);
+}
+
+static KasdContext* filled_context(void) {
+    KasdContext* context = kasd_create_context(KASD_LOG_NONE);
+    char source[64];
+    for (int i = 0; i < 100; i++) {
+        snprintf(source, sizeof(source), "let variable_%d: int = %d;", i, i);
+        kasd_execute(context, source);
+    }
+    return context;
+}
+
+static void* free_context(void* context) {
+    kasd_free_context(context);
+    return NULL;
+}
+
+// Memory one thread allocates and another only frees goes back to the
+// shared pools when the freeing thread exits, instead of being lost with
+// its cache, so the allocating thread does not need new slabs
+static void test_cross_thread_free(void) {
+    kasd_free_context(filled_context());
+    int slabs_before = atomic_load(&slabs_allocated);
+    
+    for (int i = 0; i < 100; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, free_context, filled_context());
+        pthread_join(thread, NULL);
+    }
+    check(atomic_load(&slabs_allocated) - slabs_before <= 2, "pool: slots freed by exiting threads lost", NULL);
+}
+
+int main(void) {
+    KasdAllocator allocator = {count_allocate, count_deallocate, NULL};
+    if (!kasd_set_allocator(&allocator)) {
+        fprintf(stderr, "FAIL could not set the allocator\n");
+        return 1;
+    }
+    
+    KasdContext* contexts[] = {kasd_create_context(KASD_LOG_NONE), kasd_create_region_context(KASD_LOG_NONE)};
+    
+    for (int i = 0; i < 2; i++) {
+        test_rollback(contexts[i]);
+        kasd_reset_context(contexts[i]);
+        test_run_declares(contexts[i]);
+        kasd_free_context(contexts[i]);
+    }
+    
+    test_promote_aliased();
+    test_cross_thread_free();
+    
+    printf("api: %d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#!/bin/sh
+# Run every tests/cases/*.kasd on each engine, optimization level and JIT
+# setting, and from its compiled .kasdc file, and compare what it defines
+# with tests/cases/*.out. A case that runs to the end is compared by the
+# value of every variable; a case that fails is compared by its error.
+#
+#   tests/run_cases.sh [case.kasd ...]
+#
+# Variables are read back by saving the environment with --snapshot and
+# declaring a copy of each one in the REPL, which prints it. Programs
+# translated with --emit-c print their variables themselves; those runs
+# need lib/libkasdrt.a (make runtime) and are skipped without it.
+
+KASD=${KASD:-bin/kasd}
+CC=${CC:-gcc}
+CASES_DIR=$(dirname "$0")/cases
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- "$CASES_DIR"/*.kasd
+fi
+
+failures=0
+runs=0
+
+# Drop colors and REPL prompts, and the q_ prefix of the copies
+clean() {
+    sed -e 's/\x1b\[[0-9;]*m//g' -e '/^KASD Language Interpreter/d' -e "/^Type 'exit'/d" \
+        -e 's/^\(> \)*//' -e 's/^q_//' -e '/^$/d'
+}
+
+# Output of one run of a case on the vm or a tree engine
+run_engine() {
+    case_file=$1
+    shift
+    rm -f "$WORK/env.snap"
+    if "$KASD" "$@" --snapshot "$WORK/env.snap" "$case_file" > /dev/null 2> "$WORK/err"; then
+        grep -o '^let [A-Za-z_][A-Za-z0-9_]*: *[a-z]*' "$case_file" |
+            sed 's/^let \([A-Za-z0-9_]*\): *\([a-z]*\)/let q_\1: \2 = \1;/' |
+            "$KASD" --from-snapshot "$WORK/env.snap" 2>&1 | clean
+    else
+        clean < "$WORK/err"
+    fi
+}
+
+# Output of a case translated to C
+run_emit_c() {
+    case_file=$1
+    shift
+    "$KASD" "$@" --emit-c "$case_file" > "$WORK/prog.c" 2> "$WORK/err" &&
+        "$CC" -O1 -Iinclude "$WORK/prog.c" -Llib -lkasdrt -lm -o "$WORK/prog" 2>> "$WORK/err"
+    if [ $? -ne 0 ]; then
+        clean < "$WORK/err"
+    elif "$WORK/prog" > "$WORK/out" 2> "$WORK/err"; then
+        clean < "$WORK/out"
+    else
+        clean < "$WORK/err"
+    fi
+}
+
+check() {
+    name=$1
+    expected=$2
+    shift 2
+    runs=$((runs + 1))
+    if ! cmp -s "$expected" "$WORK/actual"; then
+        failures=$((failures + 1))
+        echo "FAIL $name ($*)"
+        diff "$expected" "$WORK/actual" | head -20
+    fi
+}
+
+for case_file in "$@"; do
+    name=$(basename "$case_file" .kasd)
+    expected="${case_file%.kasd}.out"
+    if [ ! -f "$expected" ]; then
+        echo "FAIL $name: no $expected"
+        failures=$((failures + 1))
+        continue
+    fi
+
+    # Writing the same program twice gives identical files, so that their
+    # hashes identify their contents. glibc fills new memory with a
+    # different byte in each run, so bytes never written show up.
+    rm -rf "$WORK/1" "$WORK/2"
+    for copy in 1 2; do
+        mkdir "$WORK/$copy"
+        MALLOC_PERTURB_=$copy "$KASD" --cache-dir "$WORK/$copy" --snapshot "$WORK/$copy/env.snap" \
+            "$case_file" > /dev/null 2>&1
+    done
+    runs=$((runs + 1))
+    if ! diff -r "$WORK/1" "$WORK/2" > /dev/null; then
+        failures=$((failures + 1))
+        echo "FAIL $name (compiled file or snapshot differs between writes)"
+    fi
+
+    for opt in -O0 -O1 -O2; do
+        for jit in --jit=off --jit=on; do
+            run_engine "$case_file" --no-cache $opt $jit > "$WORK/actual"
+            check "$name" "$expected" vm $opt $jit
+        done
+        for engine in closure ast; do
+            run_engine "$case_file" --no-cache $opt --engine $engine > "$WORK/actual"
+            check "$name" "$expected" $engine $opt
+        done
+
+        # The second run executes the compiled file written by the first;
+        # a third one checks that the file is used rather than rebuilt
+        rm -rf "$WORK/cache"
+        mkdir "$WORK/cache"
+        run_engine "$case_file" --cache-dir "$WORK/cache" $opt > /dev/null
+        run_engine "$case_file" --cache-dir "$WORK/cache" $opt > "$WORK/actual"
+        check "$name" "$expected" vm $opt from .kasdc
+        if ! "$KASD" -l 3 --cache-dir "$WORK/cache" $opt --snapshot "$WORK/env.snap" "$case_file" 2>&1 |
+                grep -q "Loaded compiled script"; then
+            failures=$((failures + 1))
+            echo "FAIL $name (vm $opt: compiled file not loaded)"
+        fi
+
+        if [ -f lib/libkasdrt.a ]; then
+            run_emit_c "$case_file" $opt > "$WORK/actual"
+            check "$name" "$expected" emit-c $opt
+        fi
+    done
+done
+
+echo "cases: $runs runs, $failures failed"
+[ $failures -eq 0 ]
@@ -0,0 +1,167 @@
+// Stress test for independent contexts on concurrent threads.
+//
+// Every thread creates heap and region contexts in turn, compiles the same
+// scripts (so compiled code, interned literals and the cache are shared
+// across threads), runs them, reads the results back and provokes errors.
+// Build with -fsanitize=thread (make stress) to check for data races.
+
+#include "../include/kasd.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_ITERATIONS 200
+
+static const char* script_source =
+    "let base: int = 40;\n"
+    "let answer: int = base + 2;\n"
+    "let ratio: float = answer / 4.0;\n"
+    "let greeting: string = \"hello\";\n"
+    "let message: string = greeting + \", \" + \"world\";\n"
+    "let ordered: bool = greeting < message && answer > base;\n"
+    "let banner: string = \"a literal long enough to be shared on the heap\";\n";
+
+// Differs per thread, so each thread also adds new entries to the cache
+static const char* thread_source_format = "let id: int = %d; let name: string = \"thread \" + \"%d\";";
+
+typedef struct {
+    int id;
+    int iterations;
+    int failures;
+} Worker;
+
+static void fail(Worker* worker, const char* what, const char* detail) {
+    fprintf(stderr, "thread %d: %s%s%s\n", worker->id, what, detail != NULL ? ": " : "",
+            detail != NULL ? detail : "");
+    worker->failures++;
+}
+
+static void expect_int(Worker* worker, KasdContext* context, const char* name, long long expected) {
+    KasdValue value;
+    if (!kasd_get_variable(context, name, &value) || value.type != KASD_VALUE_INT ||
+        value.data.as_int != expected) {
+        fail(worker, "wrong int", name);
+        return;
+    }
+    kasd_free_value(value);
+}
+
+static void expect_string(Worker* worker, KasdContext* context, const char* name, const char* expected) {
+    KasdValue value;
+    if (!kasd_get_variable(context, name, &value)) {
+        fail(worker, "missing string", name);
+        return;
+    }
+    if (value.type != KASD_VALUE_STRING || strcmp(value.data.as_string, expected) != 0) {
+        fail(worker, "wrong string", name);
+    }
+    kasd_free_value(value);
+}
+
+static void check_script(Worker* worker, KasdContext* context) {
+    KasdValue value;
+    
+    expect_int(worker, context, "answer", 42);
+    expect_string(worker, context, "message", "hello, world");
+    expect_string(worker, context, "banner", "a literal long enough to be shared on the heap");
+    if (!kasd_get_variable(context, "ratio", &value) || value.type != KASD_VALUE_FLOAT ||
+        value.data.as_float != 10.5) {
+        fail(worker, "wrong float", "ratio");
+    }
+    if (!kasd_get_variable(context, "ordered", &value) || value.type != KASD_VALUE_BOOL || !value.data.as_bool) {
+        fail(worker, "wrong bool", "ordered");
+    }
+}
+
+static void run_once(Worker* worker, int iteration) {
+    bool region = (iteration + worker->id) % 2 == 0;
+    KasdContext* context = region ? kasd_create_region_context(KASD_LOG_NONE)
+                                  : kasd_create_context(KASD_LOG_NONE);
+    char source[128];
+    char expected[32];
+    
+    // Shared script, compiled by whichever thread gets there first
+    KasdScript* script = kasd_compile(context, script_source);
+    if (script == NULL) {
+        fail(worker, "compile failed", kasd_get_error(context));
+    } else {
+        if (!kasd_run(context, script)) {
+            fail(worker, "run failed", kasd_get_error(context));
+        }
+        check_script(worker, context);
+        kasd_free_script(script);
+    }
+    
+    // Script of this thread
+    snprintf(source, sizeof(source), thread_source_format, worker->id, worker->id);
+    snprintf(expected, sizeof(expected), "thread %d", worker->id);
+    script = kasd_compile(context, source);
+    if (script == NULL || !kasd_run(context, script)) {
+        fail(worker, "thread script failed", kasd_get_error(context));
+    } else {
+        expect_int(worker, context, "id", worker->id);
+        expect_string(worker, context, "name", expected);
+    }
+    kasd_free_script(script);
+    
+    // Errors are reported to this context only
+    if (kasd_execute(context, "let broken: int = \"text\";")) {
+        fail(worker, "type error not reported", NULL);
+    } else if (kasd_get_error(context) == NULL || strstr(kasd_get_error(context), "Type mismatch") == NULL) {
+        fail(worker, "wrong error", kasd_get_error(context));
+    }
+    if (!kasd_execute(context, "let extra: string = \"x\" + \"y\";")) {
+        fail(worker, "execute failed", kasd_get_error(context));
+    }
+    expect_string(worker, context, "extra", "xy");
+    
+    // Region contexts are reused after a reset
+    if (region) {
+        kasd_reset_context(context);
+        if (kasd_get_variable(context, "answer", &(KasdValue){0})) {
+            fail(worker, "variable survived reset", "answer");
+        }
+    }
+    kasd_free_context(context);
+}
+
+static void* run_worker(void* argument) {
+    Worker* worker = argument;
+    for (int i = 0; i < worker->iterations; i++) {
+        run_once(worker, i);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    int thread_count = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+    int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+    if (thread_count < 1 || iterations < 1) {
+        fprintf(stderr, "Usage: %s [threads] [iterations]\n", argv[0]);
+        return 2;
+    }
+    
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    Worker* workers = malloc(sizeof(Worker) * thread_count);
+    for (int i = 0; i < thread_count; i++) {
+        workers[i] = (Worker){i, iterations, 0};
+        pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+    }
+    
+    int failures = 0;
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+        failures += workers[i].failures;
+    }
+    
+    KasdCacheStats stats;
+    kasd_cache_get_stats(&stats);
+    printf("stress: %d threads x %d iterations, %d failures, cache %llu hits, %llu misses\n",
+           thread_count, iterations, failures, stats.hits, stats.misses);
+    
+    free(threads);
+    free(workers);
+    return failures == 0 ? 0 : 1;
+}